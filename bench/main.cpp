@@ -0,0 +1,387 @@
+#include <dsp/bench/speed_tester.h>
+#include <dsp/bench/fir_crossover.h>
+#include <dsp/bench/fm_if_throughput.h>
+#include <dsp/bench/convert_throughput.h>
+#include <dsp/bench/quadrature_accuracy.h>
+#include <dsp/bench/level_parity.h>
+#include <dsp/bench/simd_kernels.h>
+#include <dsp/filter/fir.h>
+#include <dsp/multirate/power_decimator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include <dsp/channel/rx_vfo.h>
+#include <dsp/demod/fm.h>
+#include <dsp/demod/broadcast_fm.h>
+#include <dsp/demod/am.h>
+#include <dsp/demod/ssb.h>
+#include <dsp/demod/psk.h>
+#include <dsp/clock_recovery/mm.h>
+#include <dsp/noise_reduction/squelch.h>
+#include <dsp/compression/sample_stream_compressor.h>
+#include <dsp/compression/sample_stream_decompressor.h>
+#include <server_compression.h>
+#include <wavreader.h>
+#include <command_args.h>
+#include <json.hpp>
+#include <functional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+using nlohmann::json;
+
+// Largest errors of the benchmarks that compare to a reference. Going over one makes sdrpp_bench fail, so that
+// upgrades of volk, FFTW or the compiler can be gated on it.
+#define BENCH_QUADRATURE_TOLERANCE  1e-4    // Radians, volk's polynomial atan2 is within a few 1e-6
+#define BENCH_PARITY_TOLERANCE      1e-4    // Relative to the amplitude of the reference output
+#define BENCH_SIMD_TOLERANCE        1e-6    // The kernels are expected to match the generic ones exactly
+
+struct BenchResult {
+    std::string name;
+    double rate;                // Input samples per second
+    double maxError = NAN;      // Only given by the benchmarks that compare to a reference
+    double tolerance = NAN;     // Largest maxError that passes
+    double ratio = NAN;         // Only given by the compression benchmarks, size of the samples as float32 over encoded size
+
+    bool failed() const { return !isnan(tolerance) && !(maxError <= tolerance); }
+};
+
+// Recording the compression benchmarks are run on, random samples are used when none is given
+std::string inputFile;
+int compressionThreads = 1;
+
+struct Bench {
+    std::string name;
+    std::function<void(std::vector<BenchResult>& results, int durationMs, int bufferSize)> run;
+};
+
+// Throughput of a block fed random samples as fast as it takes them, its output being discarded
+template <class I, class O, class BLK, class... Args>
+double blockRate(int durationMs, int bufferSize, Args... args) {
+    dsp::stream<I> in;
+    BLK blk;
+    blk.init(&in, args...);
+    dsp::bench::SpeedTester<I, O> tester(&in, &blk.out);
+    blk.start();
+    double rate = tester.benchmark(durationMs, bufferSize);
+    blk.stop();
+    return rate;
+}
+
+template <class I, class O, class BLK, class... Args>
+Bench blockBench(std::string name, Args... args) {
+    return { name, [=](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        results.push_back({ name, blockRate<I, O, BLK>(durationMs, bufferSize, args...) });
+    } };
+}
+
+template <class D, class T>
+Bench firBench(std::string name, int tapCount) {
+    return { name, [=](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        // Random taps, only their count matters
+        dsp::tap<T> taps = dsp::taps::alloc<T>(tapCount);
+        for (int i = 0; i < tapCount; i++) { taps.taps[i] = (float)rand() / (float)RAND_MAX; }
+        results.push_back({ name, blockRate<D, D, dsp::filter::FIR<D, T>>(durationMs, bufferSize, taps) });
+        dsp::taps::free(taps);
+    } };
+}
+
+// Load up to maxCount samples of a stereo WAV recording as done by the file source
+bool loadRecording(std::string path, std::vector<dsp::complex_t>& samples, int maxCount) {
+    WavReader reader(path);
+    if (!reader.isValid() || reader.getChannelCount() != 2) {
+        fprintf(stderr, "%s is not a stereo WAV file\n", path.c_str());
+        return false;
+    }
+    int bitDepth = reader.getBitDepth();
+    bool isFloat = (reader.getCodec() == WAV_SAMPLE_TYPE_FLOAT);
+    if (isFloat ? (bitDepth != 32) : (bitDepth != 8 && bitDepth != 16)) {
+        fprintf(stderr, "%s has an unsupported sample format\n", path.c_str());
+        return false;
+    }
+
+    int count = std::min<uint64_t>(reader.getSampleCount(), maxCount);
+    std::vector<uint8_t> raw(count * reader.getFrameSize());
+    count = reader.read(raw.data(), count);
+    samples.resize(count);
+    if (isFloat) {
+        memcpy(samples.data(), raw.data(), count * sizeof(dsp::complex_t));
+    }
+    else if (bitDepth == 16) {
+        volk_16i_s32f_convert_32f((float*)samples.data(), (int16_t*)raw.data(), 32768.0f, count * 2);
+    }
+    else {
+        // 8 bit WAV samples are unsigned
+        float* out = (float*)samples.data();
+        for (int i = 0; i < count * 2; i++) { out[i] = ((float)raw[i] - 128.0f) / 128.0f; }
+    }
+    return true;
+}
+
+// Encode the samples in buffers of bufferSize with the settings of the server, then decode them to check that only
+// the quantization of the sample type is lost
+BenchResult compressionRate(std::string name, const std::vector<dsp::complex_t>& samples, server::EncoderSettings settings, int durationMs, int bufferSize) {
+    server::Encoder encoder(compressionThreads);
+    bufferSize = std::min<int>(bufferSize, STREAM_BUFFER_SIZE);
+    std::vector<uint8_t> encoded(server::Encoder::maxEncodedSize(bufferSize));
+
+    // Encode the recording over and over for the duration
+    uint64_t inSize = 0;
+    uint64_t outSize = 0;
+    int offset = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    double elapsed = 0.0;
+    while (elapsed * 1000.0 < durationMs) {
+        int count = std::min<int>(bufferSize, samples.size() - offset);
+        outSize += encoder.encode(&samples[offset], count, settings, encoded.data(), encoded.size());
+        inSize += count;
+        offset += count;
+        if (offset >= samples.size()) { offset = 0; }
+        elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Check one pass over the recording, the error is relative to the peak of each buffer
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    dsp::compression::SampleStreamDecompressor decomp;
+    std::vector<uint8_t> pcm(bufferSize * sizeof(dsp::complex_t) + 8);
+    std::vector<dsp::complex_t> decoded(bufferSize);
+    double maxError = 0.0;
+    for (int i = 0; i < samples.size(); i += bufferSize) {
+        int count = std::min<int>(bufferSize, samples.size() - i);
+        size_t size = encoder.encode(&samples[i], count, settings, encoded.data(), encoded.size());
+        if (settings.level) {
+            size = ZSTD_decompressDCtx(dctx, pcm.data(), pcm.size(), encoded.data(), size);
+            if (ZSTD_isError(size)) { maxError = INFINITY; break; }
+        }
+        else {
+            memcpy(pcm.data(), encoded.data(), size);
+        }
+        if (decomp.process(size, pcm.data(), decoded.data()) != count) { maxError = INFINITY; break; }
+        float peak = dsp::compression::SampleStreamCompressor::peak(&samples[i], count);
+        if (peak <= 0.0f) { continue; }
+        for (int j = 0; j < count; j++) {
+            maxError = std::max<double>(maxError, fabs(decoded[j].re - samples[i + j].re) / peak);
+            maxError = std::max<double>(maxError, fabs(decoded[j].im - samples[i + j].im) / peak);
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+
+    // Only the quantization to the sample type may be lost, which is at most one step of it relative to the peak
+    static const double quantization[] = { 1.0 / 127.0, 1.0 / 32767.0, 0.0 };
+    BenchResult res = { name, inSize / elapsed, maxError, quantization[settings.pcmType] };
+    res.ratio = outSize ? ((double)(inSize * sizeof(dsp::complex_t)) / (double)outSize) : NAN;
+    return res;
+}
+
+std::vector<Bench> listBenches() {
+    std::vector<Bench> benches;
+
+    // Filters, using the automatic choice between direct and FFT convolution
+    for (int tc : { 16, 64, 256, 1024 }) {
+        benches.push_back(firBench<dsp::complex_t, float>("filter/fir/complex/" + std::to_string(tc), tc));
+        benches.push_back(firBench<float, float>("filter/fir/real/" + std::to_string(tc), tc));
+    }
+    benches.push_back({ "filter/fir/crossover", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        int crossover;
+        for (auto& res : dsp::bench::firCrossover<dsp::complex_t, float>(crossover, 16, 2048, durationMs, bufferSize)) {
+            results.push_back({ "filter/fir/crossover/" + std::to_string(res.tapCount) + "/direct", res.directRate });
+            results.push_back({ "filter/fir/crossover/" + std::to_string(res.tapCount) + "/fft", res.fftRate });
+        }
+    } });
+
+    // Every decimation plan
+    for (int i = 0; i < sizeof(dsp::multirate::decim::plans) / sizeof(dsp::multirate::decim::plans[0]); i++) {
+        unsigned int ratio = 2 << i;
+        benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::multirate::PowerDecimator<dsp::complex_t>>("multirate/power_decimator/" + std::to_string(ratio), ratio));
+    }
+
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::multirate::RationalResampler<dsp::complex_t>>("multirate/rational_resampler/2400000_250000", 2400000.0, 250000.0));
+    benches.push_back(blockBench<dsp::stereo_t, dsp::stereo_t, dsp::multirate::RationalResampler<dsp::stereo_t>>("multirate/rational_resampler/stereo/250000_48000", 250000.0, 48000.0));
+
+    // VFOs as used by the radio for WFM and NFM
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::channel::RxVFO>("channel/rx_vfo/wfm", 2400000.0, 250000.0, 200000.0, 300000.0));
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::channel::RxVFO>("channel/rx_vfo/nfm", 2400000.0, 50000.0, 12500.0, 300000.0));
+
+    // Demodulators at the IF samplerates of the radio
+    benches.push_back({ "demod/quadrature", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        auto res = dsp::bench::quadratureAccuracy(durationMs, bufferSize);
+        results.push_back({ "demod/quadrature/reference", res.referenceRate });
+        results.push_back({ "demod/quadrature", res.rate, res.maxError, BENCH_QUADRATURE_TOLERANCE });
+    } });
+    benches.push_back(blockBench<dsp::complex_t, float, dsp::demod::FM<float>>("demod/fm", 50000.0, 12500.0, true, false));
+    benches.push_back(blockBench<dsp::complex_t, dsp::stereo_t, dsp::demod::BroadcastFM>("demod/broadcast_fm/mono", 75000.0, 250000.0, false, true));
+    benches.push_back(blockBench<dsp::complex_t, dsp::stereo_t, dsp::demod::BroadcastFM>("demod/broadcast_fm/stereo", 75000.0, 250000.0, true, true));
+    benches.push_back(blockBench<dsp::complex_t, float, dsp::demod::AM<float>>("demod/am", dsp::demod::AM<float>::CARRIER, 10000.0, 50.0 / 15000.0, 5.0 / 15000.0, 100.0 / 15000.0, 15000.0));
+    benches.push_back(blockBench<dsp::complex_t, float, dsp::demod::SSB<float>>("demod/ssb", dsp::demod::SSB<float>::USB, 2800.0, 24000.0, 50.0 / 24000.0, 5.0 / 24000.0));
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::demod::PSK<4>>("demod/psk/qpsk", 72000.0, 144000.0, 33, 0.6, 0.1, 0.005, 1e-6, 0.01));
+
+    // Clock recovery, complex as for PSK and real as for POCSAG
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::clock_recovery::MM<dsp::complex_t>>("clock_recovery/mm/complex", 2.0, 1e-6, 0.01, 0.01));
+    benches.push_back(blockBench<float, float, dsp::clock_recovery::MM<float>>("clock_recovery/mm/real", 20.0, 1e-4, 1.0, 0.05));
+
+    // Level and noise reduction
+    benches.push_back({ "loop/agc", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        auto res = dsp::bench::agcParity(durationMs);
+        results.push_back({ "loop/agc/reference", res.referenceRate });
+        results.push_back({ "loop/agc", res.rate, res.maxError, BENCH_PARITY_TOLERANCE });
+    } });
+    benches.push_back({ "noise_reduction/noise_blanker", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        auto res = dsp::bench::noiseBlankerParity(durationMs);
+        results.push_back({ "noise_reduction/noise_blanker/reference", res.referenceRate });
+        results.push_back({ "noise_reduction/noise_blanker", res.rate, res.maxError, BENCH_PARITY_TOLERANCE });
+    } });
+    benches.push_back({ "noise_reduction/fm_if", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        for (auto& res : dsp::bench::fmifThroughput({ 32, 64, 128 }, durationMs, bufferSize)) {
+            results.push_back({ "noise_reduction/fm_if/" + std::to_string(res.bins) + "/reference", res.referenceRate });
+            results.push_back({ "noise_reduction/fm_if/" + std::to_string(res.bins), res.slidingRate });
+        }
+    } });
+    benches.push_back(blockBench<dsp::complex_t, dsp::complex_t, dsp::noise_reduction::Squelch>("noise_reduction/squelch", -50.0));
+
+    // Raw IQ conversion done by the sources and compression done by the server
+    benches.push_back({ "convert", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        const char* names[] = { "u8", "s8", "s12_packed", "s16", "s24", "f32" };
+        double referenceRate;
+        auto conv = dsp::bench::convertThroughput(referenceRate, durationMs, bufferSize);
+        results.push_back({ "convert/u8/reference", referenceRate });
+        for (auto& res : conv) {
+            results.push_back({ std::string("convert/") + names[res.format], res.rate });
+        }
+    } });
+    benches.push_back(blockBench<dsp::complex_t, uint8_t, dsp::compression::SampleStreamCompressor>("compression/sample_stream_compressor/i8", dsp::compression::PCM_TYPE_I8));
+    benches.push_back(blockBench<dsp::complex_t, uint8_t, dsp::compression::SampleStreamCompressor>("compression/sample_stream_compressor/i16", dsp::compression::PCM_TYPE_I16));
+    benches.push_back(blockBench<dsp::complex_t, uint8_t, dsp::compression::SampleStreamCompressor>("compression/sample_stream_compressor/f32", dsp::compression::PCM_TYPE_F32));
+
+    // Kernels of every instruction set the CPU supports, compared to the generic ones
+    benches.push_back({ "simd", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        for (auto& res : dsp::bench::simdKernels(durationMs, bufferSize)) {
+            results.push_back({ std::string("simd/") + res.kernel + "/" + dsp::simd::archName(res.arch), res.rate, res.maxError, BENCH_SIMD_TOLERANCE });
+        }
+    } });
+
+    // Baseband compression of the server for every sample type, preprocessing and level the rate controller uses
+    benches.push_back({ "compression/server", [](std::vector<BenchResult>& results, int durationMs, int bufferSize) {
+        // Ten seconds of a recording or of noise with a few carriers
+        std::vector<dsp::complex_t> samples;
+        if (!inputFile.empty()) {
+            if (!loadRecording(inputFile, samples, 10 * 2400000) || samples.empty()) { return; }
+        }
+        else {
+            samples.resize(std::max<int>(bufferSize, 1000000));
+            for (int i = 0; i < samples.size(); i++) {
+                float noise = 0.01f;
+                samples[i].re = noise * (((float)rand() / (float)RAND_MAX) - 0.5f);
+                samples[i].im = noise * (((float)rand() / (float)RAND_MAX) - 0.5f);
+                for (double freq : { 0.01, 0.13, -0.27 }) {
+                    samples[i].re += 0.2f * cos(2.0 * FL_M_PI * freq * i);
+                    samples[i].im += 0.2f * sin(2.0 * FL_M_PI * freq * i);
+                }
+            }
+        }
+
+        const char* typeNames[] = { "i8", "i16", "f32" };
+        const char* preprocNames[] = { "none", "delta", "shuffle", "delta_shuffle" };
+        for (auto type : { dsp::compression::PCM_TYPE_I8, dsp::compression::PCM_TYPE_I16 }) {
+            for (int preproc : { dsp::compression::PREPROCESS_NONE, dsp::compression::PREPROCESS_SHUFFLE, dsp::compression::PREPROCESS_ALL }) {
+                // Byte planes don't apply to int8
+                if (type == dsp::compression::PCM_TYPE_I8 && preproc == dsp::compression::PREPROCESS_SHUFFLE) { continue; }
+                if (type == dsp::compression::PCM_TYPE_I8 && preproc == dsp::compression::PREPROCESS_ALL) { preproc = dsp::compression::PREPROCESS_DELTA; }
+                for (int level : { 0, 1, 3, 7 }) {
+                    std::string name = std::string("compression/server/") + typeNames[type] + "/" + preprocNames[preproc] + "/" + std::to_string(level);
+                    results.push_back(compressionRate(name, samples, { type, level, preproc }, durationMs, bufferSize));
+                }
+            }
+        }
+    } });
+
+    return benches;
+}
+
+int main(int argc, char* argv[]) {
+    CommandArgsParser args;
+    args.define('h', "help", "Show help");
+    args.define('l', "list", "List the benchmarks without running them");
+    args.define('j', "json", "Print the results as JSON instead of CSV");
+    args.define('f', "filter", "Only run the benchmarks whose name contains this string", "");
+    args.define('d', "duration", "Duration of each measurement in milliseconds", 500);
+    args.define('b', "buffer", "Number of samples written to the blocks at a time", 65536);
+    args.define('i', "input", "Stereo WAV recording to run the compression benchmarks on instead of random samples", "");
+    args.define('t', "threads", "Number of threads zstd can use for large buffers in the compression benchmarks", 1);
+    if (args.parse(argc, argv) < 0) { return -1; }
+
+    if (args["help"].b()) {
+        args.showHelp();
+        return 0;
+    }
+
+    std::string filter = args["filter"];
+    int durationMs = args["duration"];
+    int bufferSize = args["buffer"];
+    bool jsonOutput = args["json"].b();
+    inputFile = args["input"].s();
+    compressionThreads = args["threads"];
+
+    std::vector<Bench> benches;
+    for (auto& bench : listBenches()) {
+        if (bench.name.find(filter) != std::string::npos) { benches.push_back(bench); }
+    }
+
+    if (args["list"].b()) {
+        for (auto& bench : benches) { printf("%s\n", bench.name.c_str()); }
+        return 0;
+    }
+
+    // Results are printed as they come in CSV so that a long run can be followed
+    if (!jsonOutput) { printf("name,samples_per_second,ns_per_sample,max_error,compression_ratio\n"); }
+    std::vector<BenchResult> results;
+    for (auto& bench : benches) {
+        int first = results.size();
+        bench.run(results, durationMs, bufferSize);
+        if (jsonOutput) { continue; }
+        for (int i = first; i < results.size(); i++) {
+            auto& res = results[i];
+            printf("%s,%.0f,%.3f,", res.name.c_str(), res.rate, 1e9 / res.rate);
+            if (!isnan(res.maxError)) { printf("%g", res.maxError); }
+            printf(",");
+            if (!isnan(res.ratio)) { printf("%.3f", res.ratio); }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    if (jsonOutput) {
+        json out;
+        out["durationMs"] = durationMs;
+        out["bufferSize"] = bufferSize;
+        out["results"] = json::array();
+        for (auto& res : results) {
+            json r;
+            r["name"] = res.name;
+            r["samplesPerSecond"] = res.rate;
+            r["nsPerSample"] = 1e9 / res.rate;
+            if (!isnan(res.maxError)) { r["maxError"] = res.maxError; }
+            if (!isnan(res.tolerance)) {
+                r["tolerance"] = res.tolerance;
+                r["passed"] = !res.failed();
+            }
+            if (!isnan(res.ratio)) { r["compressionRatio"] = res.ratio; }
+            out["results"].push_back(r);
+        }
+        printf("%s\n", out.dump(4).c_str());
+    }
+
+    // Fail if any result is further from its reference than allowed
+    int failed = 0;
+    for (auto& res : results) {
+        if (!res.failed()) { continue; }
+        fprintf(stderr, "%s: max error %g over tolerance %g\n", res.name.c_str(), res.maxError, res.tolerance);
+        failed++;
+    }
+    if (failed) {
+        fprintf(stderr, "%d benchmark(s) over tolerance\n", failed);
+        return 1;
+    }
+
+    return 0;
+}
@@ -16,11 +16,15 @@ void CommandArgsParser::defineAll() {
         define('a', "addr", "Server mode address", "0.0.0.0");
         define('h', "help", "Show help");
         define('p', "port", "Server mode port", 5259);
+        define('\0', "max-clients", "Server mode maximum number of connected clients", 8);
+        define('\0', "compression-threads", "Server mode number of threads compressing the baseband, 0 to pick one from the number of cores", 0);
         define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
         define('s', "server", "Run in server mode");
         define('d', "device", "Airspy device file descriptor", -1);
         define('t', "type", "Device type: Airspy (0) or Airspy HF+ (1), only valid on Android", 0);
         define('\0', "autostart", "Automatically start the SDR after loading");
+        define('\0', "headless", "Run without GUI using the given profile file", "");
+        define('\0', "dsp-kernels", "Show the DSP kernels selected for this CPU");
 }
 
 int CommandArgsParser::parse(int argc, char* argv[]) {
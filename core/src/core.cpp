@@ -1,4 +1,5 @@
 #include <server.h>
+#include <headless.h>
 #include "imgui.h"
 #include <stdio.h>
 #include <gui/main_window.h>
@@ -19,6 +20,8 @@
 #include <stb_image_resize.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/fft/plan.h>
+#include <dsp/simd/simd.h>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -77,11 +80,20 @@ int sdrpp_main(int argc, char* argv[]) {
         return 0;
     }
 
+    // Show the DSP kernels and exit if requested
+    if (core::args["dsp-kernels"].b()) {
+        dsp::simd::printKernels();
+        return 0;
+    }
+    flog::info("DSP kernels: {0}", dsp::simd::archName(dsp::simd::getSelectedArch()));
+
     bool serverMode = (bool)core::args["server"];
+    std::string headlessProfile = (std::string)core::args["headless"];
+    bool headlessMode = !headlessProfile.empty();
 
 #ifdef _WIN32
     // Free console if the user hasn't asked for a console and not in server mode
-    if (!core::args["con"].b() && !serverMode) { FreeConsole(); }
+    if (!core::args["con"].b() && !serverMode && !headlessMode) { FreeConsole(); }
 
     // Set error mode to avoid abnoxious popups
     SetErrorMode(SEM_NOOPENFILEERRORBOX | SEM_NOGPFAULTERRORBOX | SEM_FAILCRITICALERRORS);
@@ -117,6 +129,7 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["colorMap"] = "Classic";
     defConfig["fftHold"] = false;
     defConfig["fftHoldSpeed"] = 60;
+    defConfig["fftMinHold"] = false;
     defConfig["fftSmoothing"] = false;
     defConfig["fftSmoothingSpeed"] = 100;
     defConfig["snrSmoothing"] = false;
@@ -126,8 +139,13 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["fftRate"] = 20;
     defConfig["fftSize"] = 65536;
     defConfig["fftWindow"] = 2;
+    defConfig["fftOverlap"] = 0.0;
+    defConfig["fftAveraging"] = 1;
+    defConfig["fftThreads"] = 0; // Automatic
+    defConfig["fftPlanRigor"] = 1; // Measure
     defConfig["frequency"] = 100000000.0;
     defConfig["fullWaterfallUpdate"] = false;
+    defConfig["waterfallQuantization"] = 0; // Float
     defConfig["max"] = 0.0;
     defConfig["maximized"] = false;
     defConfig["fullscreen"] = false;
@@ -159,6 +177,9 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["menuElements"][7]["name"] = "Display";
     defConfig["menuElements"][7]["open"] = true;
 
+    defConfig["menuElements"][8]["name"] = "Performance";
+    defConfig["menuElements"][8]["open"] = false;
+
     defConfig["menuWidth"] = 300;
     defConfig["min"] = -120.0;
 
@@ -222,12 +243,15 @@ int sdrpp_main(int argc, char* argv[]) {
 
     defConfig["offsetMode"] = (int)0; // Off
     defConfig["offset"] = 0.0;
+    defConfig["profiling"] = false;
     defConfig["showMenu"] = true;
     defConfig["showWaterfall"] = true;
     defConfig["source"] = "";
     defConfig["decimationPower"] = 0;
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
+    defConfig["channelizerThreshold"] = 0; // Disabled
+    defConfig["channelizerChannels"] = 256;
 
     defConfig["streams"]["Radio"]["muted"] = false;
     defConfig["streams"]["Radio"]["sink"] = "Audio";
@@ -315,9 +339,14 @@ int sdrpp_main(int argc, char* argv[]) {
     // Load UI scaling
     style::uiScale = core::configManager.conf["uiScale"];
 
+    // Start upgrading FFT plans in the background
+    int planRigor = std::clamp<int>(core::configManager.conf["fftPlanRigor"], dsp::fft::PLAN_RIGOR_ESTIMATE, dsp::fft::PLAN_RIGOR_PATIENT);
+    dsp::fft::startPlanCache(root + "/fftw_wisdom.txt", (dsp::fft::PlanRigor)planRigor);
+
     core::configManager.release(true);
 
     if (serverMode) { return server::main(); }
+    if (headlessMode) { return headless::main(headlessProfile); }
 
     core::configManager.acquire();
     std::string resDir = core::configManager.conf["resourcesDirectory"];
@@ -373,6 +402,8 @@ int sdrpp_main(int argc, char* argv[]) {
 
     sigpath::iqFrontEnd.stop();
 
+    dsp::fft::stopPlanCache();
+
     core::configManager.disableAutoSave();
     core::configManager.save();
 #endif
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <stdlib.h>
+#include "../buffer/buffer.h"
+#include "../convert/raw_iq.h"
+
+namespace dsp::bench {
+    struct ConvertThroughputResult {
+        convert::IQFormat format;
+        double rate;
+    };
+
+    // Per sample double precision conversion that sources used to do, for comparison
+    inline void u8ToComplexReference(const uint8_t* in, complex_t* out, int count) {
+        for (int i = 0; i < count; i++) {
+            out[i].re = ((double)in[i * 2] - 127.4) / 128.0;
+            out[i].im = ((double)in[(i * 2) + 1] - 127.4) / 128.0;
+        }
+    }
+
+    // Measure the throughput in samples per second of the raw IQ converters for every format. The rate of
+    // the reference u8 conversion is written to referenceRate.
+    inline std::vector<ConvertThroughputResult> convertThroughput(double& referenceRate, int durationMs = 500, int bufferSize = 65536) {
+        std::vector<ConvertThroughputResult> results;
+        uint8_t* in = buffer::alloc<uint8_t>(bufferSize * 8);
+        complex_t* out = buffer::alloc<complex_t>(bufferSize);
+        for (int i = 0; i < bufferSize * 8; i++) { in[i] = rand(); }
+
+        // Integer formats are converted from random bytes, floats from values in [-1, 1)
+        float* fin = (float*)in;
+        for (int i = 0; i < bufferSize * 2; i++) { fin[i] = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f; }
+
+        auto measure = [&](auto conv) {
+            int64_t count = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            auto end = start + std::chrono::milliseconds(durationMs);
+            auto now = start;
+            while (now < end) {
+                conv();
+                count += bufferSize;
+                now = std::chrono::high_resolution_clock::now();
+            }
+            return (double)count / std::chrono::duration<double>(now - start).count();
+        };
+
+        referenceRate = measure([&]() { u8ToComplexReference(in, out, bufferSize); });
+
+        const convert::IQFormat formats[] = {
+            convert::IQ_FORMAT_U8,
+            convert::IQ_FORMAT_S8,
+            convert::IQ_FORMAT_S12_PACKED,
+            convert::IQ_FORMAT_S16,
+            convert::IQ_FORMAT_S24,
+            convert::IQ_FORMAT_F32
+        };
+        for (auto format : formats) {
+            float offset = (format == convert::IQ_FORMAT_U8) ? 127.4f : 0.0f;
+            ConvertThroughputResult res;
+            res.format = format;
+            res.rate = measure([&]() { convert::toComplex(format, in, out, bufferSize, offset, 1.0f / 128.0f); });
+            results.push_back(res);
+        }
+
+        buffer::free(in);
+        buffer::free(out);
+        return results;
+    }
+}
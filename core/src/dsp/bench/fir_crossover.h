@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <climits>
+#include "speed_tester.h"
+#include "../filter/fir.h"
+
+namespace dsp::bench {
+    struct FIRCrossoverResult {
+        int tapCount;
+        double directRate;
+        double fftRate;
+    };
+
+    // Measure the throughput of a FIR filter using the direct and FFT convolution for tap counts doubling
+    // from minTaps to maxTaps. The crossover is the first tap count for which the FFT is faster.
+    template <class D, class T>
+    std::vector<FIRCrossoverResult> firCrossover(int& crossover, int minTaps = 16, int maxTaps = 2048, int durationMs = 500, int bufferSize = 65536) {
+        std::vector<FIRCrossoverResult> results;
+        crossover = -1;
+
+        for (int tc = minTaps; tc <= maxTaps; tc <<= 1) {
+            // Random taps, only their count matters
+            tap<T> taps = taps::alloc<T>(tc);
+            for (int i = 0; i < tc; i++) {
+                if constexpr (std::is_same_v<T, complex_t>) {
+                    taps.taps[i] = { (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX };
+                }
+                else {
+                    taps.taps[i] = (float)rand() / (float)RAND_MAX;
+                }
+            }
+
+            FIRCrossoverResult res;
+            res.tapCount = tc;
+            stream<D> in;
+            filter::FIR<D, T> fir(&in, taps);
+            SpeedTester<D, D> tester(&in, &fir.out);
+            fir.start();
+
+            // Direct convolution
+            fir.setFFTThreshold(INT_MAX);
+            res.directRate = tester.benchmark(durationMs, bufferSize);
+
+            // FFT convolution
+            fir.setFFTThreshold(0);
+            res.fftRate = tester.benchmark(durationMs, bufferSize);
+
+            fir.stop();
+            taps::free(taps);
+
+            if (crossover < 0 && res.fftRate > res.directRate) { crossover = tc; }
+            results.push_back(res);
+        }
+
+        return results;
+    }
+}
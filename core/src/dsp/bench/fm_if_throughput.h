@@ -0,0 +1,124 @@
+#pragma once
+#include <vector>
+#include "speed_tester.h"
+#include "../noise_reduction/fm_if.h"
+
+namespace dsp::bench {
+    // Reference FM IF noise reduction doing a full forward and inverse FFT for every sample
+    class FMIFReference : public Processor<complex_t, complex_t> {
+        using base_type = Processor<complex_t, complex_t>;
+    public:
+        FMIFReference() {}
+
+        FMIFReference(stream<complex_t>* in, int bins) { init(in, bins); }
+
+        ~FMIFReference() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            forwardPlan.destroy();
+            backwardPlan.destroy();
+            fftwf_free(forwFFTIn);
+            fftwf_free(forwFFTOut);
+            fftwf_free(backFFTIn);
+            fftwf_free(backFFTOut);
+            buffer::free(buffer);
+            buffer::free(ampBuf);
+            buffer::free(fftWin);
+        }
+
+        void init(stream<complex_t>* in, int bins) {
+            _bins = bins;
+            forwFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            forwFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            backFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            backFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + 64000);
+            bufferStart = &buffer[_bins - 1];
+            buffer::clear(buffer, _bins - 1);
+            buffer::clear(backFFTIn, _bins);
+            ampBuf = buffer::alloc<float>(_bins);
+            fftWin = buffer::alloc<float>(_bins);
+            for (int i = 0; i < _bins; i++) { fftWin[i] = window::nuttall(i, _bins); }
+            forwardPlan.init(_bins, forwFFTIn, forwFFTOut);
+            backwardPlan.init(_bins, backFFTIn, backFFTOut, true);
+            base_type::init(in);
+        }
+
+        int process(int count, const complex_t* in, complex_t* out) {
+            memcpy(bufferStart, in, count * sizeof(complex_t));
+            for (int i = 0; i < count; i++) {
+                volk_32fc_32f_multiply_32fc((lv_32fc_t*)forwFFTIn, (lv_32fc_t*)&buffer[i], fftWin, _bins);
+                forwardPlan.execute();
+                uint32_t idx;
+                volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)forwFFTOut, _bins);
+                volk_32f_index_max_32u(&idx, ampBuf, _bins);
+                backFFTIn[idx] = forwFFTOut[idx];
+                backwardPlan.execute();
+                out[i] = backFFTOut[_bins / 2];
+                backFFTIn[idx] = { 0, 0 };
+            }
+            memmove(buffer, &buffer[count], (_bins - 1) * sizeof(complex_t));
+            return count;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            base_type::_in->flush();
+            if (!base_type::out.swap(count)) { return -1; }
+            return count;
+        }
+
+    protected:
+        complex_t* forwFFTIn;
+        complex_t* forwFFTOut;
+        complex_t* backFFTIn;
+        complex_t* backFFTOut;
+        fft::Plan forwardPlan;
+        fft::Plan backwardPlan;
+        complex_t* buffer;
+        complex_t* bufferStart;
+        float* fftWin;
+        float* ampBuf;
+        int _bins;
+    };
+
+    struct FMIFThroughputResult {
+        int bins;
+        double referenceRate;
+        double slidingRate;
+    };
+
+    // Measure the throughput of the FM IF noise reduction against the per-sample FFT reference
+    inline std::vector<FMIFThroughputResult> fmifThroughput(const std::vector<int>& binCounts = { 32, 64, 128 }, int durationMs = 500, int bufferSize = 65536) {
+        std::vector<FMIFThroughputResult> results;
+        for (int bins : binCounts) {
+            FMIFThroughputResult res;
+            res.bins = bins;
+
+            {
+                stream<complex_t> in;
+                FMIFReference ref(&in, bins);
+                SpeedTester<complex_t, complex_t> tester(&in, &ref.out);
+                ref.start();
+                res.referenceRate = tester.benchmark(durationMs, bufferSize);
+                ref.stop();
+            }
+
+            {
+                stream<complex_t> in;
+                noise_reduction::FMIF fmif(&in, bins);
+                SpeedTester<complex_t, complex_t> tester(&in, &fmif.out);
+                fmif.start();
+                res.slidingRate = tester.benchmark(durationMs, bufferSize);
+                fmif.stop();
+            }
+
+            results.push_back(res);
+        }
+        return results;
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <math.h>
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+#include "../loop/agc.h"
+#include "../noise_reduction/noise_blanker.h"
+
+namespace dsp::bench {
+    // Per sample AGC as it was before it was batched
+    struct AGCReference {
+        float setPoint, attack, invAttack, decay, invDecay, maxGain, maxOutputAmp;
+        float amp;
+
+        void process(int count, complex_t* in, complex_t* out) {
+            for (int i = 0; i < count; i++) {
+                float inAmp = in[i].amplitude();
+                float gain;
+                if (inAmp != 0.0f) {
+                    amp = (inAmp > amp) ? ((amp * invAttack) + (inAmp * attack)) : ((amp * invDecay) + (inAmp * decay));
+                    gain = std::min<float>(setPoint / amp, maxGain);
+                }
+                else {
+                    gain = 1.0f;
+                }
+                if (inAmp*gain > maxOutputAmp) {
+                    float maxAmp = 0;
+                    for (int j = i; j < count; j++) {
+                        inAmp = in[j].amplitude();
+                        if (inAmp > maxAmp) { maxAmp = inAmp; }
+                    }
+                    amp = maxAmp;
+                    gain = std::min<float>(setPoint / amp, maxGain);
+                }
+                out[i] = in[i] * gain;
+            }
+        }
+    };
+
+    // Per sample noise blanker as it was before it was batched
+    struct NoiseBlankerReference {
+        float rate, invRate, level;
+        float amp;
+
+        void process(int count, complex_t* in, complex_t* out) {
+            for (int i = 0; i < count; i++) {
+                float inAmp = in[i].amplitude();
+                float gain = 1.0f;
+                if (inAmp != 0.0f) {
+                    amp = (amp * invRate) + (inAmp * rate);
+                    float excess = inAmp / amp;
+                    if (excess > level) {
+                        gain = 1.0f / excess;
+                    }
+                }
+                out[i] = in[i] * gain;
+            }
+        }
+    };
+
+    struct LevelParityResult {
+        double referenceRate;
+        double rate;
+        double maxError;    // Largest difference relative to the amplitude of the reference output
+    };
+
+    // Noise with random impulses and fades, so that the AGC clips and the noise blanker triggers
+    inline void levelTestSignal(complex_t* sig, int count) {
+        float level = 1.0f;
+        for (int i = 0; i < count; i++) {
+            if (!(rand() % 4096)) { level = powf(10.0f, ((float)rand() / (float)RAND_MAX) * 4.0f - 3.0f); }
+            float impulse = (rand() % 997) ? 1.0f : 50.0f;
+            sig[i].re = level * impulse * ((2.0f * (float)rand() / (float)RAND_MAX) - 1.0f);
+            sig[i].im = level * impulse * ((2.0f * (float)rand() / (float)RAND_MAX) - 1.0f);
+        }
+    }
+
+    template <class REF, class BLK>
+    inline LevelParityResult levelParity(REF& ref, BLK& blk, int durationMs, int bufferSize, int blocks) {
+        LevelParityResult res;
+        complex_t* sig = buffer::alloc<complex_t>(bufferSize * blocks);
+        complex_t* refOut = buffer::alloc<complex_t>(bufferSize);
+        complex_t* out = buffer::alloc<complex_t>(bufferSize);
+        levelTestSignal(sig, bufferSize * blocks);
+
+        // Parity over consecutive blocks so that the state carried between them is checked too
+        res.maxError = 0.0;
+        for (int b = 0; b < blocks; b++) {
+            ref.process(bufferSize, &sig[b * bufferSize], refOut);
+            blk.process(bufferSize, &sig[b * bufferSize], out);
+            for (int i = 0; i < bufferSize; i++) {
+                float err = (out[i] - refOut[i]).amplitude() / std::max<float>(refOut[i].amplitude(), 1e-20f);
+                res.maxError = std::max<double>(res.maxError, err);
+            }
+        }
+
+        auto measure = [&](auto proc) {
+            int64_t count = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            auto end = start + std::chrono::milliseconds(durationMs);
+            auto now = start;
+            for (int b = 0; now < end; b = (b + 1) % blocks) {
+                proc(&sig[b * bufferSize]);
+                count += bufferSize;
+                now = std::chrono::high_resolution_clock::now();
+            }
+            return (double)count / std::chrono::duration<double>(now - start).count();
+        };
+        res.referenceRate = measure([&](complex_t* in) { ref.process(bufferSize, in, refOut); });
+        res.rate = measure([&](complex_t* in) { blk.process(bufferSize, in, out); });
+
+        buffer::free(sig);
+        buffer::free(refOut);
+        buffer::free(out);
+        return res;
+    }
+
+    // Compare the batched AGC to the per sample reference, with the settings of the AM carrier AGC
+    inline LevelParityResult agcParity(int durationMs = 500, int bufferSize = 8192, int blocks = 16) {
+        AGCReference ref = { 1.0f, 50.0f / 48000.0f, 1.0f - (50.0f / 48000.0f), 5.0f / 48000.0f, 1.0f - (5.0f / 48000.0f), 10e6f, 10.0f, 1.0f };
+        loop::AGC<complex_t> agc;
+        agc.init(NULL, 1.0, 50.0 / 48000.0, 5.0 / 48000.0, 10e6, 10.0);
+        return levelParity(ref, agc, durationMs, bufferSize, blocks);
+    }
+
+    // Compare the batched noise blanker to the per sample reference
+    inline LevelParityResult noiseBlankerParity(int durationMs = 500, int bufferSize = 8192, int blocks = 16) {
+        NoiseBlankerReference ref = { 500.0f / 48000.0f, 1.0f - (500.0f / 48000.0f), 5.0f, 1.0f };
+        noise_reduction::NoiseBlanker nb;
+        nb.init(NULL, 500.0 / 48000.0, 5.0);
+        return levelParity(ref, nb, durationMs, bufferSize, blocks);
+    }
+}
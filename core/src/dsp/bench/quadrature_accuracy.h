@@ -0,0 +1,109 @@
+#pragma once
+#include <math.h>
+#include <stdlib.h>
+#include "speed_tester.h"
+#include "../demod/quadrature.h"
+#include "../math/normalize_phase.h"
+
+namespace dsp::bench {
+    // Reference quadrature demodulator computing the exact phase of every sample
+    class QuadratureReference : public Processor<complex_t, float> {
+        using base_type = Processor<complex_t, float>;
+    public:
+        QuadratureReference() {}
+
+        QuadratureReference(stream<complex_t>* in, double deviation) { init(in, deviation); }
+
+        void init(stream<complex_t>* in, double deviation) {
+            _invDeviation = 1.0 / deviation;
+            base_type::init(in);
+        }
+
+        inline int process(int count, complex_t* in, float* out) {
+            for (int i = 0; i < count; i++) {
+                float cphase = in[i].phase();
+                out[i] = math::normalizePhase(cphase - phase) * _invDeviation;
+                phase = cphase;
+            }
+            return count;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            base_type::_in->flush();
+            if (!base_type::out.swap(count)) { return -1; }
+            return count;
+        }
+
+    protected:
+        float _invDeviation;
+        float phase = 0.0f;
+    };
+
+    struct QuadratureAccuracyResult {
+        double referenceRate;
+        double rate;
+        double maxError;    // Radians
+        double rmsError;    // Radians
+    };
+
+    // Measure the throughput of the quadrature demodulator against the exact reference, and its error on
+    // a signal with random phase steps and amplitude
+    inline QuadratureAccuracyResult quadratureAccuracy(int durationMs = 500, int bufferSize = 65536) {
+        QuadratureAccuracyResult res;
+
+        {
+            stream<complex_t> in;
+            QuadratureReference ref(&in, 1.0);
+            SpeedTester<complex_t, float> tester(&in, &ref.out);
+            ref.start();
+            res.referenceRate = tester.benchmark(durationMs, bufferSize);
+            ref.stop();
+        }
+
+        {
+            stream<complex_t> in;
+            demod::Quadrature demod(&in, 1.0);
+            SpeedTester<complex_t, float> tester(&in, &demod.out);
+            demod.start();
+            res.rate = tester.benchmark(durationMs, bufferSize);
+            demod.stop();
+        }
+
+        // Compare both on the same signal, skipping the first sample that depends on the initial state
+        complex_t* sig = buffer::alloc<complex_t>(bufferSize);
+        float* refOut = buffer::alloc<float>(bufferSize);
+        float* out = buffer::alloc<float>(bufferSize);
+        float phase = 0.0f;
+        for (int i = 0; i < bufferSize; i++) {
+            phase = math::normalizePhase(phase + FL_M_PI * ((2.0f * (float)rand() / (float)RAND_MAX) - 1.0f));
+            float amp = 0.01f + (float)rand() / (float)RAND_MAX;
+            sig[i] = { amp * cosf(phase), amp * sinf(phase) };
+        }
+        QuadratureReference ref;
+        ref.init(NULL, 1.0);
+        ref.process(bufferSize, sig, refOut);
+        demod::Quadrature demod;
+        demod.init(NULL, 1.0);
+        demod.process(bufferSize, sig, out);
+
+        res.maxError = 0.0;
+        double errSum = 0.0;
+        for (int i = 1; i < bufferSize; i++) {
+            // Differences of exactly pi can come out with either sign
+            double err = fabs(math::normalizePhase(out[i] - refOut[i]));
+            res.maxError = std::max<double>(res.maxError, err);
+            errSum += err * err;
+        }
+        res.rmsError = sqrt(errSum / (double)(bufferSize - 1));
+
+        buffer::free(sig);
+        buffer::free(refOut);
+        buffer::free(out);
+        return res;
+    }
+}
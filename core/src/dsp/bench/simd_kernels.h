@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include "../buffer/buffer.h"
+#include "../simd/simd.h"
+
+namespace dsp::bench {
+    struct SIMDKernelResult {
+        simd::Arch arch;
+        std::string kernel;
+        double rate;        // Input values per second
+        double maxError;    // Largest difference with the generic kernel
+    };
+
+    // Measure the throughput of every kernel of every instruction set the CPU supports and compare its output to
+    // that of the generic kernel on the same random input
+    inline std::vector<SIMDKernelResult> simdKernels(int durationMs = 500, int bufferSize = 65536) {
+        std::vector<SIMDKernelResult> results;
+        float* fin = buffer::alloc<float>(bufferSize * 2);
+        uint8_t* bin = buffer::alloc<uint8_t>(bufferSize * 2);
+        float* fout = buffer::alloc<float>(bufferSize * 2);
+        float* fref = buffer::alloc<float>(bufferSize * 2);
+        uint8_t* bout = buffer::alloc<uint8_t>(bufferSize * 2);
+        uint8_t* bref = buffer::alloc<uint8_t>(bufferSize * 2);
+        for (int i = 0; i < bufferSize * 2; i++) {
+            fin[i] = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+            bin[i] = rand();
+        }
+
+        auto measure = [&](auto kernel) {
+            int64_t count = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            auto end = start + std::chrono::milliseconds(durationMs);
+            auto now = start;
+            while (now < end) {
+                kernel();
+                count += bufferSize;
+                now = std::chrono::high_resolution_clock::now();
+            }
+            return (double)count / std::chrono::duration<double>(now - start).count();
+        };
+        auto floatError = [&](int count) {
+            double err = 0.0;
+            for (int i = 0; i < count; i++) { err = std::max<double>(err, fabs(fout[i] - fref[i])); }
+            return err;
+        };
+        auto byteError = [&](int count) {
+            double err = 0.0;
+            for (int i = 0; i < count; i++) { err = std::max<double>(err, abs(bout[i] - bref[i])); }
+            return err;
+        };
+
+        const simd::Kernels* ref = simd::getKernels(simd::ARCH_GENERIC);
+        for (int a = simd::ARCH_GENERIC; a < simd::_ARCH_COUNT; a++) {
+            const simd::Kernels* k = simd::getKernels((simd::Arch)a);
+            if (!k) { continue; }
+            simd::Arch arch = (simd::Arch)a;
+            volatile float sink;
+
+            double err = fabs(k->max_32f(fin, bufferSize) - ref->max_32f(fin, bufferSize));
+            results.push_back({ arch, "max_32f", measure([&]() { sink = k->max_32f(fin, bufferSize); }), err });
+
+            err = fabs(k->absMax_32f(fin, bufferSize) - ref->absMax_32f(fin, bufferSize));
+            results.push_back({ arch, "absMax_32f", measure([&]() { sink = k->absMax_32f(fin, bufferSize); }), err });
+
+            k->slice_32f_8u(fin, bout, bufferSize);
+            ref->slice_32f_8u(fin, bref, bufferSize);
+            results.push_back({ arch, "slice_32f_8u", measure([&]() { k->slice_32f_8u(fin, bout, bufferSize); }), byteError(bufferSize) });
+
+            k->u8ToF32(bin, fout, bufferSize, 127.4f, 1.0f / 128.0f);
+            ref->u8ToF32(bin, fref, bufferSize, 127.4f, 1.0f / 128.0f);
+            results.push_back({ arch, "u8ToF32", measure([&]() { k->u8ToF32(bin, fout, bufferSize, 127.4f, 1.0f / 128.0f); }), floatError(bufferSize) });
+
+            k->s8ToF32((int8_t*)bin, fout, bufferSize, 0.4f, 1.0f / 128.0f);
+            ref->s8ToF32((int8_t*)bin, fref, bufferSize, 0.4f, 1.0f / 128.0f);
+            results.push_back({ arch, "s8ToF32", measure([&]() { k->s8ToF32((int8_t*)bin, fout, bufferSize, 0.4f, 1.0f / 128.0f); }), floatError(bufferSize) });
+
+            k->stereoToMono(fin, fout, bufferSize);
+            ref->stereoToMono(fin, fref, bufferSize);
+            results.push_back({ arch, "stereoToMono", measure([&]() { k->stereoToMono(fin, fout, bufferSize); }), floatError(bufferSize) });
+
+            k->shuffle16(bin, bout, bufferSize);
+            ref->shuffle16(bin, bref, bufferSize);
+            results.push_back({ arch, "shuffle16", measure([&]() { k->shuffle16(bin, bout, bufferSize); }), byteError(bufferSize * 2) });
+
+            k->unshuffle16(bin, bout, bufferSize);
+            ref->unshuffle16(bin, bref, bufferSize);
+            results.push_back({ arch, "unshuffle16", measure([&]() { k->unshuffle16(bin, bout, bufferSize); }), byteError(bufferSize * 2) });
+        }
+
+        buffer::free(fin);
+        buffer::free(bin);
+        buffer::free(fout);
+        buffer::free(fref);
+        buffer::free(bout);
+        buffer::free(bref);
+        return results;
+    }
+}
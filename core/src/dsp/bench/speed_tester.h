@@ -39,6 +39,10 @@ namespace dsp::bench {
                     randBuf[i].re = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
                     randBuf[i].im = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
                 }
+                else if constexpr (std::is_same_v<I, stereo_t>) {
+                    randBuf[i].l = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+                    randBuf[i].r = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+                }
                 else if constexpr (std::is_same_v<I, float>) {
                     randBuf[i] = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
                 }
@@ -3,8 +3,11 @@
 #include <thread>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <string>
 #include "stream.h"
 #include "types.h"
+#include "profiler.h"
 
 namespace dsp {
     class generic_block {
@@ -13,11 +16,15 @@ namespace dsp {
         virtual void start() {}
         virtual void stop() {}
         virtual int run() { return -1; }
+
+        // Name shown by the profiler instead of the type of the block
+        virtual void setProfileName(const std::string& name) {}
     };
 
     class block : public generic_block {
     public:
         virtual ~block() {
+            if (profileStats) { profileStats->alive = false; }
             if (!_block_init) { return; }
             stop();
             _block_init = false;
@@ -63,9 +70,37 @@ namespace dsp {
 
         virtual int run() = 0;
 
+        void setProfileName(const std::string& name) {
+            std::lock_guard<std::mutex> lck(profileMtx);
+            profileName = name;
+            if (profileStats) { profiler::renameBlock(profileStats.get(), name); }
+        }
+
     protected:
         void workerLoop() {
-            while (run() >= 0) {}
+            while (true) {
+                int ret = profiler::isEnabled() ? profiledRun() : run();
+                if (ret < 0) { break; }
+            }
+        }
+
+        int profiledRun() {
+            if (!profileStats) {
+                std::lock_guard<std::mutex> lck(profileMtx);
+                profileStats = profiler::registerBlock(profileName.empty() ? profiler::typeName(typeid(*this)) : profileName);
+            }
+            profiler::BlockStats* stats = profileStats.get();
+
+            // Sample how full the inputs are before reading from them
+            if (!inputs.empty()) {
+                int occupancy = 0;
+                for (auto& in : inputs) {
+                    occupancy += (in->getOccupancy() * 100) / in->getCapacity();
+                }
+                profiler::addOccupancy(stats, occupancy / inputs.size());
+            }
+
+            return profiler::timedRun(stats, [this]() { return run(); });
         }
 
         virtual void doStart() {
@@ -128,5 +163,9 @@ namespace dsp {
         bool tempStopped = false;
         int tempStopDepth = 0;
         std::thread workerThread;
+
+        std::mutex profileMtx;
+        std::string profileName;
+        std::shared_ptr<profiler::BlockStats> profileStats;
     };
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+
+namespace dsp::buffer {
+    template <class T>
+    class SharedBufferPool;
+
+    // Reference counted buffer that can be read by multiple readers at once without copying it.
+    // Readers must NOT modify its content. It is returned to its pool when the last reference is released.
+    template <class T>
+    class SharedBuffer {
+        friend SharedBufferPool<T>;
+    public:
+        void acquire() {
+            refs++;
+        }
+
+        void release() {
+            if (--refs) { return; }
+
+            // Return to the pool, or delete if the pool doesn't exist anymore
+            std::unique_lock<std::mutex> lck(pool->mtx);
+            if (!pool->alive) {
+                lck.unlock();
+                delete this;
+                return;
+            }
+            pool->freeBuffers.push_back(this);
+        }
+
+        T* data;
+
+    private:
+        struct PoolState {
+            std::mutex mtx;
+            std::vector<SharedBuffer<T>*> freeBuffers;
+            bool alive = true;
+        };
+
+        SharedBuffer(std::shared_ptr<PoolState> pool, int size) {
+            this->pool = pool;
+            data = buffer::alloc<T>(size);
+        }
+
+        ~SharedBuffer() {
+            buffer::free(data);
+        }
+
+        std::atomic<int> refs = 0;
+        std::shared_ptr<PoolState> pool;
+    };
+
+    // Pool of shared buffers, buffers are allocated on demand and recycled once released
+    template <class T>
+    class SharedBufferPool {
+        using PoolState = typename SharedBuffer<T>::PoolState;
+    public:
+        SharedBufferPool() {}
+
+        SharedBufferPool(int bufferSize) { init(bufferSize); }
+
+        ~SharedBufferPool() {
+            if (!_init) { return; }
+
+            // Buffers still referenced by a reader will delete themselves once released
+            std::lock_guard<std::mutex> lck(state->mtx);
+            state->alive = false;
+            for (auto& buf : state->freeBuffers) {
+                delete buf;
+            }
+            state->freeBuffers.clear();
+        }
+
+        void init(int bufferSize) {
+            _bufferSize = bufferSize;
+            state = std::make_shared<PoolState>();
+            _init = true;
+        }
+
+        // Get an unreferenced buffer
+        SharedBuffer<T>* get() {
+            assert(_init);
+            {
+                std::lock_guard<std::mutex> lck(state->mtx);
+                if (!state->freeBuffers.empty()) {
+                    SharedBuffer<T>* buf = state->freeBuffers.back();
+                    state->freeBuffers.pop_back();
+                    return buf;
+                }
+            }
+            return new SharedBuffer<T>(state, _bufferSize);
+        }
+
+    private:
+        bool _init = false;
+        int _bufferSize;
+        std::shared_ptr<PoolState> state;
+    };
+}
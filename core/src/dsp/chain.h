@@ -3,6 +3,9 @@
 #include <map>
 #include "processor.h"
 
+// Number of samples processed by each link at a time when the chain is fused
+#define CHAIN_FUSED_BLOCK_SIZE 4096
+
 namespace dsp {
     template<class T>
     class chain {
@@ -11,13 +14,77 @@ namespace dsp {
 
         chain(stream<T>* in) { init(in); }
 
+        ~chain() {
+            stopFused();
+            if (profileStats) { profileStats->alive = false; }
+            if (scratch[0]) { buffer::free(scratch[0]); }
+            if (scratch[1]) { buffer::free(scratch[1]); }
+        }
+
         void init(stream<T>* in) {
             _in = in;
             out = _in;
         }
 
+        // In fused mode, the enabled blocks are not started. Instead, the chain runs them back to back
+        // on a single thread and only the output of the last one goes through a stream.
+        template<typename Func>
+        void setFused(bool fused, Func onOutputChange) {
+            if (fused == _fused) { return; }
+
+            // Make sure all blocks support it
+            if (fused) {
+                for (auto& ln : links) {
+                    if (!ln->fusable()) {
+                        throw std::runtime_error("[chain] Tried to fuse a chain containing a block that can't be fused");
+                    }
+                }
+                if (!scratch[0]) {
+                    scratch[0] = buffer::alloc<T>(STREAM_BUFFER_SIZE);
+                    scratch[1] = buffer::alloc<T>(STREAM_BUFFER_SIZE);
+                }
+            }
+
+            // Switch mode with everything stopped
+            bool wasRunning = running;
+            stop();
+            _fused = fused;
+            updateFused();
+            if (!_fused) { rewire(); }
+            stream<T>* newOut = _fused ? (fusedLinks.empty() ? _in : &fusedOut) : lastOutput();
+            if (newOut != out) {
+                out = newOut;
+                onOutputChange(out);
+            }
+            if (wasRunning) { start(); }
+        }
+
+        bool isFused() { return _fused; }
+
+        // Name the chain in the profiler and its blocks after it
+        void setProfileName(const std::string& name) {
+            std::lock_guard<std::mutex> lck(profileMtx);
+            profileName = name;
+            if (profileStats) { profiler::renameBlock(profileStats.get(), name); }
+            for (auto& ln : links) {
+                ln->setProfileName(name + " / " + profiler::typeName(typeid(*ln)));
+            }
+        }
+
         template<typename Func>
         void setInput(stream<T>* in, Func onOutputChange) {
+            if (_fused) {
+                stopFused();
+                _in = in;
+                if (fusedLinks.empty()) {
+                    out = _in;
+                    onOutputChange(out);
+                    return;
+                }
+                if (running) { startFused(); }
+                return;
+            }
+
             _in = in;
             for (auto& ln : links) {
                 if (states[ln]) {
@@ -35,9 +102,18 @@ namespace dsp {
                 throw std::runtime_error("[chain] Tried to add a block that is already part of the chain");
             }
 
+            // Check that the block can run in a fused chain
+            if (_fused && !block->fusable()) {
+                throw std::runtime_error("[chain] Tried to add a block that can't be fused to a fused chain");
+            }
+
             // Add to the list
             links.push_back(block);
             states[block] = false;
+            {
+                std::lock_guard<std::mutex> lck(profileMtx);
+                if (!profileName.empty()) { block->setProfileName(profileName + " / " + profiler::typeName(typeid(*block))); }
+            }
 
             // Enable if needed
             if (enabled) { enableBlock(block, [](stream<T>* out){}); }
@@ -68,6 +144,11 @@ namespace dsp {
             // If already enable, don't do anything
             if (states[block]) { return; }
 
+            if (_fused) {
+                setFusedState(block, true, onOutputChange);
+                return;
+            }
+
             // Gather blocks before and after the block to enable
             Processor<T, T>* before = blockBefore(block);
             Processor<T, T>* after = blockAfter(block);
@@ -99,6 +180,11 @@ namespace dsp {
             // If already disabled, don't do anything
             if (!states[block]) { return; }
 
+            if (_fused) {
+                setFusedState(block, false, onOutputChange);
+                return;
+            }
+
             // Stop disabled block
             block->stop();
             states[block] = false;
@@ -143,6 +229,11 @@ namespace dsp {
 
         void start() {
             if (running) { return; }
+            if (_fused) {
+                if (!fusedLinks.empty()) { startFused(); }
+                running = true;
+                return;
+            }
             for (auto& ln : links) {
                 if (!states[ln]) { continue; }
                 ln->start();
@@ -152,6 +243,11 @@ namespace dsp {
 
         void stop() {
             if (!running) { return; }
+            if (_fused) {
+                stopFused();
+                running = false;
+                return;
+            }
             for (auto& ln : links) {
                 if (!states[ln]) { continue; }
                 ln->stop();
@@ -162,6 +258,98 @@ namespace dsp {
         stream<T>* out;
 
     private:
+        template<typename Func>
+        void setFusedState(Processor<T, T>* block, bool enabled, Func onOutputChange) {
+            stopFused();
+            states[block] = enabled;
+            updateFused();
+
+            // The output only changes when going from no block to one block or the opposite
+            stream<T>* newOut = fusedLinks.empty() ? _in : &fusedOut;
+            if (newOut != out) {
+                out = newOut;
+                onOutputChange(out);
+            }
+
+            if (running && !fusedLinks.empty()) { startFused(); }
+        }
+
+        void updateFused() {
+            fusedLinks.clear();
+            for (auto& ln : links) {
+                if (states[ln]) { fusedLinks.push_back(ln); }
+            }
+        }
+
+        // Restore the stream connections between blocks, they aren't maintained while fused
+        void rewire() {
+            stream<T>* prev = _in;
+            for (auto& ln : links) {
+                if (!states[ln]) { continue; }
+                ln->setInput(prev);
+                prev = &ln->out;
+            }
+        }
+
+        stream<T>* lastOutput() {
+            for (auto it = links.rbegin(); it != links.rend(); it++) {
+                if (states[*it]) { return &(*it)->out; }
+            }
+            return _in;
+        }
+
+        void startFused() {
+            fusedThread = std::thread(&chain<T>::fusedWorker, this);
+        }
+
+        void stopFused() {
+            if (!fusedThread.joinable()) { return; }
+            _in->stopReader();
+            fusedOut.stopWriter();
+            fusedThread.join();
+            _in->clearReadStop();
+            fusedOut.clearWriteStop();
+        }
+
+        void fusedWorker() {
+            while (true) {
+                int ret = profiler::isEnabled() ? profiledFusedRun() : fusedRun();
+                if (ret < 0) { break; }
+            }
+        }
+
+        int fusedRun() {
+            int count = _in->read();
+            if (count < 0) { return -1; }
+
+            // Run each piece of the input through all blocks while it's still in cache
+            int outCount = 0;
+            for (int offset = 0; offset < count; offset += CHAIN_FUSED_BLOCK_SIZE) {
+                int chunkCount = std::min<int>(count - offset, CHAIN_FUSED_BLOCK_SIZE);
+                const T* data = &_in->readBuf[offset];
+                for (int i = 0; i < fusedLinks.size() && chunkCount; i++) {
+                    T* dst = (i == fusedLinks.size() - 1) ? &fusedOut.writeBuf[outCount] : scratch[i & 1];
+                    chunkCount = fusedLinks[i]->processFused(chunkCount, data, dst);
+                    data = dst;
+                }
+                outCount += chunkCount;
+            }
+
+            _in->flush();
+            if (outCount && !fusedOut.swap(outCount)) { return -1; }
+            return count;
+        }
+
+        // The fused blocks don't have threads of their own, so the whole chain is profiled as one block
+        int profiledFusedRun() {
+            if (!profileStats) {
+                std::lock_guard<std::mutex> lck(profileMtx);
+                profileStats = profiler::registerBlock(profileName.empty() ? profiler::typeName(typeid(*this)) : profileName);
+            }
+            profiler::addOccupancy(profileStats.get(), (_in->getOccupancy() * 100) / _in->getCapacity());
+            return profiler::timedRun(profileStats.get(), [this]() { return fusedRun(); });
+        }
+
         Processor<T, T>* blockBefore(Processor<T, T>* block) {
             // TODO: This is wrong and must be fixed when I get more time
             for (auto& ln : links) {
@@ -191,5 +379,16 @@ namespace dsp {
         std::vector<Processor<T, T>*> links;
         std::map<Processor<T, T>*, bool> states;
         bool running = false;
+
+        // Fused mode
+        bool _fused = false;
+        std::vector<Processor<T, T>*> fusedLinks;
+        stream<T> fusedOut;
+        T* scratch[2] = { NULL, NULL };
+        std::thread fusedThread;
+
+        std::mutex profileMtx;
+        std::string profileName;
+        std::shared_ptr<profiler::BlockStats> profileStats;
     };
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#pragma once
+#include "rx_vfo.h"
+#include "pfb_channelizer.h"
+#include "../routing/splitter.h"
+
+namespace dsp::channel {
+    // RxVFO that takes its input from the nearest channel of a PFBChannelizer instead of the full band.
+    // Falls back to the wideband splitter whenever its samplerate or bandwidth doesn't fit in a channel.
+    class ChannelizedRxVFO : public RxVFO {
+        using base_type = RxVFO;
+    public:
+        ChannelizedRxVFO() {}
+
+        ChannelizedRxVFO(routing::Splitter<complex_t>* wideband, PFBChannelizer* channelizer, double inSamplerate, double outSamplerate, double bandwidth, double offset) { init(wideband, channelizer, inSamplerate, outSamplerate, bandwidth, offset); }
+
+        ~ChannelizedRxVFO() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            unbindInput();
+        }
+
+        void init(routing::Splitter<complex_t>* wideband, PFBChannelizer* channelizer, double inSamplerate, double outSamplerate, double bandwidth, double offset) {
+            _wideband = wideband;
+            _channelizer = channelizer;
+            _wideSamplerate = inSamplerate;
+            _wideOffset = offset;
+
+            // Pick the input according to the initial parameters
+            channelized = fitsChannel(outSamplerate, bandwidth);
+            double residual;
+            channel = _channelizer->getChannel(_wideOffset, residual);
+            if (channelized) {
+                base_type::init(&input, _channelizer->getChannelSamplerate(), outSamplerate, bandwidth, residual);
+            }
+            else {
+                base_type::init(&input, _wideSamplerate, outSamplerate, bandwidth, _wideOffset);
+            }
+            bindInput();
+        }
+
+        void setInSamplerate(double inSamplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _wideSamplerate = inSamplerate;
+            updateRouting();
+            base_type::tempStart();
+        }
+
+        void setOutSamplerate(double outSamplerate, double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            base_type::setOutSamplerate(outSamplerate, bandwidth);
+            updateRouting();
+            base_type::tempStart();
+        }
+
+        void setBandwidth(double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::setBandwidth(bandwidth);
+
+            // Only interrupt the stream if the input has to change
+            if (fitsChannel(_outSamplerate, _bandwidth) != channelized) {
+                base_type::tempStop();
+                updateRouting();
+                base_type::tempStart();
+            }
+        }
+
+        void setOffset(double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            _wideOffset = offset;
+            if (!channelized) {
+                base_type::setOffset(_wideOffset);
+                return;
+            }
+
+            // Retune within the channel, and hop to another one if needed
+            double residual;
+            int newChannel = _channelizer->getChannel(_wideOffset, residual);
+            if (newChannel != channel) {
+                channel = newChannel;
+                if (!inputDetached) { _channelizer->setChannel(&input, channel); }
+            }
+            base_type::setOffset(residual);
+        }
+
+        inline bool isChannelized() { return channelized; }
+
+        // Disconnect the input so the VFO can't hold up the channelizer or splitter, for when its output is fed by
+        // something else. Routing changes are still tracked and applied when it's connected again.
+        void setInputDetached(bool detached) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (detached == inputDetached) { return; }
+            base_type::tempStop();
+            if (detached) {
+                unbindInput();
+                inputDetached = true;
+            }
+            else {
+                inputDetached = false;
+                bindInput();
+            }
+            base_type::tempStart();
+        }
+
+    protected:
+        bool fitsChannel(double outSamplerate, double bandwidth) {
+            return std::max<double>(outSamplerate, bandwidth) <= _channelizer->getMaxBandwidth();
+        }
+
+        void bindInput() {
+            if (inputDetached) { return; }
+            if (channelized) {
+                _channelizer->bindStream(&input, channel);
+            }
+            else {
+                _wideband->bindStream(&input);
+            }
+        }
+
+        void unbindInput() {
+            if (inputDetached) { return; }
+            if (channelized) {
+                _channelizer->unbindStream(&input);
+            }
+            else {
+                _wideband->unbindStream(&input);
+            }
+        }
+
+        // NOTE: Must be called with the block temporarily stopped
+        void updateRouting() {
+            // The channel layout may have changed along with the samplerate
+            double residual;
+            int newChannel = _channelizer->getChannel(_wideOffset, residual);
+
+            bool shouldChannelize = fitsChannel(_outSamplerate, _bandwidth);
+            if (shouldChannelize != channelized) {
+                unbindInput();
+                channelized = shouldChannelize;
+                channel = newChannel;
+                bindInput();
+            }
+
+            if (channelized) {
+                channel = newChannel;
+                if (!inputDetached) { _channelizer->setChannel(&input, channel); }
+                base_type::setInSamplerate(_channelizer->getChannelSamplerate());
+                base_type::setOffset(residual);
+            }
+            else {
+                base_type::setInSamplerate(_wideSamplerate);
+                base_type::setOffset(_wideOffset);
+            }
+        }
+
+        routing::Splitter<complex_t>* _wideband;
+        PFBChannelizer* _channelizer;
+        stream<complex_t> input;
+
+        bool channelized;
+        int channel;
+        bool inputDetached = false;
+        double _wideSamplerate;
+        double _wideOffset;
+    };
+}
@@ -0,0 +1,251 @@
+#pragma once
+#include "../sink.h"
+#include "../taps/low_pass.h"
+#include "../fft/plan.h"
+
+namespace dsp::channel {
+    // 2x oversampled polyphase filter bank channelizer. Splits the input into channelCount channels spaced
+    // by samplerate / channelCount, each one centered at DC and output at 2 * samplerate / channelCount.
+    // Only channels that have a stream bound to them are output, but the cost is the same for any number of channels.
+    class PFBChannelizer : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        PFBChannelizer() {}
+
+        PFBChannelizer(stream<complex_t>* in, int channelCount, double samplerate) { init(in, channelCount, samplerate); }
+
+        ~PFBChannelizer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            destroyBuffers();
+        }
+
+        void init(stream<complex_t>* in, int channelCount, double samplerate) {
+            _channelCount = channelCount;
+            _samplerate = samplerate;
+            initBuffers();
+            base_type::init(in);
+        }
+
+        void setChannelCount(int channelCount) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _channelCount = channelCount;
+            destroyBuffers();
+            initBuffers();
+            for (auto& o : outputs) {
+                o.channel = std::clamp<int>(o.channel, 0, _channelCount - 1);
+            }
+            base_type::tempStart();
+        }
+
+        // The samplerate is only used to map frequencies to channels, it has no effect on the processing
+        void setSamplerate(double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            _samplerate = samplerate;
+        }
+
+        inline int getChannelCount() { return _channelCount; }
+
+        inline double getChannelSpacing() { return _samplerate / (double)_channelCount; }
+
+        inline double getChannelSamplerate() { return 2.0 * getChannelSpacing(); }
+
+        // Widest signal that is guaranteed to be alias-free when served from its nearest channel
+        inline double getMaxBandwidth() { return 0.5 * getChannelSpacing(); }
+
+        // Get the channel nearest to a frequency offset and the remaining offset from its center
+        int getChannel(double offset, double& residual) {
+            double spacing = getChannelSpacing();
+            int id = round(offset / spacing);
+            residual = offset - ((double)id * spacing);
+            return ((id % _channelCount) + _channelCount) % _channelCount;
+        }
+
+        void bindStream(stream<complex_t>* stream, int channel) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+
+            // Check that the stream isn't already bound
+            if (findOutput(stream) != outputs.end()) {
+                throw std::runtime_error("[PFBChannelizer] Tried to bind stream to that is already bound");
+            }
+
+            // Add to the list
+            base_type::tempStop();
+            base_type::registerOutput(stream);
+            outputs.push_back({ stream, channel });
+            base_type::tempStart();
+        }
+
+        void unbindStream(stream<complex_t>* stream) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+
+            // Check that the stream is bound
+            auto oit = findOutput(stream);
+            if (oit == outputs.end()) {
+                throw std::runtime_error("[PFBChannelizer] Tried to unbind stream to that isn't bound");
+            }
+
+            // Remove from the list
+            base_type::tempStop();
+            outputs.erase(oit);
+            base_type::unregisterOutput(stream);
+            base_type::tempStart();
+        }
+
+        // Change the channel a bound stream receives, this doesn't interrupt processing
+        void setChannel(stream<complex_t>* stream, int channel) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            std::lock_guard<std::mutex> lck2(outMtx);
+            auto oit = findOutput(stream);
+            if (oit == outputs.end()) {
+                throw std::runtime_error("[PFBChannelizer] Tried to set the channel of a stream that isn't bound");
+            }
+            oit->channel = channel;
+        }
+
+        int process(int count, const complex_t* in) {
+            // Copy data to work buffer
+            memcpy(bufStart, in, count * sizeof(complex_t));
+
+            // Compute one frame of all channels every half channel count samples
+            int outCount = 0;
+            for (; offset < count; offset += decim) {
+                // Sum the windowed segments of each branch
+                const complex_t* seg = &buffer[offset + (tapsPerBranch - 1) * _channelCount];
+                for (int i = 0; i < _channelCount; i++) {
+                    fftIn[i] = { seg[i].re * btaps[i], seg[i].im * btaps[i] };
+                }
+                for (int p = 1; p < tapsPerBranch; p++) {
+                    seg = &buffer[offset + (tapsPerBranch - 1 - p) * _channelCount];
+                    const float* t = &btaps[p * _channelCount];
+                    for (int i = 0; i < _channelCount; i++) {
+                        fftIn[i].re += seg[i].re * t[i];
+                        fftIn[i].im += seg[i].im * t[i];
+                    }
+                }
+
+                // Do the FFT
+                plan.execute();
+
+                // Correct phase of the requested channels, the odd channels flip sign every other frame
+                for (auto& o : outputs) {
+                    complex_t val = fftOut[o.channel] * phaseCorr[o.channel];
+                    o.out->writeBuf[outCount] = (oddFrame && (o.channel & 1)) ? complex_t{ -val.re, -val.im } : val;
+                }
+                oddFrame = !oddFrame;
+                outCount++;
+            }
+            offset -= count;
+
+            // Move unused data
+            memmove(buffer, &buffer[count], (tapCount - 1) * sizeof(complex_t));
+
+            return outCount;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = 0;
+            if (!outputs.empty()) {
+                std::lock_guard<std::mutex> lck(outMtx);
+                outCount = process(count, base_type::_in->readBuf);
+            }
+
+            base_type::_in->flush();
+            if (!outCount) { return count; }
+
+            for (auto& o : outputs) {
+                if (!o.out->swap(outCount)) { return -1; }
+            }
+
+            return count;
+        }
+
+    protected:
+        struct Output {
+            stream<complex_t>* out;
+            int channel;
+        };
+
+        std::vector<Output>::iterator findOutput(stream<complex_t>* stream) {
+            return std::find_if(outputs.begin(), outputs.end(), [=](const Output& o) { return o.out == stream; });
+        }
+
+        void initBuffers() {
+            decim = _channelCount / 2;
+
+            // Design the prototype filter on a normalized samplerate where the channel spacing is 1.
+            // Passband ends at 0.75 channel and stopband starts at 1.25 channel to keep aliasing out of the usable band
+            tap<float> proto = taps::lowPass(1.0, 0.5, _channelCount);
+            tapsPerBranch = (proto.size + _channelCount - 1) / _channelCount;
+            tapCount = tapsPerBranch * _channelCount;
+
+            // Reverse the taps of each branch so that the segments can be multiplied in order
+            btaps = buffer::alloc<float>(tapCount);
+            for (int p = 0; p < tapsPerBranch; p++) {
+                for (int i = 0; i < _channelCount; i++) {
+                    int id = (p * _channelCount) + (_channelCount - 1 - i);
+                    btaps[(p * _channelCount) + i] = (id < proto.size) ? proto.taps[id] : 0.0f;
+                }
+            }
+            taps::free(proto);
+
+            // Phase correction due to the reversed branch order
+            phaseCorr = buffer::alloc<complex_t>(_channelCount);
+            for (int i = 0; i < _channelCount; i++) {
+                double phase = -2.0 * DB_M_PI * (double)i / (double)_channelCount;
+                phaseCorr[i] = { (float)cos(phase), (float)sin(phase) };
+            }
+
+            // Allocate and clear delay buffer
+            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + tapCount);
+            bufStart = &buffer[tapCount - 1];
+            buffer::clear(buffer, tapCount - 1);
+            offset = 0;
+            oddFrame = false;
+
+            // Plan FFT
+            fftIn = (complex_t*)fftwf_malloc(_channelCount * sizeof(complex_t));
+            fftOut = (complex_t*)fftwf_malloc(_channelCount * sizeof(complex_t));
+            plan.init(_channelCount, fftIn, fftOut);
+        }
+
+        void destroyBuffers() {
+            plan.destroy();
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+            buffer::free(buffer);
+            buffer::free(btaps);
+            buffer::free(phaseCorr);
+        }
+
+        int _channelCount;
+        double _samplerate;
+
+        std::mutex outMtx;
+        std::vector<Output> outputs;
+
+        int decim;
+        int tapsPerBranch;
+        int tapCount;
+        float* btaps;
+        complex_t* phaseCorr;
+
+        complex_t* buffer;
+        complex_t* bufStart;
+        int offset = 0;
+        bool oddFrame = false;
+
+        complex_t* fftIn;
+        complex_t* fftOut;
+        fft::Plan plan;
+    };
+}
@@ -32,7 +32,7 @@ namespace dsp::channel {
             base_type::init(in);
         }
 
-        void setInSamplerate(double inSamplerate) {
+        virtual void setInSamplerate(double inSamplerate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
@@ -42,7 +42,7 @@ namespace dsp::channel {
             base_type::tempStart();
         }
 
-        void setOutSamplerate(double outSamplerate, double bandwidth) {
+        virtual void setOutSamplerate(double outSamplerate, double bandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
@@ -57,7 +57,7 @@ namespace dsp::channel {
             base_type::tempStart();
         }
 
-        void setBandwidth(double bandwidth) {
+        virtual void setBandwidth(double bandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             std::lock_guard<std::mutex> lck2(filterMtx);
@@ -69,13 +69,15 @@ namespace dsp::channel {
             }
         }
 
-        void setOffset(double offset) {
+        virtual void setOffset(double offset) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _offset = offset;
             xlator.setOffset(-_offset, _inSamplerate);
         }
 
+        inline double getOutSamplerate() { return _outSamplerate; }
+
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <type_traits>
+#include "../simd/simd.h"
+
+namespace dsp::compression {
+    // Transforms applied to the PCM samples before they are given to a general purpose compressor, stored as flags
+    // in the header of each buffer. Both are lossless and only make the data more compressible:
+    // - Delta: each sample is replaced by its difference with the previous one of the same channel, which is
+    //   smaller than the sample itself for oversampled signals.
+    // - Shuffle: the bytes of the samples are regrouped by significance (all low bytes, then all high bytes, ...)
+    //   so that the mostly constant high bytes end up next to each other.
+    enum Preprocessing {
+        PREPROCESS_NONE     = 0,
+        PREPROCESS_DELTA    = (1 << 0),
+        PREPROCESS_SHUFFLE  = (1 << 1),
+        PREPROCESS_ALL      = PREPROCESS_DELTA | PREPROCESS_SHUFFLE
+    };
+
+    namespace preprocessing {
+        // Delta code interleaved IQ samples in place. Differences wrap around so that decoding is exact.
+        template <class T>
+        inline void deltaEncode(T* data, int count) {
+            for (int i = (count * 2) - 1; i >= 2; i--) {
+                data[i] = (T)((std::make_unsigned_t<T>)data[i] - (std::make_unsigned_t<T>)data[i - 2]);
+            }
+        }
+
+        template <class T>
+        inline void deltaDecode(T* data, int count) {
+            for (int i = 2; i < count * 2; i++) {
+                data[i] = (T)((std::make_unsigned_t<T>)data[i] + (std::make_unsigned_t<T>)data[i - 2]);
+            }
+        }
+
+        // Regroup the bytes of count values of size bytes each by significance
+        inline void shuffle(uint8_t* out, const uint8_t* in, int count, int size) {
+            if (size == 2) {
+                simd::selectedKernels().shuffle16(in, out, count);
+                return;
+            }
+            for (int b = 0; b < size; b++) {
+                uint8_t* plane = &out[b * count];
+                for (int i = 0; i < count; i++) { plane[i] = in[(i * size) + b]; }
+            }
+        }
+
+        inline void unshuffle(uint8_t* out, const uint8_t* in, int count, int size) {
+            if (size == 2) {
+                simd::selectedKernels().unshuffle16(in, out, count);
+                return;
+            }
+            for (int b = 0; b < size; b++) {
+                const uint8_t* plane = &in[b * count];
+                for (int i = 0; i < count; i++) { out[(i * size) + b] = plane[i]; }
+            }
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "../processor.h"
 #include "pcm_type.h"
+#include "preprocessing.h"
 
 namespace dsp::compression {
     class SampleStreamCompressor : public Processor<complex_t, uint8_t> {
@@ -8,10 +9,11 @@ namespace dsp::compression {
     public:
         SampleStreamCompressor() {}
 
-        SampleStreamCompressor(stream<complex_t>* in, PCMType pcmType) { init(in, pcmType); }
+        SampleStreamCompressor(stream<complex_t>* in, PCMType pcmType, int preprocess = PREPROCESS_NONE) { init(in, pcmType, preprocess); }
 
-        void init(stream<complex_t>* in, PCMType pcmType) {
+        void init(stream<complex_t>* in, PCMType pcmType, int preprocess = PREPROCESS_NONE) {
             _pcmType = pcmType;
+            _preprocess = preprocess;
 
             // Set the output buffer size to the max size of a complex buffer + 8 bytes for the header
             out.setBufferSize(STREAM_BUFFER_SIZE*sizeof(complex_t) + 8);
@@ -27,37 +29,71 @@ namespace dsp::compression {
             base_type::tempStart();
         }
 
-        inline static int process(int count, PCMType pcmType, const complex_t* in, uint8_t* out) {
+        void setPreprocessing(int preprocess) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _preprocess = preprocess;
+            base_type::tempStart();
+        }
+
+        // Largest absolute value of the samples, peaks can be negative just as well as positive
+        inline static float peak(const complex_t* in, int count) {
+            return simd::selectedKernels().absMax_32f((const float*)in, count * 2);
+        }
+
+        // Encode count samples into out, which must be able to hold 8 + count * sizeof(complex_t) bytes whatever the
+        // PCM type. The preprocessing flags that don't apply to the PCM type are ignored, the header has those used.
+        inline static int process(int count, PCMType pcmType, const complex_t* in, uint8_t* out, int preprocess = PREPROCESS_NONE) {
             uint16_t* compressionType = (uint16_t*)out;
             uint16_t* sampleType = (uint16_t*)&out[2];
             float* scaler = (float*)&out[4];
-            void* dataBuf = &out[8];
+            uint8_t* dataBuf = &out[8];
 
-            // Write options and leave blank space for compression
-            *compressionType = 0;
+            // Write options, the compression type holds the preprocessing flags
+            *compressionType = PREPROCESS_NONE;
             *sampleType = pcmType;
 
-            // If type is float32, no compression is needed
+            // If type is float32, no conversion is needed. Delta coding the bits of floats would be pointless.
             if (pcmType == PCMType::PCM_TYPE_F32) {
                 *scaler = 0;
-                memcpy(dataBuf, in, count * sizeof(complex_t));
+                if (preprocess & PREPROCESS_SHUFFLE) {
+                    preprocessing::shuffle(dataBuf, (const uint8_t*)in, count * 2, sizeof(float));
+                    *compressionType = PREPROCESS_SHUFFLE;
+                }
+                else {
+                    memcpy(dataBuf, in, count * sizeof(complex_t));
+                }
                 return 8 + (count * sizeof(complex_t));
             }
 
-            // Find maximum value
-            uint32_t maxIdx;
-            volk_32f_index_max_32u(&maxIdx, (float*)in, count * 2);
-            float maxVal = ((float*)in)[maxIdx];
+            // Scale to the peak, a silent buffer is sent as zeros
+            float maxVal = peak(in, count);
             *scaler = maxVal;
+            float scale = (maxVal > 0.0f) ? (1.0f / maxVal) : 0.0f;
 
             // Convert to the right type and send it out (sign bit determines pcm type)
             if (pcmType == PCMType::PCM_TYPE_I8) {
-                volk_32f_s32f_convert_8i((int8_t*)dataBuf, (float*)in, 128.0f / maxVal, count * 2);
+                volk_32f_s32f_convert_8i((int8_t*)dataBuf, (float*)in, 128.0f * scale, count * 2);
+                if (preprocess & PREPROCESS_DELTA) {
+                    preprocessing::deltaEncode((int8_t*)dataBuf, count);
+                    *compressionType = PREPROCESS_DELTA;
+                }
                 return 8 + (count * sizeof(int8_t) * 2);
             }
             else if (pcmType == PCMType::PCM_TYPE_I16) {
-                volk_32f_s32f_convert_16i((int16_t*)dataBuf, (float*)in, 32768.0f / maxVal, count * 2);
-                return 8 + (count * sizeof(int16_t) * 2);
+                // When shuffling, convert into the unused second half of the output first
+                int size = count * sizeof(int16_t) * 2;
+                int16_t* samples = (preprocess & PREPROCESS_SHUFFLE) ? (int16_t*)&dataBuf[size] : (int16_t*)dataBuf;
+                volk_32f_s32f_convert_16i(samples, (float*)in, 32768.0f * scale, count * 2);
+                if (preprocess & PREPROCESS_DELTA) {
+                    preprocessing::deltaEncode(samples, count);
+                }
+                if (preprocess & PREPROCESS_SHUFFLE) {
+                    preprocessing::shuffle(dataBuf, (const uint8_t*)samples, count * 2, sizeof(int16_t));
+                }
+                *compressionType = preprocess & PREPROCESS_ALL;
+                return 8 + size;
             }
 
             return count;
@@ -67,7 +103,7 @@ namespace dsp::compression {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, _pcmType, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount = process(count, _pcmType, base_type::_in->readBuf, base_type::out.writeBuf, _preprocess);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -79,5 +115,6 @@ namespace dsp::compression {
 
     protected:
         PCMType _pcmType;
+        int _preprocess = PREPROCESS_NONE;
     };
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "../processor.h"
 #include "pcm_type.h"
+#include "preprocessing.h"
+#include <vector>
 
 namespace dsp::compression {
     class SampleStreamDecompressor : public Processor<uint8_t, complex_t> {
@@ -10,23 +12,50 @@ namespace dsp::compression {
 
         SampleStreamDecompressor(stream<uint8_t>* in) { base_type::init(in); }
 
+        // Preprocessed buffers are undone in a work buffer of the instance, so calls must not run concurrently
         inline int process(int count, const uint8_t* in, complex_t* out) {
+            uint16_t compressionType = *(uint16_t*)in;
             uint16_t sampleType = *(uint16_t*)&in[2];
             float scaler = *(float*)&in[4];
-            const void* dataBuf = &in[8];
+            const uint8_t* dataBuf = &in[8];
 
             if (sampleType == PCMType::PCM_TYPE_F32) {
-                memcpy(out, dataBuf, count - 8);
-                return (count - 8) / sizeof(complex_t);
+                int outCount = (count - 8) / sizeof(complex_t);
+                if (compressionType & PREPROCESS_SHUFFLE) {
+                    preprocessing::unshuffle((uint8_t*)out, dataBuf, outCount * 2, sizeof(float));
+                }
+                else {
+                    memcpy(out, dataBuf, outCount * sizeof(complex_t));
+                }
+                return outCount;
             }
             else if (sampleType == PCMType::PCM_TYPE_I16) {
                 int outCount = (count - 8) / (sizeof(int16_t) * 2);
-                volk_16i_s32f_convert_32f((float*)out, (int16_t*)dataBuf, 32768.0f / scaler, outCount * 2);
+                const int16_t* samples = (const int16_t*)dataBuf;
+                if (compressionType & PREPROCESS_ALL) {
+                    // Undo the preprocessing in a work buffer since the input is left untouched
+                    scratch.resize(outCount * sizeof(int16_t) * 2);
+                    if (compressionType & PREPROCESS_SHUFFLE) {
+                        preprocessing::unshuffle(scratch.data(), dataBuf, outCount * 2, sizeof(int16_t));
+                    }
+                    else {
+                        memcpy(scratch.data(), dataBuf, scratch.size());
+                    }
+                    if (compressionType & PREPROCESS_DELTA) { preprocessing::deltaDecode((int16_t*)scratch.data(), outCount); }
+                    samples = (const int16_t*)scratch.data();
+                }
+                volk_16i_s32f_convert_32f((float*)out, samples, 32768.0f / scaler, outCount * 2);
                 return outCount;
             }
             else if (sampleType == PCMType::PCM_TYPE_I8) {
                 int outCount = (count - 8) / (sizeof(int8_t) * 2);
-                volk_8i_s32f_convert_32f((float*)out, (int8_t*)dataBuf, 128.0f / scaler, outCount * 2);
+                const int8_t* samples = (const int8_t*)dataBuf;
+                if (compressionType & PREPROCESS_DELTA) {
+                    scratch.assign(dataBuf, dataBuf + (outCount * 2));
+                    preprocessing::deltaDecode((int8_t*)scratch.data(), outCount);
+                    samples = (const int8_t*)scratch.data();
+                }
+                volk_8i_s32f_convert_32f((float*)out, samples, 128.0f / scaler, outCount * 2);
                 return outCount;
             }
             
@@ -46,5 +75,8 @@ namespace dsp::compression {
             }
             return outCount;
         }
+
+    private:
+        std::vector<uint8_t> scratch;
     };
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include <stdint.h>
+#include <utility>
+#include <volk/volk.h>
+#include "../types.h"
+#include "../simd/simd.h"
+
+namespace dsp::convert {
+    // Interleaved IQ sample formats as sent by hardware and network sources
+    enum IQFormat {
+        IQ_FORMAT_U8,           // Unsigned 8bit, offset binary
+        IQ_FORMAT_S8,           // Signed 8bit
+        IQ_FORMAT_S12_PACKED,   // Signed 12bit, I and Q packed little endian in 3 bytes
+        IQ_FORMAT_S16,          // Signed 16bit, little endian
+        IQ_FORMAT_S24,          // Signed 24bit, little endian in 3 bytes
+        IQ_FORMAT_F32           // 32bit float
+    };
+
+    // Number of bytes taken by one complex sample
+    inline int iqSampleSize(IQFormat format) {
+        switch (format) {
+        case IQ_FORMAT_U8:          return 2;
+        case IQ_FORMAT_S8:          return 2;
+        case IQ_FORMAT_S12_PACKED:  return 3;
+        case IQ_FORMAT_S16:         return 4;
+        case IQ_FORMAT_S24:         return 6;
+        case IQ_FORMAT_F32:         return 8;
+        default:                    return 0;
+        }
+    }
+
+    // All converters output (raw - offset) * scale for count complex samples. The loops are kept free of
+    // branches and lookups so that the compiler vectorizes them, volk is used where it has a kernel and the SIMD
+    // kernels for the 8bit formats.
+
+    inline void swapIQ(complex_t* data, int count) {
+        for (int i = 0; i < count; i++) {
+            std::swap(data[i].re, data[i].im);
+        }
+    }
+
+    template <class T>
+    inline void integerToFloat(const T* in, float* out, int count, float offset, float scale) {
+        for (int i = 0; i < count; i++) {
+            out[i] = ((float)in[i] - offset) * scale;
+        }
+    }
+
+    inline void u8ToComplex(const uint8_t* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        simd::selectedKernels().u8ToF32(in, (float*)out, count * 2, offset, scale);
+        if (swap) { swapIQ(out, count); }
+    }
+
+    inline void s8ToComplex(const int8_t* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        if (offset == 0.0f) {
+            volk_8i_s32f_convert_32f((float*)out, in, 1.0f / scale, count * 2);
+        }
+        else {
+            simd::selectedKernels().s8ToF32(in, (float*)out, count * 2, offset, scale);
+        }
+        if (swap) { swapIQ(out, count); }
+    }
+
+    inline void s12PackedToComplex(const uint8_t* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        for (int i = 0; i < count; i++) {
+            const uint8_t* s = &in[i * 3];
+            // Move each value to the top of an int16 and shift back down to sign extend it
+            int16_t re = (int16_t)(((uint16_t)s[0] << 4) | ((uint16_t)(s[1] & 0x0F) << 12)) >> 4;
+            int16_t im = (int16_t)(((uint16_t)(s[1] & 0xF0)) | ((uint16_t)s[2] << 8)) >> 4;
+            out[i].re = ((float)re - offset) * scale;
+            out[i].im = ((float)im - offset) * scale;
+        }
+        if (swap) { swapIQ(out, count); }
+    }
+
+    inline void s16ToComplex(const int16_t* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        if (offset == 0.0f) {
+            volk_16i_s32f_convert_32f((float*)out, in, 1.0f / scale, count * 2);
+        }
+        else {
+            integerToFloat<int16_t>(in, (float*)out, count * 2, offset, scale);
+        }
+        if (swap) { swapIQ(out, count); }
+    }
+
+    inline void s24ToComplex(const uint8_t* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        float* fout = (float*)out;
+        for (int i = 0; i < count * 2; i++) {
+            const uint8_t* s = &in[i * 3];
+            // Same as for 12bit, at the top of an int32
+            int32_t val = (int32_t)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24)) >> 8;
+            fout[i] = ((float)val - offset) * scale;
+        }
+        if (swap) { swapIQ(out, count); }
+    }
+
+    inline void f32ToComplex(const float* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        if (offset == 0.0f) {
+            volk_32f_s32f_multiply_32f((float*)out, in, scale, count * 2);
+        }
+        else {
+            float* fout = (float*)out;
+            for (int i = 0; i < count * 2; i++) {
+                fout[i] = (in[i] - offset) * scale;
+            }
+        }
+        if (swap) { swapIQ(out, count); }
+    }
+
+    // Convert count complex samples of any format
+    inline void toComplex(IQFormat format, const void* in, complex_t* out, int count, float offset, float scale, bool swap = false) {
+        switch (format) {
+        case IQ_FORMAT_U8:
+            u8ToComplex((const uint8_t*)in, out, count, offset, scale, swap);
+            break;
+        case IQ_FORMAT_S8:
+            s8ToComplex((const int8_t*)in, out, count, offset, scale, swap);
+            break;
+        case IQ_FORMAT_S12_PACKED:
+            s12PackedToComplex((const uint8_t*)in, out, count, offset, scale, swap);
+            break;
+        case IQ_FORMAT_S16:
+            s16ToComplex((const int16_t*)in, out, count, offset, scale, swap);
+            break;
+        case IQ_FORMAT_S24:
+            s24ToComplex((const uint8_t*)in, out, count, offset, scale, swap);
+            break;
+        case IQ_FORMAT_F32:
+            f32ToComplex((const float*)in, out, count, offset, scale, swap);
+            break;
+        default:
+            break;
+        }
+    }
+}
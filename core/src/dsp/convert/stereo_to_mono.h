@@ -1,5 +1,6 @@
 #pragma once
 #include "../processor.h"
+#include "../simd/simd.h"
 
 namespace dsp::convert {
     class StereoToMono : public Processor<stereo_t, float> {
@@ -10,9 +11,7 @@ namespace dsp::convert {
         StereoToMono(stream<stereo_t>* in) { base_type::init(in); }
         
         inline int process(int count, const stereo_t* in, float* out) {
-            for (int i = 0; i < count; i++) {
-                out[i] = (in[i].l + in[i].r) / 2.0f;
-            }
+            simd::selectedKernels().stereoToMono((const float*)in, out, count);
             return count;
         }
 
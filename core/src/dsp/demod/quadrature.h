@@ -1,8 +1,7 @@
 #pragma once
 #include "../processor.h"
-#include "../math/fast_atan2.h"
 #include "../math/hz_to_rads.h"
-#include "../math/normalize_phase.h"
+#include "../math/phase_diff.h"
 
 namespace dsp::demod {
     class Quadrature : public Processor<complex_t, float> {
@@ -14,9 +13,16 @@ namespace dsp::demod {
 
         Quadrature(stream<complex_t>* in, double deviation, double samplerate) { init(in, deviation, samplerate); }
 
-        
+        ~Quadrature() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(diffBuf);
+        }
+
         virtual void init(stream<complex_t>* in, double deviation) {
             _invDeviation = 1.0 / deviation;
+            // Blocks can be initialized again, the buffer is kept
+            if (!diffBuf) { diffBuf = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE); }
             base_type::init(in);
         }
 
@@ -37,18 +43,14 @@ namespace dsp::demod {
         }
 
         inline int process(int count, complex_t* in, float* out) {
-            for (int i = 0; i < count; i++) {
-                float cphase = in[i].phase();
-                out[i] = math::normalizePhase(cphase - phase) * _invDeviation;
-                phase = cphase;
-            }
+            math::phaseDiff(in, lastSample, diffBuf, out, _invDeviation, count);
             return count;
         }
 
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            phase = 0.0f;
+            lastSample = { 0.0f, 0.0f };
         }
 
         int run() {
@@ -64,6 +66,7 @@ namespace dsp::demod {
 
     protected:
         float _invDeviation;
-        float phase = 0.0f;
+        complex_t lastSample = { 0.0f, 0.0f };
+        complex_t* diffBuf = NULL;
     };
 }
\ No newline at end of file
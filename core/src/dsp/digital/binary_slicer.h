@@ -1,5 +1,6 @@
 #pragma once
 #include "../processor.h"
+#include "../simd/simd.h"
 
 namespace dsp::digital {
     class BinarySlicer : public Processor<float, uint8_t> {
@@ -10,10 +11,7 @@ namespace dsp::digital {
         BinarySlicer(stream<float> *in) { base_type::init(in); }
 
         static inline int process(int count, const float* in, uint8_t* out) {
-            // TODO: Switch to volk
-            for (int i = 0; i < count; i++) {
-                out[i] = in[i] > 0.0f;
-            }
+            simd::selectedKernels().slice_32f_8u(in, out, count);
             return count;
         }
 
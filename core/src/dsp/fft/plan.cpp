@@ -0,0 +1,204 @@
+#include "plan.h"
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <condition_variable>
+#include <utils/flog.h>
+
+// Longest the background planner may spend on a single plan, in seconds. The FFTW planner can only be used by
+// one thread at a time, so a thread that needs a plan of a shape that was never made before can wait this long.
+#define PLAN_CACHE_TIME_LIMIT   0.25
+
+namespace dsp::fft {
+    // Everything that creates or destroys a plan must hold this
+    std::mutex plannerMtx;
+
+    // Plans made so far, by type, size, direction, in place and unaligned
+    typedef std::tuple<PlanType, int, bool, bool, bool> PlanKey;
+    std::mutex cacheMtx;
+    std::map<PlanKey, std::shared_ptr<PlanState>> cache;
+
+    std::mutex queueMtx;
+    std::condition_variable queueCV;
+    std::deque<std::shared_ptr<PlanState>> queue;
+    std::thread workerThread;
+    bool running = false;
+    PlanRigor _rigor = PLAN_RIGOR_ESTIMATE;
+    std::string _wisdomPath;
+
+    unsigned int rigorFlags(PlanRigor rigor) {
+        if (rigor == PLAN_RIGOR_PATIENT) { return FFTW_PATIENT; }
+        if (rigor == PLAN_RIGOR_MEASURE) { return FFTW_MEASURE; }
+        return FFTW_ESTIMATE;
+    }
+
+    fftwf_plan makePlan(PlanType type, int size, void* in, void* out, bool backward, unsigned int flags) {
+        switch (type) {
+        case PLAN_TYPE_COMPLEX:
+            return fftwf_plan_dft_1d(size, (fftwf_complex*)in, (fftwf_complex*)out, backward ? FFTW_BACKWARD : FFTW_FORWARD, flags);
+        case PLAN_TYPE_REAL_TO_COMPLEX:
+            return fftwf_plan_dft_r2c_1d(size, (float*)in, (fftwf_complex*)out, flags);
+        case PLAN_TYPE_COMPLEX_TO_REAL:
+            return fftwf_plan_dft_c2r_1d(size, (fftwf_complex*)in, (float*)out, flags);
+        }
+        return NULL;
+    }
+
+    void worker() {
+        while (true) {
+            // Wait for a plan to upgrade
+            std::shared_ptr<PlanState> state;
+            PlanRigor rigor;
+            {
+                std::unique_lock<std::mutex> lck(queueMtx);
+                queueCV.wait(lck, []() { return !queue.empty() || !running; });
+                if (!running) { return; }
+                state = queue.front();
+                queue.pop_front();
+                rigor = _rigor;
+            }
+            if (rigor == PLAN_RIGOR_ESTIMATE) { continue; }
+
+            std::lock_guard<std::mutex> lck(plannerMtx);
+
+            // Measure on scratch buffers so that the samples of the owner of the plan don't get overwritten
+            int complexSize = (state->type == PLAN_TYPE_COMPLEX) ? state->size : (state->size / 2) + 1;
+            size_t scratchSize = complexSize * sizeof(complex_t);
+            void* in = fftwf_malloc(scratchSize);
+            void* out = state->inPlace ? in : fftwf_malloc(scratchSize);
+            unsigned int flags = rigorFlags(rigor);
+            if (state->unaligned) { flags |= FFTW_UNALIGNED; }
+
+            fftwf_set_timelimit(PLAN_CACHE_TIME_LIMIT);
+            fftwf_plan plan = makePlan(state->type, state->size, in, out, state->backward, flags);
+            fftwf_set_timelimit(FFTW_NO_TIMELIMIT);
+
+            fftwf_free(in);
+            if (!state->inPlace) { fftwf_free(out); }
+            if (!plan) {
+                flog::warn("Could not upgrade FFT plan of size {0}", state->size);
+                continue;
+            }
+            state->upgraded.store(plan, std::memory_order_release);
+
+            // Save the wisdom right away so that it isn't lost if the program doesn't exit cleanly
+            if (!_wisdomPath.empty() && !fftwf_export_wisdom_to_filename(_wisdomPath.c_str())) {
+                flog::warn("Could not save FFTW wisdom to '{0}'", _wisdomPath);
+            }
+        }
+    }
+
+    void startPlanCache(const std::string& wisdomPath, PlanRigor rigor) {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        if (running) { return; }
+        _wisdomPath = wisdomPath;
+        _rigor = rigor;
+
+        {
+            std::lock_guard<std::mutex> lck2(plannerMtx);
+            if (fftwf_import_wisdom_from_filename(_wisdomPath.c_str())) {
+                flog::info("Loaded FFTW wisdom from '{0}'", _wisdomPath);
+            }
+        }
+
+        running = true;
+        workerThread = std::thread(worker);
+    }
+
+    void stopPlanCache() {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (!running) { return; }
+            running = false;
+            queue.clear();
+        }
+        queueCV.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+    }
+
+    void setPlanRigor(PlanRigor rigor) {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        _rigor = rigor;
+    }
+
+    // Queue a plan to be measured if the rigor asks for it and it wasn't already
+    void queueUpgrade(const std::shared_ptr<PlanState>& state) {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (!running || _rigor == PLAN_RIGOR_ESTIMATE || state->queued || state->upgraded.load()) { return; }
+            state->queued = true;
+            queue.push_back(state);
+        }
+        queueCV.notify_one();
+    }
+
+    std::shared_ptr<PlanState> createPlan(PlanType type, int size, void* in, void* out, bool backward) {
+        bool inPlace = (in == out);
+        bool unaligned = fftwf_alignment_of((float*)in) || fftwf_alignment_of((float*)out);
+        PlanKey key = { type, size, backward, inPlace, unaligned };
+
+        // Plans run on the buffers given to execute, so one of the same shape can be used as is
+        {
+            std::lock_guard<std::mutex> lck(cacheMtx);
+            auto it = cache.find(key);
+            if (it != cache.end()) {
+                queueUpgrade(it->second);
+                return it->second;
+            }
+        }
+
+        std::shared_ptr<PlanState> state = std::make_shared<PlanState>();
+        state->type = type;
+        state->size = size;
+        state->backward = backward;
+        state->inPlace = inPlace;
+        state->unaligned = unaligned;
+
+        PlanRigor rigor;
+        bool upgrade;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            rigor = _rigor;
+            upgrade = running && rigor != PLAN_RIGOR_ESTIMATE;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(plannerMtx);
+            unsigned int flags = unaligned ? FFTW_UNALIGNED : 0;
+
+            // If the wisdom already knows the best plan, it can be used right away without measuring
+            state->plan = NULL;
+            if (upgrade) {
+                state->plan = makePlan(type, size, in, out, backward, rigorFlags(rigor) | FFTW_WISDOM_ONLY | flags);
+                // Nothing to measure then
+                if (state->plan) { state->queued = true; }
+            }
+            if (!state->plan) {
+                state->plan = makePlan(type, size, in, out, backward, FFTW_ESTIMATE | flags);
+            }
+        }
+
+        // Another thread may have made the same plan in the meantime
+        {
+            std::lock_guard<std::mutex> lck(cacheMtx);
+            auto [it, inserted] = cache.emplace(key, state);
+            if (!inserted) {
+                std::lock_guard<std::mutex> lck2(plannerMtx);
+                fftwf_destroy_plan(state->plan);
+                state = it->second;
+            }
+        }
+
+        // Measure it in the background
+        queueUpgrade(state);
+
+        return state;
+    }
+
+    void destroyPlan(std::shared_ptr<PlanState>& state) {
+        // The plans stay in the cache for the next one of the same shape
+        state.reset();
+    }
+}
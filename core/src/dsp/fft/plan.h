@@ -0,0 +1,109 @@
+#pragma once
+#include <fftw3.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "../types.h"
+
+namespace dsp::fft {
+    enum PlanRigor {
+        PLAN_RIGOR_ESTIMATE,
+        PLAN_RIGOR_MEASURE,
+        PLAN_RIGOR_PATIENT
+    };
+
+    enum PlanType {
+        PLAN_TYPE_COMPLEX,
+        PLAN_TYPE_REAL_TO_COMPLEX,
+        PLAN_TYPE_COMPLEX_TO_REAL
+    };
+
+    struct PlanState {
+        PlanType type;
+        int size;
+        bool backward;
+        bool inPlace;
+        bool unaligned;
+        fftwf_plan plan;
+        std::atomic<fftwf_plan> upgraded = NULL;
+        bool queued = false;
+    };
+
+    // Load the wisdom file and start upgrading plans in the background. Plans can be created before this
+    // is called, they will just stay estimated.
+    void startPlanCache(const std::string& wisdomPath, PlanRigor rigor);
+    void stopPlanCache();
+    void setPlanRigor(PlanRigor rigor);
+
+    // Get the state of a plan, see Plan. Usually not needed directly. States are shared by all the plans of the same
+    // type, size, direction and buffer layout, and are kept for the lifetime of the program, so that creating a plan
+    // that was already made once doesn't need the FFTW planner.
+    std::shared_ptr<PlanState> createPlan(PlanType type, int size, void* in, void* out, bool backward);
+    void destroyPlan(std::shared_ptr<PlanState>& state);
+
+    // FFTW plan handle. It starts out as a plan from the wisdom if there is one or an estimated one otherwise,
+    // and is switched to a measured plan once the background planner has made one. The measured plan runs
+    // on the buffers given at creation through the new-array execute interface, they must not change.
+    class Plan {
+    public:
+        Plan() {}
+
+        Plan(int size, complex_t* in, complex_t* out, bool backward = false) { init(size, in, out, backward); }
+
+        Plan(int size, float* in, complex_t* out) { init(size, in, out); }
+
+        Plan(int size, complex_t* in, float* out) { init(size, in, out); }
+
+        Plan(const Plan& b) = delete;
+        Plan& operator=(const Plan& b) = delete;
+
+        ~Plan() { destroy(); }
+
+        void init(int size, complex_t* in, complex_t* out, bool backward = false) {
+            destroy();
+            _in = in;
+            _out = out;
+            state = createPlan(PLAN_TYPE_COMPLEX, size, in, out, backward);
+        }
+
+        void init(int size, float* in, complex_t* out) {
+            destroy();
+            _in = in;
+            _out = out;
+            state = createPlan(PLAN_TYPE_REAL_TO_COMPLEX, size, in, out, false);
+        }
+
+        void init(int size, complex_t* in, float* out) {
+            destroy();
+            _in = in;
+            _out = out;
+            state = createPlan(PLAN_TYPE_COMPLEX_TO_REAL, size, in, out, true);
+        }
+
+        void destroy() {
+            if (!state) { return; }
+            destroyPlan(state);
+        }
+
+        inline void execute() {
+            fftwf_plan p = state->upgraded.load(std::memory_order_acquire);
+            if (!p) { p = state->plan; }
+            switch (state->type) {
+            case PLAN_TYPE_COMPLEX:
+                fftwf_execute_dft(p, (fftwf_complex*)_in, (fftwf_complex*)_out);
+                break;
+            case PLAN_TYPE_REAL_TO_COMPLEX:
+                fftwf_execute_dft_r2c(p, (float*)_in, (fftwf_complex*)_out);
+                break;
+            case PLAN_TYPE_COMPLEX_TO_REAL:
+                fftwf_execute_dft_c2r(p, (fftwf_complex*)_in, (float*)_out);
+                break;
+            }
+        }
+
+    private:
+        std::shared_ptr<PlanState> state;
+        void* _in;
+        void* _out;
+    };
+}
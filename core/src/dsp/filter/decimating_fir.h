@@ -12,6 +12,7 @@ namespace dsp::filter {
 
         void init(stream<D>* in, tap<T>& taps, int decimation) {
             _decimation = decimation;
+            base_type::fftDecimation = decimation;
             base_type::init(in, taps);
         }
 
@@ -29,6 +30,8 @@ namespace dsp::filter {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _decimation = decimation;
+            base_type::fftDecimation = decimation;
+            base_type::updateFFT();
             offset = 0;
             base_type::tempStart();
         }
@@ -46,6 +49,13 @@ namespace dsp::filter {
             // Copy data to work buffer
             memcpy(base_type::bufStart, in, count * sizeof(D));
 
+            // Do convolution in the frequency domain for long filters
+            if (base_type::useFFT) {
+                int outCount = base_type::convolveFFT(count, out, offset, _decimation);
+                memmove(base_type::buffer, &base_type::buffer[count], (base_type::_taps.size - 1) * sizeof(D));
+                return outCount;
+            }
+
             // Do convolution
             int outCount = 0;
             for (; offset < count; offset += _decimation) {
@@ -87,7 +87,13 @@ namespace dsp::filter {
             return count;
         }
 
+        bool fusable() { return true; }
+
     private:
+        int fusedProcess(int count, const T* in, T* out) {
+            return process(count, in, out);
+        }
+
         void updateAlpha() {
             float dt = 1.0f / _samplerate;
             alpha = dt / (_tau + dt);
@@ -1,6 +1,10 @@
 #pragma once
 #include "../processor.h"
 #include "../taps/tap.h"
+#include "../fft/plan.h"
+
+// Tap count from which the convolution is done in the frequency domain using overlap-save
+#define FIR_FFT_TAP_THRESHOLD   128
 
 namespace dsp::filter {
     template <class D, class T>
@@ -15,6 +19,7 @@ namespace dsp::filter {
             if (!base_type::_block_init) { return; }
             base_type::stop();
             buffer::free(buffer);
+            destroyFFT();
         }
 
         virtual void init(stream<D>* in, tap<T>& taps) {
@@ -25,6 +30,8 @@ namespace dsp::filter {
             bufStart = &buffer[_taps.size - 1];
             buffer::clear<D>(buffer, _taps.size - 1);
 
+            updateFFT();
+
             base_type::init(in);
         }
 
@@ -47,10 +54,24 @@ namespace dsp::filter {
                 memmove(&buffer[_taps.size - oldTC], buffer, (oldTC - 1) * sizeof(D));
                 buffer::clear<D>(buffer, _taps.size - oldTC);
             }
+
+            updateFFT();
             
             base_type::tempStart();
         }
 
+        // Override the tap count from which the FFT convolution is used, INT_MAX disables it
+        void setFFTThreshold(int threshold) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            fftThreshold = threshold;
+            updateFFT();
+            base_type::tempStart();
+        }
+
+        inline bool usingFFT() { return useFFT; }
+
         virtual void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
@@ -62,6 +83,14 @@ namespace dsp::filter {
         inline int process(int count, const D* in, D* out) {
             // Copy data to work buffer
             memcpy(bufStart, in, count * sizeof(D));
+
+            // Do convolution in the frequency domain for long filters
+            if (useFFT) {
+                int offset = 0;
+                convolveFFT(count, out, offset, 1);
+                memmove(buffer, &buffer[count], (_taps.size - 1) * sizeof(D));
+                return count;
+            }
             
             // Do convolution
             for (int i = 0; i < count; i++) {
@@ -94,8 +123,103 @@ namespace dsp::filter {
         }
 
     protected:
+        static constexpr bool fftSupported = (std::is_same_v<D, float> && std::is_same_v<T, float>) ||
+                                             ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && (std::is_same_v<T, float> || std::is_same_v<T, complex_t>));
+
+        void updateFFT() {
+            destroyFFT();
+            // Every output is computed in the frequency domain, so with decimation the dot products only compute
+            // one in fftDecimation and the filter must be that much longer for the FFT to pay off
+            useFFT = fftSupported && ((int)_taps.size / fftDecimation) >= fftThreshold;
+            if (!useFFT) { return; }
+
+            // Use blocks of at least 4 times the filter length to keep the overhead of the overlap low
+            fftSize = 1024;
+            while (fftSize < 4 * _taps.size) { fftSize <<= 1; }
+            fftHop = fftSize - _taps.size + 1;
+
+            // Real signals only need half of the spectrum
+            int specSize = std::is_same_v<D, float> ? (fftSize / 2) + 1 : fftSize;
+            fftBuf = (D*)fftwf_malloc(fftSize * sizeof(D));
+            fftSpec = (complex_t*)fftwf_malloc(specSize * sizeof(complex_t));
+            fftTaps = (complex_t*)fftwf_malloc(specSize * sizeof(complex_t));
+            if constexpr (std::is_same_v<D, float>) {
+                fwdPlan.init(fftSize, fftBuf, fftSpec);
+                invPlan.init(fftSize, fftSpec, fftBuf);
+            }
+            else {
+                fwdPlan.init(fftSize, (complex_t*)fftBuf, fftSpec);
+                invPlan.init(fftSize, fftSpec, (complex_t*)fftBuf, true);
+            }
+
+            // The taps are applied as a dot product, so the equivalent impulse response is reversed
+            buffer::clear<D>(fftBuf, fftSize);
+            for (int i = 0; i < _taps.size; i++) {
+                if constexpr (std::is_same_v<T, float> && std::is_same_v<D, float>) {
+                    fftBuf[i] = _taps.taps[_taps.size - 1 - i];
+                }
+                else if constexpr (std::is_same_v<T, float>) {
+                    ((complex_t*)fftBuf)[i] = { _taps.taps[_taps.size - 1 - i], 0.0f };
+                }
+                else {
+                    ((complex_t*)fftBuf)[i] = _taps.taps[_taps.size - 1 - i];
+                }
+            }
+            fwdPlan.execute();
+
+            // Include the normalization of the inverse FFT in the filter's spectrum
+            volk_32f_s32f_multiply_32f((float*)fftTaps, (float*)fftSpec, 1.0f / (float)fftSize, specSize * 2);
+        }
+
+        void destroyFFT() {
+            if (!fftBuf) { return; }
+            fwdPlan.destroy();
+            invPlan.destroy();
+            fftwf_free(fftBuf);
+            fftwf_free(fftSpec);
+            fftwf_free(fftTaps);
+            fftBuf = NULL;
+        }
+
+        // Overlap-save convolution of the work buffer. Only the outputs starting at offset and then every
+        // decimation samples are written so that decimating filters can use it as well.
+        int convolveFFT(int count, D* out, int& offset, int decimation) {
+            int specSize = std::is_same_v<D, float> ? (fftSize / 2) + 1 : fftSize;
+            int outCount = 0;
+            for (int i = 0; i < count; i += fftHop) {
+                // Load the block along with its history, zero pad the last one
+                int n = std::min<int>(fftHop, count - i);
+                int segLen = n + _taps.size - 1;
+                memcpy(fftBuf, &buffer[i], segLen * sizeof(D));
+                if (segLen < fftSize) { buffer::clear<D>(fftBuf, fftSize - segLen, segLen); }
+
+                // Filter
+                fwdPlan.execute();
+                volk_32fc_x2_multiply_32fc((lv_32fc_t*)fftSpec, (lv_32fc_t*)fftSpec, (lv_32fc_t*)fftTaps, specSize);
+                invPlan.execute();
+
+                // Keep the samples that aren't affected by the circular wrap
+                for (; offset < i + n; offset += decimation) {
+                    out[outCount++] = fftBuf[offset - i + _taps.size - 1];
+                }
+            }
+            offset -= count;
+            return outCount;
+        }
+
         tap<T> _taps;
         D* buffer;
         D* bufStart;
+
+        int fftThreshold = FIR_FFT_TAP_THRESHOLD;
+        int fftDecimation = 1;
+        bool useFFT = false;
+        int fftSize;
+        int fftHop;
+        D* fftBuf = NULL;
+        complex_t* fftSpec;
+        complex_t* fftTaps;
+        fft::Plan fwdPlan;
+        fft::Plan invPlan;
     };
 }
\ No newline at end of file
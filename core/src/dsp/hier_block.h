@@ -41,6 +41,14 @@ namespace dsp {
             }
         }
 
+        // Name the blocks inside after the hierarchical block
+        void setProfileName(const std::string& name) {
+            profileName = name;
+            for (auto& block : blocks) {
+                block->setProfileName(name + " / " + profiler::typeName(typeid(*block)));
+            }
+        }
+
         void tempStop() {
             assert(_block_init);
             if (tempStopDepth++) { return; }
@@ -68,9 +76,14 @@ namespace dsp {
         bool running = false;
         int tempStopDepth = 0;
 
+        std::string profileName;
+
     protected:
         void registerBlock(generic_block* block) {
             blocks.push_back(block);
+            if (!profileName.empty()) {
+                block->setProfileName(profileName + " / " + profiler::typeName(typeid(*block)));
+            }
         }
 
         void unregisterBlock(generic_block* block) {
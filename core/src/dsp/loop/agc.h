@@ -10,6 +10,13 @@ namespace dsp::loop {
 
         AGC(stream<T>* in, double setPoint, double attack, double decay, double maxGain, double maxOutputAmp, double initGain = 1.0) { init(in, setPoint, attack, decay, maxGain, maxOutputAmp, initGain); }
 
+        ~AGC() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(ampBuf);
+            buffer::free(gainBuf);
+        }
+
         void init(stream<T>* in, double setPoint, double attack, double decay, double maxGain, double maxOutputAmp, double initGain = 1.0) {
             _setPoint = setPoint;
             _attack = attack;
@@ -20,6 +27,8 @@ namespace dsp::loop {
             _maxOutputAmp = maxOutputAmp;
             _initGain = initGain;
             amp = _setPoint / _initGain;
+            if (!ampBuf) { ampBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE); }
+            if (!gainBuf) { gainBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE); }
             base_type::init(in);
         }
 
@@ -68,43 +77,59 @@ namespace dsp::loop {
         }
 
         inline int process(int count, T* in, T* out) {
-            for (int i = 0; i < count; i++) {
-                // Get signal amplitude
-                float inAmp, gain;
-                if constexpr (std::is_same_v<T, complex_t>) {
-                    inAmp = in[i].amplitude();
-                }
-                if constexpr (std::is_same_v<T, float>) {
-                    inAmp = fabsf(in[i]);
-                }
+            // Get signal amplitudes
+            if constexpr (std::is_same_v<T, complex_t>) {
+                volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)in, count);
+            }
+            if constexpr (std::is_same_v<T, float>) {
+                for (int i = 0; i < count; i++) { ampBuf[i] = fabsf(in[i]); }
+            }
 
-                // Update average amplitude
-                if (inAmp != 0.0f) {
-                    amp = (inAmp > amp) ? ((amp * _invAttack) + (inAmp * _attack)) : ((amp * _invDecay) + (inAmp * _decay));
-                    gain = std::min<float>(_setPoint / amp, _maxGain);
-                }
-                else {
-                    gain = 1.0f;
-                }
+            // Work on local copies of the state so that it stays in registers, the compiler can't tell that the
+            // gain buffer doesn't alias the members
+            float _amp = amp;
+            const float setPoint = _setPoint;
+            const float attack = _attack;
+            const float invAttack = _invAttack;
+            const float decay = _decay;
+            const float invDecay = _invDecay;
+            const float maxGain = _maxGain;
+            const float maxOutputAmp = _maxOutputAmp;
+            bool lookAhead = false;
+            for (int i = 0; i < count; i++) {
+                // Update average amplitude, written with selects so that the loop stays branchless
+                float inAmp = ampBuf[i];
+                float attacked = (_amp * invAttack) + (inAmp * attack);
+                float decayed = (_amp * invDecay) + (inAmp * decay);
+                float newAmp = (inAmp > _amp) ? attacked : decayed;
+                _amp = (inAmp != 0.0f) ? newAmp : _amp;
+                float gain = (inAmp != 0.0f) ? std::min<float>(setPoint / _amp, maxGain) : 1.0f;
 
                 // If clipping is detected look ahead and correct
-                if (inAmp*gain > _maxOutputAmp) {
-                    float maxAmp = 0;
-                    for (int j = i; j < count; j++) {
-                        if constexpr (std::is_same_v<T, complex_t>) {
-                            inAmp = in[j].amplitude();
+                if (inAmp*gain > maxOutputAmp) {
+                    // The max amplitude from each sample to the end of the block is computed the first time it's
+                    // needed, in the part of the gain buffer that hasn't been written yet
+                    if (!lookAhead) {
+                        float maxAmp = 0.0f;
+                        for (int j = count - 1; j >= i; j--) {
+                            maxAmp = std::max<float>(maxAmp, ampBuf[j]);
+                            gainBuf[j] = maxAmp;
                         }
-                        if constexpr (std::is_same_v<T, float>) {
-                            inAmp = fabsf(in[j]);
-                        }
-                        if (inAmp > maxAmp) { maxAmp = inAmp; }
+                        lookAhead = true;
                     }
-                    amp = maxAmp;
-                    gain = std::min<float>(_setPoint / amp, _maxGain);
+                    _amp = gainBuf[i];
+                    gain = std::min<float>(setPoint / _amp, maxGain);
                 }
-                
-                // Scale output by gain
-                out[i] = in[i] * gain;
+                gainBuf[i] = gain;
+            }
+            amp = _amp;
+
+            // Scale output by gain
+            if constexpr (std::is_same_v<T, complex_t>) {
+                volk_32fc_32f_multiply_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, gainBuf, count);
+            }
+            if constexpr (std::is_same_v<T, float>) {
+                volk_32f_x2_multiply_32f(out, in, gainBuf, count);
             }
             return count;
         }
@@ -132,5 +157,8 @@ namespace dsp::loop {
 
         float amp = 1.0;
 
+        float* ampBuf = NULL;
+        float* gainBuf = NULL;
+
     };
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+#include <volk/volk.h>
+#include "../types.h"
+
+namespace dsp::math {
+    // Phase difference between consecutive samples multiplied by scale. It's computed as the phase of
+    // x[n]*conj(x[n-1]) so the result never needs to be wrapped. last is the sample preceding in[0] and is
+    // updated to the last input sample. tmp must hold count samples.
+    // volk picks the multiply and polynomial atan2 kernels (SSE4.1, AVX2, AVX-512, NEON...) at runtime.
+    inline void phaseDiff(complex_t* in, complex_t& last, complex_t* tmp, float* out, float scale, int count) {
+        if (count <= 0) { return; }
+        tmp[0] = in[0] * last.conj();
+        volk_32fc_x2_multiply_conjugate_32fc((lv_32fc_t*)&tmp[1], (lv_32fc_t*)&in[1], (lv_32fc_t*)in, count - 1);
+        volk_32fc_s32f_atan2_32f(out, (lv_32fc_t*)tmp, 1.0f / scale, count);
+        last = in[count - 1];
+    }
+}
@@ -109,7 +109,13 @@ namespace dsp::multirate {
             return outCount;
         }
 
+        bool fusable() { return true; }
+
     protected:
+        int fusedProcess(int count, const T* in, T* out) {
+            return process(count, in, out);
+        }
+
         enum Mode {
             BOTH,
             DECIM_ONLY,
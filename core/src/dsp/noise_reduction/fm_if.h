@@ -1,9 +1,14 @@
 #pragma once
 #include "../processor.h"
 #include "../window/nuttall.h"
-#include <fftw3.h>
+#include "../fft/plan.h"
+
+// Half width of the frequency domain window kernel, the 4 term Nuttall window only needs 3 bins on each side
+#define FMIF_WIN_KERNEL_HALF    3
 
 namespace dsp::noise_reduction {
+    // Keeps only the strongest frequency bin of a sliding window DFT. The DFT is updated recursively for every
+    // input sample instead of being recomputed, and the window is applied in the frequency domain.
     class FMIF : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
@@ -38,7 +43,6 @@ namespace dsp::noise_reduction {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             buffer::clear(buffer, _bins - 1);
-            buffer::clear(backFFTIn, _bins);
             base_type::tempStart();
         }
 
@@ -46,28 +50,43 @@ namespace dsp::noise_reduction {
             // Write new input data to buffer buffer
             memcpy(bufferStart, in, count * sizeof(complex_t));
             
-            // Iterate the FFT
+            // Slide the DFT
             for (int i = 0; i < count; i++) {
-                // Apply windows
-                volk_32fc_32f_multiply_32fc((lv_32fc_t*)forwFFTIn, (lv_32fc_t*)&buffer[i], fftWin, _bins);
-
-                // Do forward FFT
-                fftwf_execute(forwardPlan);
-
-                // Process bins here
+                // Periodically compute the bins from scratch so that rounding errors don't accumulate
+                if (!(i % _bins)) {
+                    memcpy(forwFFTIn, &buffer[i], _bins * sizeof(complex_t));
+                    forwardPlan.execute();
+                    memcpy(sdft, forwFFTOut, _bins * sizeof(complex_t));
+                }
+                else {
+                    // Add the newest sample, remove the oldest one and rotate
+                    const complex_t& newest = buffer[i + _bins - 1];
+                    const complex_t& oldest = buffer[i - 1];
+                    float dre = newest.re - oldest.re;
+                    float dim = newest.im - oldest.im;
+                    for (int k = 0; k < _bins; k++) {
+                        float re = sdft[k].re + dre;
+                        float im = sdft[k].im + dim;
+                        sdft[k].re = (re * twiddles[k].re) - (im * twiddles[k].im);
+                        sdft[k].im = (re * twiddles[k].im) + (im * twiddles[k].re);
+                    }
+                }
+
+                // Update the wrap around copies needed by the window kernel
+                memcpy(&sdft[-FMIF_WIN_KERNEL_HALF], &sdft[_bins - FMIF_WIN_KERNEL_HALF], FMIF_WIN_KERNEL_HALF * sizeof(complex_t));
+                memcpy(&sdft[_bins], sdft, FMIF_WIN_KERNEL_HALF * sizeof(complex_t));
+
+                // Apply window in the frequency domain and find the bin of highest amplitude
+                for (int k = 0; k < _bins; k++) {
+                    complex_t val = windowed(k);
+                    ampBuf[k] = (val.re * val.re) + (val.im * val.im);
+                }
                 uint32_t idx;
-                volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)forwFFTOut, _bins);
                 volk_32f_index_max_32u(&idx, ampBuf, _bins);
 
-                // Keep only the bin of highest amplitude
-                backFFTIn[idx] = forwFFTOut[idx];
-
-                // Do reverse FFT and get first element
-                fftwf_execute(backwardPlan);
-                out[i] = backFFTOut[_bins / 2];
-
-                // Reset the input buffer
-                backFFTIn[idx] = { 0, 0 };
+                // Keep only that bin, this is the middle sample of its inverse DFT
+                complex_t val = windowed(idx);
+                out[i] = (idx & 1) ? complex_t{ -val.re, -val.im } : val;
             }
 
             // Move buffer buffer
@@ -88,58 +107,79 @@ namespace dsp::noise_reduction {
             return count;
         }
 
+        bool fusable() { return true; }
+
     protected:
+        int fusedProcess(int count, const complex_t* in, complex_t* out) {
+            return process(count, in, out);
+        }
+
+        inline complex_t windowed(int k) {
+            complex_t val = { sdft[k].re * winKernel[0], sdft[k].im * winKernel[0] };
+            for (int m = 1; m <= FMIF_WIN_KERNEL_HALF; m++) {
+                val.re += (sdft[k - m].re + sdft[k + m].re) * winKernel[m];
+                val.im += (sdft[k - m].im + sdft[k + m].im) * winKernel[m];
+            }
+            return val;
+        }
+
         void initBuffers() {
-            // Allocate FFT buffers
+            // Allocate FFT buffers, only used to periodically compute the bins from scratch
             forwFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
             forwFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-            backFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-            backFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+
+            // Allocate the bins with room for wrap around copies on each side
+            sdftBuf = buffer::alloc<complex_t>(_bins + (2 * FMIF_WIN_KERNEL_HALF));
+            sdft = &sdftBuf[FMIF_WIN_KERNEL_HALF];
+
+            // Generate the rotation applied to each bin when sliding by one sample
+            twiddles = buffer::alloc<complex_t>(_bins);
+            for (int i = 0; i < _bins; i++) {
+                double phase = 2.0 * DB_M_PI * (double)i / (double)_bins;
+                twiddles[i] = { (float)cos(phase), (float)sin(phase) };
+            }
 
             // Allocate and clear delay buffer
             buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + 64000);
             bufferStart = &buffer[_bins - 1];
             buffer::clear(buffer, _bins - 1);
 
-            // Clear backward FFT input since only one value is changed and reset at a time
-            buffer::clear(backFFTIn, _bins);
-
             // Allocate amplitude buffer
             ampBuf = buffer::alloc<float>(_bins);
 
-            // Allocate and generate Window
-            fftWin = buffer::alloc<float>(_bins);
-            for (int i = 0; i < _bins; i++) { fftWin[i] = window::nuttall(i, _bins - 1); }
+            // The window is periodic so that multiplying by it is a short convolution of the bins
+            for (int m = 0; m <= FMIF_WIN_KERNEL_HALF; m++) {
+                double sum = 0.0;
+                for (int i = 0; i < _bins; i++) { sum += window::nuttall(i, _bins) * cos(2.0 * DB_M_PI * (double)(m * i) / (double)_bins); }
+                winKernel[m] = sum / (double)_bins;
+            }
 
-            // Plan FFTs
-            forwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)forwFFTIn, (fftwf_complex*)forwFFTOut, FFTW_FORWARD, FFTW_ESTIMATE);
-            backwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)backFFTIn, (fftwf_complex*)backFFTOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+            // Plan FFT
+            forwardPlan.init(_bins, forwFFTIn, forwFFTOut);
         }
 
         void destroyBuffers() {
-            fftwf_destroy_plan(forwardPlan);
-            fftwf_destroy_plan(backwardPlan);
+            forwardPlan.destroy();
             fftwf_free(forwFFTIn);
             fftwf_free(forwFFTOut);
-            fftwf_free(backFFTIn);
-            fftwf_free(backFFTOut);
             buffer::free(buffer);
             buffer::free(ampBuf);
-            buffer::free(fftWin);
+            buffer::free(sdftBuf);
+            buffer::free(twiddles);
         }
 
         complex_t* forwFFTIn;
         complex_t* forwFFTOut;
-        complex_t* backFFTIn;
-        complex_t* backFFTOut;
 
-        fftwf_plan forwardPlan;
-        fftwf_plan backwardPlan;
+        fft::Plan forwardPlan;
 
         complex_t* buffer;
         complex_t* bufferStart;
 
-        float* fftWin;
+        complex_t* sdftBuf;
+        complex_t* sdft;
+        complex_t* twiddles;
+        float winKernel[FMIF_WIN_KERNEL_HALF + 1];
 
         float* ampBuf;
 
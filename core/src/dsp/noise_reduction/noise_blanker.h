@@ -9,10 +9,19 @@ namespace dsp::noise_reduction {
 
         NoiseBlanker(stream<complex_t>* in, double rate, double level) { init(in, rate, level); }
 
+        ~NoiseBlanker() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(ampBuf);
+            buffer::free(gainBuf);
+        }
+
         void init(stream<complex_t>* in, double rate, double level) {
             _rate = rate;
             _invRate = 1.0f - _rate;
             _level = level;
+            if (!ampBuf) { ampBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE); }
+            if (!gainBuf) { gainBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE); }
             base_type::init(in);
         }
 
@@ -36,23 +45,26 @@ namespace dsp::noise_reduction {
         }
 
         inline int process(int count, complex_t* in, complex_t* out) {
+            // Get signal amplitudes
+            volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)in, count);
+
+            // Update average amplitude, written with selects so that the loop stays branchless. The state is
+            // copied to locals so that it stays in registers.
+            float _amp = amp;
+            const float rate = _rate;
+            const float invRate = _invRate;
+            const float level = _level;
             for (int i = 0; i < count; i++) {
-                // Get signal amplitude
-                float inAmp = in[i].amplitude();
-
-                // Update average amplitude
-                float gain = 1.0f;
-                if (inAmp != 0.0f) {
-                    amp = (amp * _invRate) + (inAmp * _rate);
-                    float excess = inAmp / amp;
-                    if (excess > _level) {
-                        gain = 1.0f / excess;
-                    }
-                }
-                
-                // Scale output by gain
-                out[i] = in[i] * gain;
+                float inAmp = ampBuf[i];
+                float newAmp = (_amp * invRate) + (inAmp * rate);
+                _amp = (inAmp != 0.0f) ? newAmp : _amp;
+                float excess = inAmp / _amp;
+                gainBuf[i] = (inAmp != 0.0f && excess > level) ? (1.0f / excess) : 1.0f;
             }
+            amp = _amp;
+
+            // Scale output by gain
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, gainBuf, count);
             return count;
         }
 
@@ -67,12 +79,21 @@ namespace dsp::noise_reduction {
             return count;
         }
 
+        bool fusable() { return true; }
+
     protected:
+        int fusedProcess(int count, const complex_t* in, complex_t* out) {
+            return process(count, (complex_t*)in, out);
+        }
+
         float _rate;
         float _invRate;
         float _level;
 
         float amp = 1.0;
 
+        float* ampBuf = NULL;
+        float* gainBuf = NULL;
+
     };
 }
\ No newline at end of file
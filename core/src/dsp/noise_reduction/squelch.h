@@ -8,7 +8,7 @@ namespace dsp::noise_reduction {
     public:
         Squelch() {}
 
-        Squelch(stream<complex_t>* in, double level) {}
+        Squelch(stream<complex_t>* in, double level) { init(in, level); }
 
         ~Squelch() {
             if (!base_type::_block_init) { return; }
@@ -57,7 +57,13 @@ namespace dsp::noise_reduction {
             return count;
         }
 
+        bool fusable() { return true; }
+
     private:
+        int fusedProcess(int count, const complex_t* in, complex_t* out) {
+            return process(count, in, out);
+        }
+
         float* normBuffer;
         float _level = -50.0f;
                 
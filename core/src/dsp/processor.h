@@ -66,9 +66,19 @@ namespace dsp {
 
         virtual int run() = 0;
 
+        // Whether the block can be run from a fused chain's thread using processFused()
+        virtual bool fusable() { return false; }
+
+        int processFused(int count, const I* in, O* out) {
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            return fusedProcess(count, in, out);
+        }
+
         stream<O> out;
 
     protected:
+        virtual int fusedProcess(int count, const I* in, O* out) { return 0; }
+
         stream<I>* _in;
     };
 }
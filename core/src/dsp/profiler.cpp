@@ -0,0 +1,109 @@
+#include "profiler.h"
+#include <mutex>
+#include <algorithm>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <stdlib.h>
+#endif
+
+namespace dsp::profiler {
+    struct Snapshot {
+        uint64_t time, runs, samples, busyTime, readWaitTime, swapWaitTime, occupancy, occupancySamples;
+    };
+
+    std::atomic<bool> _enabled = false;
+    thread_local BlockStats* current = NULL;
+
+    std::mutex registryMtx;
+    std::vector<std::shared_ptr<BlockStats>> registry;
+    std::vector<std::pair<uint64_t, Snapshot>> lastSnapshots;
+    uint64_t nextId = 0;
+
+    bool isEnabled() {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) {
+        _enabled = enabled;
+    }
+
+    BlockStats* getCurrent() {
+        return current;
+    }
+
+    void setCurrent(BlockStats* stats) {
+        current = stats;
+    }
+
+    std::shared_ptr<BlockStats> registerBlock(const std::string& name) {
+        auto stats = std::make_shared<BlockStats>();
+        std::lock_guard<std::mutex> lck(registryMtx);
+        stats->id = nextId++;
+        stats->name = name;
+        registry.push_back(stats);
+        return stats;
+    }
+
+    void renameBlock(BlockStats* stats, const std::string& name) {
+        std::lock_guard<std::mutex> lck(registryMtx);
+        stats->name = name;
+    }
+
+    std::vector<BlockReport> report() {
+        std::lock_guard<std::mutex> lck(registryMtx);
+        registry.erase(std::remove_if(registry.begin(), registry.end(), [](auto& s) { return !s->alive; }), registry.end());
+
+        uint64_t time = now();
+        std::vector<BlockReport> reports;
+        std::vector<std::pair<uint64_t, Snapshot>> snaps;
+        for (auto& stats : registry) {
+            Snapshot snap = {
+                time,
+                stats->runs.load(),
+                stats->samples.load(),
+                stats->busyTime.load(),
+                stats->readWaitTime.load(),
+                stats->swapWaitTime.load(),
+                stats->occupancy.load(),
+                stats->occupancySamples.load()
+            };
+            snaps.push_back({ stats->id, snap });
+
+            // Blocks seen for the first time are reported from the next call on
+            auto it = std::find_if(lastSnapshots.begin(), lastSnapshots.end(), [&](auto& l) { return l.first == stats->id; });
+            if (it == lastSnapshots.end()) { continue; }
+            Snapshot& prev = it->second;
+            double elapsed = (double)(time - prev.time) * 1e-9;
+            if (elapsed <= 0.0) { continue; }
+
+            BlockReport rep;
+            uint64_t runs = snap.runs - prev.runs;
+            uint64_t occSamples = snap.occupancySamples - prev.occupancySamples;
+            double busy = (double)(snap.busyTime - prev.busyTime) * 1e-9;
+            rep.name = stats->name;
+            rep.sampleRate = (double)(snap.samples - prev.samples) / elapsed;
+            rep.runTime = runs ? (busy / (double)runs) : 0.0;
+            rep.load = busy / elapsed;
+            rep.readWait = ((double)(snap.readWaitTime - prev.readWaitTime) * 1e-9) / elapsed;
+            rep.swapWait = ((double)(snap.swapWaitTime - prev.swapWaitTime) * 1e-9) / elapsed;
+            rep.occupancy = occSamples ? ((double)(snap.occupancy - prev.occupancy) / (double)occSamples) / 100.0 : 0.0;
+            reports.push_back(rep);
+        }
+        lastSnapshots = std::move(snaps);
+
+        return reports;
+    }
+
+    std::string typeName(const std::type_info& type) {
+#ifdef __GNUG__
+        int status;
+        char* demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+        if (status == 0 && demangled) {
+            std::string name = demangled;
+            free(demangled);
+            return name;
+        }
+#endif
+        return type.name();
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace dsp::profiler {
+    // Counters of a single block, only updated while profiling is enabled. Times are in nanoseconds.
+    struct BlockStats {
+        uint64_t id;
+        std::string name;
+        std::atomic<bool> alive = true;
+
+        std::atomic<uint64_t> runs = 0;
+        std::atomic<uint64_t> samples = 0;
+        std::atomic<uint64_t> busyTime = 0;         // Time spent in run() minus the time blocked in streams
+        std::atomic<uint64_t> readWaitTime = 0;     // Time blocked waiting for input data
+        std::atomic<uint64_t> swapWaitTime = 0;     // Time blocked waiting for the reader of an output
+        std::atomic<uint64_t> occupancy = 0;        // Sum of the input occupancy in percent, sampled once per run
+        std::atomic<uint64_t> occupancySamples = 0;
+    };
+
+    // Rates computed from the counters of a block between two reports
+    struct BlockReport {
+        std::string name;
+        double sampleRate;      // Samples per second
+        double runTime;         // Average busy time of a call to run() in seconds
+        double load;            // Fraction of the time spent busy, the CPU use of the worker thread
+        double readWait;        // Fraction of the time blocked waiting for input
+        double swapWait;        // Fraction of the time blocked waiting for the output to be read
+        double occupancy;       // Average fill of the input streams between 0 and 1
+    };
+
+    enum WaitType {
+        WAIT_READ,
+        WAIT_SWAP
+    };
+
+    // Checked by the worker loop before every call to run()
+    bool isEnabled();
+    void setEnabled(bool enabled);
+
+    // Stats of the block running on the calling thread, NULL when not profiling
+    BlockStats* getCurrent();
+    void setCurrent(BlockStats* stats);
+
+    // Create the stats of a block, they are dropped from the reports once alive is cleared
+    std::shared_ptr<BlockStats> registerBlock(const std::string& name);
+    void renameBlock(BlockStats* stats, const std::string& name);
+
+    // Compute the rates of every block since the last call
+    std::vector<BlockReport> report();
+
+    std::string typeName(const std::type_info& type);
+
+    inline uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Adds the time spent blocked in a stream to the stats of the running block, if any.
+    // Streams only create one when they actually have to wait, so this costs nothing otherwise.
+    class WaitScope {
+    public:
+        WaitScope(WaitType type) {
+            stats = getCurrent();
+            if (!stats) { return; }
+            _type = type;
+            start = now();
+        }
+
+        ~WaitScope() {
+            if (!stats) { return; }
+            uint64_t elapsed = now() - start;
+            if (_type == WAIT_READ) {
+                stats->readWaitTime.fetch_add(elapsed, std::memory_order_relaxed);
+            }
+            else {
+                stats->swapWaitTime.fetch_add(elapsed, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        BlockStats* stats;
+        WaitType _type;
+        uint64_t start;
+    };
+
+
+    // Call run with stats as those of the current thread and add the time it took to them. The time blocked
+    // in streams is counted by them and subtracted from the busy time.
+    template <class Func>
+    inline int timedRun(BlockStats* stats, Func run) {
+        uint64_t waitStart = stats->readWaitTime.load(std::memory_order_relaxed) + stats->swapWaitTime.load(std::memory_order_relaxed);
+        setCurrent(stats);
+        uint64_t start = now();
+        int count = run();
+        uint64_t elapsed = now() - start;
+        setCurrent(NULL);
+        uint64_t waited = stats->readWaitTime.load(std::memory_order_relaxed) + stats->swapWaitTime.load(std::memory_order_relaxed) - waitStart;
+
+        stats->busyTime.fetch_add((elapsed > waited) ? (elapsed - waited) : 0, std::memory_order_relaxed);
+        if (count >= 0) {
+            stats->runs.fetch_add(1, std::memory_order_relaxed);
+            stats->samples.fetch_add(count, std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    // Add a sample of the input occupancy, in percent
+    inline void addOccupancy(BlockStats* stats, int percent) {
+        stats->occupancy.fetch_add(percent, std::memory_order_relaxed);
+        stats->occupancySamples.fetch_add(1, std::memory_order_relaxed);
+    }
+}
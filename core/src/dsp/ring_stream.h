@@ -0,0 +1,199 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "stream.h"
+
+namespace dsp {
+    // Drop-in replacement for stream<T> backed by a single-producer/single-consumer ring of buffers.
+    // The writer only blocks once every slot is in flight, the hand-off itself is lock-free.
+    // With two slots, the behavior is identical to stream<T>.
+    template <class T>
+    class ring_stream : public stream<T> {
+        using base_type = stream<T>;
+    public:
+        ring_stream(int slotCount = 4) {
+            // Reuse the buffers already allocated by stream<T> as the first two slots
+            slotCount = std::max<int>(slotCount, 2);
+            slots.push_back(base_type::writeBuf);
+            slots.push_back(base_type::readBuf);
+            for (int i = 2; i < slotCount; i++) {
+                slots.push_back(buffer::alloc<T>(STREAM_BUFFER_SIZE));
+            }
+            sizes.resize(slotCount);
+            bufferSize = STREAM_BUFFER_SIZE;
+            base_type::writeBuf = slots[0];
+            base_type::readBuf = slots[1];
+        }
+
+        ~ring_stream() {
+            freeSlots();
+        }
+
+        void setBufferSize(int samples) {
+            for (auto& slot : slots) {
+                buffer::free(slot);
+                slot = buffer::alloc<T>(samples);
+            }
+            bufferSize = samples;
+            base_type::writeBuf = slots[writeIdx % slots.size()];
+            base_type::readBuf = slots[(writeIdx + 1) % slots.size()];
+        }
+
+        // NOTE: Must only be called while neither the reader nor the writer is running
+        void setSlotCount(int slotCount) {
+            slotCount = std::max<int>(slotCount, 2);
+            for (int i = slotCount; i < slots.size(); i++) {
+                buffer::free(slots[i]);
+            }
+            for (int i = slots.size(); i < slotCount; i++) {
+                slots.push_back(buffer::alloc<T>(bufferSize));
+            }
+            slots.resize(slotCount);
+            sizes.resize(slotCount);
+            writeIdx = 0;
+            readIdx = 0;
+            reading = false;
+            base_type::writeBuf = slots[0];
+            base_type::readBuf = slots[1];
+        }
+
+        inline int getSlotCount() { return slots.size(); }
+
+        // Number of buffers written but not yet flushed by the reader
+        inline int getOccupancy() { return writeIdx.load() - readIdx.load(); }
+
+        inline int getCapacity() { return slots.size() - 1; }
+
+        inline bool swap(int size) {
+            // Wait for the next slot to be released by the reader
+            uint64_t widx = writeIdx.load(std::memory_order_relaxed);
+            if (!canWrite(widx)) {
+                std::unique_lock<std::mutex> lck(writeMtx);
+                profiler::WaitScope wait(profiler::WAIT_SWAP);
+                writerWaiting = true;
+                writeCV.wait(lck, [=] { return canWrite(widx) || writerStop; });
+                writerWaiting = false;
+            }
+
+            // If writer was stopped, abandon operation
+            if (writerStop) { return false; }
+
+            // Publish the current slot and move on to the next one
+            sizes[widx % slots.size()] = size;
+            writeIdx.store(widx + 1);
+            base_type::writeBuf = slots[(widx + 1) % slots.size()];
+
+            // Wake up the reader if it's waiting for data
+            if (readerWaiting) {
+                { std::lock_guard<std::mutex> lck(readMtx); }
+                readCV.notify_all();
+            }
+
+            return true;
+        }
+
+        // Shared buffers can't take the place of a slot, copy instead
+        inline bool swap(buffer::SharedBuffer<T>* buf, int size) {
+            memcpy(base_type::writeBuf, buf->data, size * sizeof(T));
+            if (!swap(size)) { return false; }
+            buf->release();
+            return true;
+        }
+
+        inline int read() {
+            // Wait for a slot to be published or to be stopped
+            uint64_t ridx = readIdx.load(std::memory_order_relaxed);
+            if (!canRead(ridx)) {
+                std::unique_lock<std::mutex> lck(readMtx);
+                profiler::WaitScope wait(profiler::WAIT_READ);
+                readerWaiting = true;
+                readCV.wait(lck, [=] { return canRead(ridx) || readerStop; });
+                readerWaiting = false;
+            }
+
+            if (readerStop) { return -1; }
+
+            base_type::readBuf = slots[ridx % slots.size()];
+            reading = true;
+            return sizes[ridx % slots.size()];
+        }
+
+        inline void flush() {
+            // Some blocks flush after a failed read, only release a slot that was actually read
+            if (!reading) { return; }
+            reading = false;
+
+            // Release the slot
+            readIdx.store(readIdx.load(std::memory_order_relaxed) + 1);
+
+            // Wake up the writer if it's waiting for a free slot
+            if (writerWaiting) {
+                { std::lock_guard<std::mutex> lck(writeMtx); }
+                writeCV.notify_all();
+            }
+        }
+
+        void stopWriter() {
+            {
+                std::lock_guard<std::mutex> lck(writeMtx);
+                writerStop = true;
+            }
+            writeCV.notify_all();
+        }
+
+        void clearWriteStop() {
+            writerStop = false;
+        }
+
+        void stopReader() {
+            {
+                std::lock_guard<std::mutex> lck(readMtx);
+                readerStop = true;
+            }
+            readCV.notify_all();
+        }
+
+        void clearReadStop() {
+            readerStop = false;
+        }
+
+    private:
+        // The slot held by the writer must never be one that the reader can see
+        inline bool canWrite(uint64_t widx) {
+            return (widx + 1) - readIdx.load() < slots.size();
+        }
+
+        inline bool canRead(uint64_t ridx) {
+            return writeIdx.load() > ridx;
+        }
+
+        void freeSlots() {
+            for (auto& slot : slots) {
+                buffer::free(slot);
+            }
+            slots.clear();
+
+            // Prevent stream<T> from freeing the slots a second time
+            base_type::writeBuf = NULL;
+            base_type::readBuf = NULL;
+        }
+
+        std::vector<T*> slots;
+        std::vector<int> sizes;
+        int bufferSize;
+
+        std::atomic<uint64_t> writeIdx = 0;
+        std::atomic<uint64_t> readIdx = 0;
+        bool reading = false;
+
+        std::mutex writeMtx;
+        std::condition_variable writeCV;
+        std::atomic<bool> writerWaiting = false;
+        std::atomic<bool> writerStop = false;
+
+        std::mutex readMtx;
+        std::condition_variable readCV;
+        std::atomic<bool> readerWaiting = false;
+        std::atomic<bool> readerStop = false;
+    };
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "../sink.h"
+#include "../buffer/shared_buffer.h"
 
 namespace dsp::routing {
     template <class T>
@@ -8,7 +9,12 @@ namespace dsp::routing {
     public:
         Splitter() {}
 
-        Splitter(stream<T>* in) { base_type::init(in); }
+        Splitter(stream<T>* in) { init(in); }
+
+        void init(stream<T>* in) {
+            pool.init(STREAM_BUFFER_SIZE);
+            base_type::init(in);
+        }
 
         void bindStream(stream<T>* stream) {
             assert(base_type::_block_init);
@@ -47,21 +53,29 @@ namespace dsp::routing {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
+            // Copy the input once to a shared buffer, all outputs reference it instead of getting their own copy
+            buffer::SharedBuffer<T>* buf = pool.get();
+            memcpy(buf->data, base_type::_in->readBuf, count * sizeof(T));
+            base_type::_in->flush();
+
+            // Hold a reference while handing it out so that it can't be recycled too early
+            buf->acquire();
             for (const auto& stream : streams) {
-                memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
-                if (!stream->swap(count)) {
-                    base_type::_in->flush();
+                buf->acquire();
+                if (!stream->swap(buf, count)) {
+                    buf->release();
+                    buf->release();
                     return -1;
                 }
             }
-
-            base_type::_in->flush();
+            buf->release();
 
             return count;
         }
 
     protected:
         std::vector<stream<T>*> streams;
+        buffer::SharedBufferPool<T> pool;
 
     };
 }
\ No newline at end of file
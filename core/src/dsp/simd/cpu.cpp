@@ -0,0 +1,144 @@
+#include "cpu.h"
+#include <stdint.h>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace dsp::simd {
+    struct Features {
+        bool sse41 = false;
+        bool avx = false;
+        bool fma = false;
+        bool avx2 = false;
+        bool avx512f = false;
+        bool avx512dq = false;
+        bool avx512bw = false;
+        bool avx512vl = false;
+        bool neon = false;
+    };
+
+#ifdef SIMD_X86
+    static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; i++) { regs[i] = r[i]; }
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    // Register state the OS saves on context switches, only valid if OSXSAVE is set
+    static uint64_t xgetbv() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64_t)edx << 32) | eax;
+#endif
+    }
+#endif
+
+    static Features detect() {
+        Features f;
+#ifdef SIMD_X86
+        uint32_t regs[4];
+        cpuid(0, 0, regs);
+        uint32_t maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        uint32_t ecx1 = regs[2];
+        f.sse41 = (ecx1 >> 19) & 1;
+        f.fma = (ecx1 >> 12) & 1;
+
+        // The AVX registers are only usable if the OS saves them, XMM and YMM for AVX, opmask and ZMM for AVX-512
+        bool osxsave = (ecx1 >> 27) & 1;
+        uint64_t xcr0 = osxsave ? xgetbv() : 0;
+        bool osAVX = (xcr0 & 0x06) == 0x06;
+        bool osAVX512 = (xcr0 & 0xE6) == 0xE6;
+        f.avx = osAVX && ((ecx1 >> 28) & 1);
+        f.fma = f.fma && osAVX;
+
+        if (maxLeaf >= 7) {
+            cpuid(7, 0, regs);
+            uint32_t ebx7 = regs[1];
+            f.avx2 = osAVX && ((ebx7 >> 5) & 1);
+            f.avx512f = osAVX512 && ((ebx7 >> 16) & 1);
+            f.avx512dq = osAVX512 && ((ebx7 >> 17) & 1);
+            f.avx512bw = osAVX512 && ((ebx7 >> 30) & 1);
+            f.avx512vl = osAVX512 && ((ebx7 >> 31) & 1);
+        }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+        // Always there on 64bit ARM
+        f.neon = true;
+#elif defined(__arm__) && defined(__linux__)
+        f.neon = getauxval(AT_HWCAP) & HWCAP_NEON;
+#elif defined(__ARM_NEON)
+        f.neon = true;
+#endif
+        return f;
+    }
+
+    static const Features& features() {
+        static Features f = detect();
+        return f;
+    }
+
+    const char* archName(Arch arch) {
+        switch (arch) {
+        case ARCH_GENERIC:  return "generic";
+        case ARCH_SSE4:     return "sse4";
+        case ARCH_AVX2:     return "avx2";
+        case ARCH_AVX512:   return "avx512";
+        case ARCH_NEON:     return "neon";
+        default:            return "unknown";
+        }
+    }
+
+    bool cpuSupports(Arch arch) {
+        const Features& f = features();
+        switch (arch) {
+        case ARCH_GENERIC:  return true;
+        case ARCH_SSE4:     return f.sse41;
+        case ARCH_AVX2:     return f.sse41 && f.avx && f.avx2 && f.fma;
+        case ARCH_AVX512:   return cpuSupports(ARCH_AVX2) && f.avx512f && f.avx512dq && f.avx512bw && f.avx512vl;
+        case ARCH_NEON:     return f.neon;
+        default:            return false;
+        }
+    }
+
+    std::string cpuFeatures() {
+        const Features& f = features();
+        const std::pair<const char*, bool> list[] = {
+            { "sse4.1", f.sse41 },
+            { "avx", f.avx },
+            { "fma", f.fma },
+            { "avx2", f.avx2 },
+            { "avx512f", f.avx512f },
+            { "avx512dq", f.avx512dq },
+            { "avx512bw", f.avx512bw },
+            { "avx512vl", f.avx512vl },
+            { "neon", f.neon }
+        };
+        std::string str;
+        for (const auto& [name, present] : list) {
+            if (!present) { continue; }
+            if (!str.empty()) { str += ' '; }
+            str += name;
+        }
+        return str.empty() ? "none" : str;
+    }
+}
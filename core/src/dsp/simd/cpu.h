@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+
+namespace dsp::simd {
+    // Instruction sets the kernels are built for. The x86 ones include those before them.
+    enum Arch {
+        ARCH_GENERIC,
+        ARCH_SSE4,
+        ARCH_AVX2,
+        ARCH_AVX512,
+        ARCH_NEON,
+        _ARCH_COUNT
+    };
+
+    const char* archName(Arch arch);
+
+    // True if both the CPU and the OS support the instruction set
+    bool cpuSupports(Arch arch);
+
+    // Features found on the CPU, for diagnostics
+    std::string cpuFeatures();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// NOTE: This header is included by the kernel files built for other instruction sets than the rest of SDR++. It must
+// stay free of anything that could emit shared code (inline functions, templates, globals with initializers), the
+// linker could otherwise keep a copy built for an instruction set the CPU doesn't have.
+
+namespace dsp::simd {
+    // Primitives with an implementation for each instruction set, see simd.h
+    struct Kernels {
+        // Largest value, -INFINITY for no values. NaNs are skipped.
+        float (*max_32f)(const float* in, int count);
+
+        // Largest absolute value, 0 for no values. NaNs are skipped.
+        float (*absMax_32f)(const float* in, int count);
+
+        // out[i] = in[i] > 0
+        void (*slice_32f_8u)(const float* in, uint8_t* out, int count);
+
+        // out[i] = (in[i] - offset) * scale
+        void (*u8ToF32)(const uint8_t* in, float* out, int count, float offset, float scale);
+        void (*s8ToF32)(const int8_t* in, float* out, int count, float offset, float scale);
+
+        // out[i] = (in[2i] + in[2i + 1]) / 2 for count output values
+        void (*stereoToMono)(const float* in, float* out, int count);
+
+        // Split count 16bit values into a plane of their low bytes followed by one of their high bytes, and back
+        void (*shuffle16)(const uint8_t* in, uint8_t* out, int count);
+        void (*unshuffle16)(const uint8_t* in, uint8_t* out, int count);
+    };
+
+    // Replace the kernels of k by those built for the instruction set. Return false if SDR++ was built without it.
+    bool fillSSE4(Kernels& k);
+    bool fillAVX2(Kernels& k);
+    bool fillAVX512(Kernels& k);
+    bool fillNEON(Kernels& k);
+}
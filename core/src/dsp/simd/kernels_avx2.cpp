@@ -0,0 +1,86 @@
+#include "kernels.h"
+
+// Built with AVX2 and FMA enabled, see core/CMakeLists.txt
+#ifdef __AVX2__
+#include <immintrin.h>
+#include "kernels_impl.h"
+
+namespace dsp::simd {
+    namespace avx2 {
+        static inline float hmax(__m256 v) {
+            __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+            m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+            return _mm_cvtss_f32(m);
+        }
+
+        // maxps returns its second operand when one is NaN, the accumulators are always given second to skip them.
+        // Two accumulators hide the latency of maxps on long inputs.
+        static float max_32f(const float* in, int count) {
+            __m256 m0 = _mm256_set1_ps(-INFINITY);
+            __m256 m1 = m0;
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                m0 = _mm256_max_ps(_mm256_loadu_ps(&in[i]), m0);
+                m1 = _mm256_max_ps(_mm256_loadu_ps(&in[i + 8]), m1);
+            }
+            for (; i + 8 <= count; i += 8) { m0 = _mm256_max_ps(_mm256_loadu_ps(&in[i]), m0); }
+            float maxVal = hmax(_mm256_max_ps(m0, m1));
+            for (; i < count; i++) { maxVal = (in[i] > maxVal) ? in[i] : maxVal; }
+            return maxVal;
+        }
+
+        static float absMax_32f(const float* in, int count) {
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+            __m256 m0 = _mm256_setzero_ps();
+            __m256 m1 = m0;
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                m0 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i]), absMask), m0);
+                m1 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i + 8]), absMask), m1);
+            }
+            for (; i + 8 <= count; i += 8) { m0 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i]), absMask), m0); }
+            float maxVal = hmax(_mm256_max_ps(m0, m1));
+            for (; i < count; i++) {
+                float val = fabsf(in[i]);
+                maxVal = (val > maxVal) ? val : maxVal;
+            }
+            return maxVal;
+        }
+
+        // The comparison masks (-1 or 0) are narrowed with saturation down to bytes. The packs work within each
+        // 128bit lane, a permutation puts the groups of four back in order before masking to 1 or 0.
+        static void slice_32f_8u(const float* in, uint8_t* out, int count) {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256i one = _mm256_set1_epi8(1);
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            int i = 0;
+            for (; i + 32 <= count; i += 32) {
+                __m256i a = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(&in[i]), zero, _CMP_GT_OQ));
+                __m256i b = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(&in[i + 8]), zero, _CMP_GT_OQ));
+                __m256i c = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(&in[i + 16]), zero, _CMP_GT_OQ));
+                __m256i d = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(&in[i + 24]), zero, _CMP_GT_OQ));
+                __m256i bytes = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+                bytes = _mm256_permutevar8x32_epi32(bytes, order);
+                _mm256_storeu_si256((__m256i*)&out[i], _mm256_and_si256(bytes, one));
+            }
+            for (; i < count; i++) { out[i] = in[i] > 0.0f; }
+        }
+    }
+
+    bool fillAVX2(Kernels& k) {
+        impl::fill(k);
+        k.max_32f = avx2::max_32f;
+        k.absMax_32f = avx2::absMax_32f;
+        k.slice_32f_8u = avx2::slice_32f_8u;
+        return true;
+    }
+}
+
+#else
+
+namespace dsp::simd {
+    bool fillAVX2(Kernels& k) { return false; }
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "kernels.h"
+
+// Built with AVX-512 F, DQ, BW and VL enabled, see core/CMakeLists.txt
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#include "kernels_impl.h"
+
+namespace dsp::simd {
+    namespace avx512 {
+        // Mask of the first count lanes of a vector of 16 floats, for the tails
+        static inline __mmask16 tailMask(int count) {
+            return (__mmask16)((1u << count) - 1);
+        }
+
+        // maxps returns its second operand when one is NaN, the accumulators are always given second to skip them.
+        // The tail is loaded with the lanes past the end set to -INFINITY so that it doesn't need a scalar loop.
+        static float max_32f(const float* in, int count) {
+            const __m512 minusInf = _mm512_set1_ps(-INFINITY);
+            __m512 m0 = minusInf;
+            __m512 m1 = minusInf;
+            int i = 0;
+            for (; i + 32 <= count; i += 32) {
+                m0 = _mm512_max_ps(_mm512_loadu_ps(&in[i]), m0);
+                m1 = _mm512_max_ps(_mm512_loadu_ps(&in[i + 16]), m1);
+            }
+            for (; i + 16 <= count; i += 16) { m0 = _mm512_max_ps(_mm512_loadu_ps(&in[i]), m0); }
+            if (i < count) { m1 = _mm512_max_ps(_mm512_mask_loadu_ps(minusInf, tailMask(count - i), &in[i]), m1); }
+            return _mm512_reduce_max_ps(_mm512_max_ps(m0, m1));
+        }
+
+        static float absMax_32f(const float* in, int count) {
+            __m512 m0 = _mm512_setzero_ps();
+            __m512 m1 = m0;
+            int i = 0;
+            for (; i + 32 <= count; i += 32) {
+                m0 = _mm512_max_ps(_mm512_abs_ps(_mm512_loadu_ps(&in[i])), m0);
+                m1 = _mm512_max_ps(_mm512_abs_ps(_mm512_loadu_ps(&in[i + 16])), m1);
+            }
+            for (; i + 16 <= count; i += 16) { m0 = _mm512_max_ps(_mm512_abs_ps(_mm512_loadu_ps(&in[i])), m0); }
+            if (i < count) { m1 = _mm512_max_ps(_mm512_abs_ps(_mm512_maskz_loadu_ps(tailMask(count - i), &in[i])), m1); }
+            return _mm512_reduce_max_ps(_mm512_max_ps(m0, m1));
+        }
+
+        // The comparison gives a bit mask directly, which selects between bytes of 1 and 0
+        static void slice_32f_8u(const float* in, uint8_t* out, int count) {
+            const __m512 zero = _mm512_setzero_ps();
+            const __m128i one = _mm_set1_epi8(1);
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __mmask16 gt = _mm512_cmp_ps_mask(_mm512_loadu_ps(&in[i]), zero, _CMP_GT_OQ);
+                _mm_storeu_si128((__m128i*)&out[i], _mm_maskz_mov_epi8(gt, one));
+            }
+            if (i < count) {
+                __mmask16 tail = tailMask(count - i);
+                __mmask16 gt = _mm512_mask_cmp_ps_mask(tail, _mm512_maskz_loadu_ps(tail, &in[i]), zero, _CMP_GT_OQ);
+                _mm_mask_storeu_epi8(&out[i], tail, _mm_maskz_mov_epi8(gt, one));
+            }
+        }
+    }
+
+    bool fillAVX512(Kernels& k) {
+        impl::fill(k);
+        k.max_32f = avx512::max_32f;
+        k.absMax_32f = avx512::absMax_32f;
+        k.slice_32f_8u = avx512::slice_32f_8u;
+        return true;
+    }
+}
+
+#else
+
+namespace dsp::simd {
+    bool fillAVX512(Kernels& k) { return false; }
+}
+
+#endif
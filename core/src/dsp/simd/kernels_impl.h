@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include "kernels.h"
+
+// Plain implementations of the kernels. They are built once as the generic kernels and again in the file of each
+// instruction set, where the compiler vectorizes them for it. The functions are static so that every file keeps its
+// own copy, see the note in kernels.h.
+
+namespace dsp::simd::impl {
+    static inline float max_32f(const float* in, int count) {
+        float maxVal = -INFINITY;
+        for (int i = 0; i < count; i++) { maxVal = (in[i] > maxVal) ? in[i] : maxVal; }
+        return maxVal;
+    }
+
+    static inline float absMax_32f(const float* in, int count) {
+        float maxVal = 0.0f;
+        for (int i = 0; i < count; i++) {
+            float val = fabsf(in[i]);
+            maxVal = (val > maxVal) ? val : maxVal;
+        }
+        return maxVal;
+    }
+
+    static inline void slice_32f_8u(const float* in, uint8_t* out, int count) {
+        for (int i = 0; i < count; i++) { out[i] = in[i] > 0.0f; }
+    }
+
+    static inline void u8ToF32(const uint8_t* in, float* out, int count, float offset, float scale) {
+        for (int i = 0; i < count; i++) { out[i] = ((float)in[i] - offset) * scale; }
+    }
+
+    static inline void s8ToF32(const int8_t* in, float* out, int count, float offset, float scale) {
+        for (int i = 0; i < count; i++) { out[i] = ((float)in[i] - offset) * scale; }
+    }
+
+    static inline void stereoToMono(const float* in, float* out, int count) {
+        for (int i = 0; i < count; i++) { out[i] = (in[i * 2] + in[(i * 2) + 1]) / 2.0f; }
+    }
+
+    static inline void shuffle16(const uint8_t* in, uint8_t* out, int count) {
+        uint8_t* lo = out;
+        uint8_t* hi = &out[count];
+        for (int i = 0; i < count; i++) {
+            lo[i] = in[i * 2];
+            hi[i] = in[(i * 2) + 1];
+        }
+    }
+
+    static inline void unshuffle16(const uint8_t* in, uint8_t* out, int count) {
+        const uint8_t* lo = in;
+        const uint8_t* hi = &in[count];
+        for (int i = 0; i < count; i++) {
+            out[i * 2] = lo[i];
+            out[(i * 2) + 1] = hi[i];
+        }
+    }
+
+    // Set every kernel of k to the ones above
+    static inline void fill(Kernels& k) {
+        k.max_32f = max_32f;
+        k.absMax_32f = absMax_32f;
+        k.slice_32f_8u = slice_32f_8u;
+        k.u8ToF32 = u8ToF32;
+        k.s8ToF32 = s8ToF32;
+        k.stereoToMono = stereoToMono;
+        k.shuffle16 = shuffle16;
+        k.unshuffle16 = unshuffle16;
+    }
+}
@@ -0,0 +1,73 @@
+#include "kernels.h"
+
+// Always available on 64bit ARM, built with -mfpu=neon on 32bit ARM, see core/CMakeLists.txt
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#include "kernels_impl.h"
+
+namespace dsp::simd {
+    namespace neon {
+        static inline float hmax(float32x4_t v) {
+            float32x2_t m = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+            m = vpmax_f32(m, m);
+            return vget_lane_f32(m, 0);
+        }
+
+        // vmaxq returns NaN when either operand is, a comparison and select skips them like the generic kernel does
+        static float max_32f(const float* in, int count) {
+            float32x4_t m = vdupq_n_f32(-INFINITY);
+            int i = 0;
+            for (; i + 4 <= count; i += 4) {
+                float32x4_t x = vld1q_f32(&in[i]);
+                m = vbslq_f32(vcgtq_f32(x, m), x, m);
+            }
+            float maxVal = hmax(m);
+            for (; i < count; i++) { maxVal = (in[i] > maxVal) ? in[i] : maxVal; }
+            return maxVal;
+        }
+
+        static float absMax_32f(const float* in, int count) {
+            float32x4_t m = vdupq_n_f32(0.0f);
+            int i = 0;
+            for (; i + 4 <= count; i += 4) {
+                float32x4_t x = vabsq_f32(vld1q_f32(&in[i]));
+                m = vbslq_f32(vcgtq_f32(x, m), x, m);
+            }
+            float maxVal = hmax(m);
+            for (; i < count; i++) {
+                float val = fabsf(in[i]);
+                maxVal = (val > maxVal) ? val : maxVal;
+            }
+            return maxVal;
+        }
+
+        // The comparison masks are narrowed down to bytes, then masked to 1 or 0
+        static void slice_32f_8u(const float* in, uint8_t* out, int count) {
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            const uint8x8_t one = vdup_n_u8(1);
+            int i = 0;
+            for (; i + 8 <= count; i += 8) {
+                uint16x4_t a = vmovn_u32(vcgtq_f32(vld1q_f32(&in[i]), zero));
+                uint16x4_t b = vmovn_u32(vcgtq_f32(vld1q_f32(&in[i + 4]), zero));
+                vst1_u8(&out[i], vand_u8(vmovn_u16(vcombine_u16(a, b)), one));
+            }
+            for (; i < count; i++) { out[i] = in[i] > 0.0f; }
+        }
+    }
+
+    bool fillNEON(Kernels& k) {
+        impl::fill(k);
+        k.max_32f = neon::max_32f;
+        k.absMax_32f = neon::absMax_32f;
+        k.slice_32f_8u = neon::slice_32f_8u;
+        return true;
+    }
+}
+
+#else
+
+namespace dsp::simd {
+    bool fillNEON(Kernels& k) { return false; }
+}
+
+#endif
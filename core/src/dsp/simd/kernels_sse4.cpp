@@ -0,0 +1,71 @@
+#include "kernels.h"
+
+// Built with SSE4.1 enabled, see core/CMakeLists.txt. MSVC allows the intrinsics without any flag.
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <smmintrin.h>
+#include "kernels_impl.h"
+
+namespace dsp::simd {
+    namespace sse4 {
+        static inline float hmax(__m128 v) {
+            v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+            return _mm_cvtss_f32(v);
+        }
+
+        // maxps returns its second operand when one is NaN, the accumulator is always given second to skip them
+        static float max_32f(const float* in, int count) {
+            __m128 m = _mm_set1_ps(-INFINITY);
+            int i = 0;
+            for (; i + 4 <= count; i += 4) { m = _mm_max_ps(_mm_loadu_ps(&in[i]), m); }
+            float maxVal = hmax(m);
+            for (; i < count; i++) { maxVal = (in[i] > maxVal) ? in[i] : maxVal; }
+            return maxVal;
+        }
+
+        static float absMax_32f(const float* in, int count) {
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+            __m128 m = _mm_setzero_ps();
+            int i = 0;
+            for (; i + 4 <= count; i += 4) { m = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(&in[i]), absMask), m); }
+            float maxVal = hmax(m);
+            for (; i < count; i++) {
+                float val = fabsf(in[i]);
+                maxVal = (val > maxVal) ? val : maxVal;
+            }
+            return maxVal;
+        }
+
+        // The comparison masks (-1 or 0) are narrowed with saturation down to bytes, then masked to 1 or 0
+        static void slice_32f_8u(const float* in, uint8_t* out, int count) {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128i one = _mm_set1_epi8(1);
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128i a = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(&in[i]), zero));
+                __m128i b = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(&in[i + 4]), zero));
+                __m128i c = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(&in[i + 8]), zero));
+                __m128i d = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(&in[i + 12]), zero));
+                __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                _mm_storeu_si128((__m128i*)&out[i], _mm_and_si128(bytes, one));
+            }
+            for (; i < count; i++) { out[i] = in[i] > 0.0f; }
+        }
+    }
+
+    bool fillSSE4(Kernels& k) {
+        impl::fill(k);
+        k.max_32f = sse4::max_32f;
+        k.absMax_32f = sse4::absMax_32f;
+        k.slice_32f_8u = sse4::slice_32f_8u;
+        return true;
+    }
+}
+
+#else
+
+namespace dsp::simd {
+    bool fillSSE4(Kernels& k) { return false; }
+}
+
+#endif
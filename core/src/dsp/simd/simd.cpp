@@ -0,0 +1,103 @@
+#include "simd.h"
+#include "kernels_impl.h"
+#include <volk/volk.h>
+#include <stdio.h>
+
+namespace dsp::simd {
+    static constexpr Kernels genericKernels = {
+        impl::max_32f,
+        impl::absMax_32f,
+        impl::slice_32f_8u,
+        impl::u8ToF32,
+        impl::s8ToF32,
+        impl::stereoToMono,
+        impl::shuffle16,
+        impl::unshuffle16
+    };
+
+    // Constant initialized so that the generic kernels can be called before the selection
+    static Kernels current = genericKernels;
+
+    const Kernels& selectedKernels() {
+        return current;
+    }
+
+    struct Tables {
+        Kernels kernels[_ARCH_COUNT];
+        bool built[_ARCH_COUNT];
+    };
+
+    static Tables buildTables() {
+        Tables t;
+        t.kernels[ARCH_GENERIC] = genericKernels;
+        t.built[ARCH_GENERIC] = true;
+
+        // Each x86 set builds on top of the ones before it
+        Kernels x86 = genericKernels;
+        t.built[ARCH_SSE4] = fillSSE4(x86);
+        t.kernels[ARCH_SSE4] = x86;
+        t.built[ARCH_AVX2] = fillAVX2(x86);
+        t.kernels[ARCH_AVX2] = x86;
+        t.built[ARCH_AVX512] = fillAVX512(x86);
+        t.kernels[ARCH_AVX512] = x86;
+
+        t.kernels[ARCH_NEON] = genericKernels;
+        t.built[ARCH_NEON] = fillNEON(t.kernels[ARCH_NEON]);
+        return t;
+    }
+
+    static const Tables& tables() {
+        static Tables t = buildTables();
+        return t;
+    }
+
+    const Kernels* getKernels(Arch arch) {
+        if (arch < 0 || arch >= _ARCH_COUNT) { return NULL; }
+        const Tables& t = tables();
+        if (!t.built[arch] || !cpuSupports(arch)) { return NULL; }
+        return &t.kernels[arch];
+    }
+
+    static Arch select() {
+        Arch best = ARCH_GENERIC;
+        for (int i = ARCH_GENERIC + 1; i < _ARCH_COUNT; i++) {
+            if (getKernels((Arch)i)) { best = (Arch)i; }
+        }
+        current = *getKernels(best);
+        return best;
+    }
+
+    static Arch selected = select();
+
+    Arch getSelectedArch() {
+        return selected;
+    }
+
+    static const char* kernelNames[] = {
+        "max_32f",
+        "absMax_32f",
+        "slice_32f_8u",
+        "u8ToF32",
+        "s8ToF32",
+        "stereoToMono",
+        "shuffle16",
+        "unshuffle16"
+    };
+
+    void printKernels() {
+        printf("CPU features: %s\n", cpuFeatures().c_str());
+        printf("volk machine: %s\n\n", volk_get_machine());
+
+        printf("%-16s%-8s%-10s\n", "Instruction set", "Built", "Supported");
+        const Tables& t = tables();
+        for (int i = 0; i < _ARCH_COUNT; i++) {
+            printf("%-16s%-8s%-10s\n", archName((Arch)i), t.built[i] ? "yes" : "no", cpuSupports((Arch)i) ? "yes" : "no");
+        }
+        printf("\nSelected: %s\n", archName(selected));
+
+        // Every set has its own build of all kernels, some written with intrinsics and the rest vectorized by the compiler
+        printf("Kernels:");
+        for (const char* name : kernelNames) { printf(" %s", name); }
+        printf("\n");
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "cpu.h"
+#include "kernels.h"
+
+// Hot loops that volk has no kernel for, built for several instruction sets in the kernels_*.cpp files. The best
+// ones the CPU supports are picked at startup, so that builds for a generic CPU still use AVX2 or AVX-512 when the
+// machine has it. Before that and on CPUs without any of them, plain loops are used.
+namespace dsp::simd {
+    // Kernels selected for this CPU, call through this table. A function rather than an exported variable so that
+    // modules can use it without importing data from the core library.
+    const Kernels& selectedKernels();
+
+    // Instruction set the kernels were selected for
+    Arch getSelectedArch();
+
+    // Kernels of an instruction set, with those of the sets it includes for the ones it has no version of.
+    // NULL if SDR++ was built without it or the CPU doesn't support it.
+    const Kernels* getKernels(Arch arch);
+
+    // Print the CPU features and the kernel selected for each primitive, for --dsp-kernels
+    void printKernels();
+}
@@ -4,6 +4,8 @@
 #include <condition_variable>
 #include <volk/volk.h>
 #include "buffer/buffer.h"
+#include "buffer/shared_buffer.h"
+#include "profiler.h"
 
 // 1MSample buffer
 #define STREAM_BUFFER_SIZE 1000000
@@ -19,6 +21,10 @@ namespace dsp {
         virtual void clearWriteStop() {}
         virtual void stopReader() {}
         virtual void clearReadStop() {}
+
+        // Number of buffers written but not yet flushed by the reader, out of getCapacity()
+        virtual int getOccupancy() { return 0; }
+        virtual int getCapacity() { return 1; }
     };
 
     template <class T>
@@ -44,7 +50,10 @@ namespace dsp {
             {
                 // Wait to either swap or stop
                 std::unique_lock<std::mutex> lck(swapMtx);
-                swapCV.wait(lck, [this] { return (canSwap || writerStop); });
+                if (!canSwap && !writerStop) {
+                    profiler::WaitScope wait(profiler::WAIT_SWAP);
+                    swapCV.wait(lck, [this] { return (canSwap || writerStop); });
+                }
 
                 // If writer was stopped, abandon operation
                 if (writerStop) { return false; }
@@ -67,10 +76,45 @@ namespace dsp {
             return true;
         }
 
+        // Hand a shared buffer to the reader instead of swapping, the reader sees it as readBuf.
+        // On success, the stream takes ownership of one reference and releases it on flush.
+        virtual inline bool swap(buffer::SharedBuffer<T>* buf, int size) {
+            {
+                // Wait to either swap or stop
+                std::unique_lock<std::mutex> lck(swapMtx);
+                if (!canSwap && !writerStop) {
+                    profiler::WaitScope wait(profiler::WAIT_SWAP);
+                    swapCV.wait(lck, [this] { return (canSwap || writerStop); });
+                }
+
+                // If writer was stopped, abandon operation
+                if (writerStop) { return false; }
+
+                // Point the read buffer to the shared buffer
+                dataSize = size;
+                sharedBuf = buf;
+                ownReadBuf = readBuf;
+                readBuf = buf->data;
+                canSwap = false;
+            }
+
+            // Notify reader that some data is ready
+            {
+                std::lock_guard<std::mutex> lck(rdyMtx);
+                dataReady = true;
+            }
+            rdyCV.notify_all();
+
+            return true;
+        }
+
         virtual inline int read() {
             // Wait for data to be ready or to be stopped
             std::unique_lock<std::mutex> lck(rdyMtx);
-            rdyCV.wait(lck, [this] { return (dataReady || readerStop); });
+            if (!dataReady && !readerStop) {
+                profiler::WaitScope wait(profiler::WAIT_READ);
+                rdyCV.wait(lck, [this] { return (dataReady || readerStop); });
+            }
 
             return (readerStop ? -1 : dataSize);
         }
@@ -82,6 +126,9 @@ namespace dsp {
                 dataReady = false;
             }
 
+            // Give back the shared buffer if one was used
+            releaseShared();
+
             // Notify writer that buffers can be swapped
             {
                 std::lock_guard<std::mutex> lck(swapMtx);
@@ -115,7 +162,13 @@ namespace dsp {
             readerStop = false;
         }
 
+        virtual int getOccupancy() {
+            std::lock_guard<std::mutex> lck(swapMtx);
+            return canSwap ? 0 : 1;
+        }
+
         void free() {
+            releaseShared();
             if (writeBuf) { buffer::free(writeBuf); }
             if (readBuf) { buffer::free(readBuf); }
             writeBuf = NULL;
@@ -126,6 +179,13 @@ namespace dsp {
         T* readBuf;
 
     private:
+        inline void releaseShared() {
+            if (!sharedBuf) { return; }
+            readBuf = ownReadBuf;
+            sharedBuf->release();
+            sharedBuf = NULL;
+        }
+
         std::mutex swapMtx;
         std::condition_variable swapCV;
         bool canSwap = true;
@@ -138,5 +198,8 @@ namespace dsp {
         bool writerStop = false;
 
         int dataSize = 0;
+
+        buffer::SharedBuffer<T>* sharedBuf = NULL;
+        T* ownReadBuf = NULL;
     };
 }
\ No newline at end of file
@@ -20,6 +20,7 @@
 #include <gui/menus/vfo_color.h>
 #include <gui/menus/module_manager.h>
 #include <gui/menus/theme.h>
+#include <gui/menus/performance.h>
 #include <gui/dialogs/credits.h>
 #include <filesystem>
 #include <signal_path/source.h>
@@ -77,6 +78,7 @@ void MainWindow::init() {
     gui::menu.registerEntry("Theme", thememenu::draw, NULL);
     gui::menu.registerEntry("VFO Color", vfo_color_menu::draw, NULL);
     gui::menu.registerEntry("Module Manager", module_manager_menu::draw, NULL);
+    gui::menu.registerEntry("Performance", performancemenu::draw, NULL);
 
     gui::freqSelect.init();
 
@@ -84,11 +86,7 @@ void MainWindow::init() {
     gui::waterfall.setBandwidth(8000000);
     gui::waterfall.setViewBandwidth(8000000);
 
-    fft_in = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fft_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fftwPlan = fftwf_plan_dft_1d(fftSize, fft_in, fft_out, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    sigpath::iqFrontEnd.init(&dummyStream, 8000000, true, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL, acquireFFTBuffer, releaseFFTBuffer, this);
+    sigpath::iqFrontEnd.init(&dummyStream, 8000000, true, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL, acquireFFTBuffer, releaseFFTBuffer, getFFTHoldBuffer, this);
     sigpath::iqFrontEnd.start();
 
     vfoCreatedHandler.handler = vfoAddedHandler;
@@ -169,6 +167,7 @@ void MainWindow::init() {
     displaymenu::init();
     vfo_color_menu::init();
     module_manager_menu::init();
+    performancemenu::init();
 
     // TODO for 0.2.5
     // Fix gain not updated on startup, soapysdr
@@ -231,6 +230,10 @@ float* MainWindow::acquireFFTBuffer(void* ctx) {
     return gui::waterfall.getFFTBuffer();
 }
 
+float* MainWindow::getFFTHoldBuffer(void* ctx, bool min) {
+    return gui::waterfall.getFFTHoldBuffer(min);
+}
+
 void MainWindow::releaseFFTBuffer(void* ctx) {
     gui::waterfall.pushFFT();
 }
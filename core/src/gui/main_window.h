@@ -20,6 +20,7 @@ public:
     void setFirstMenuRender();
 
     static float* acquireFFTBuffer(void* ctx);
+    static float* getFFTHoldBuffer(void* ctx, bool min);
     static void releaseFFTBuffer(void* ctx);
 
     // TODO: Replace with it's own class
@@ -39,8 +40,6 @@ private:
     // FFT Variables
     int fftSize = 8192 * 8;
     std::mutex fft_mtx;
-    fftwf_complex *fft_in, *fft_out;
-    fftwf_plan fftwPlan;
 
     // GUI Variables
     bool firstMenuRender = true;
@@ -8,7 +8,9 @@
 #include <signal_path/signal_path.h>
 #include <gui/style.h>
 #include <utils/optionlist.h>
+#include <dsp/fft/plan.h>
 #include <algorithm>
+#include <thread>
 
 namespace displaymenu {
     bool showWaterfall;
@@ -22,7 +24,13 @@ namespace displaymenu {
     int uiScaleId = 0;
     bool restartRequired = false;
     bool fftHold = false;
+    bool fftMinHold = false;
     int fftHoldSpeed = 60;
+    int fftOverlapId = 0;
+    int fftAveraging = 1;
+    int fftThreads = 0;
+    int fftPlanRigor = 1;
+    int waterfallQuantization = SPECTRUM_QUANT_FLOAT;
     bool fftSmoothing = false;
     int fftSmoothingSpeed = 100;
     bool snrSmoothing = false;
@@ -56,14 +64,30 @@ namespace displaymenu {
 
     int fftSizeId = 0;
 
+    const double fftOverlaps[] = {
+        0.0,
+        0.5,
+        0.75
+    };
+
+    const char* fftOverlapsStr = "None\0"
+                                 "50%\0"
+                                 "75%\0";
+
     const IQFrontEnd::FFTWindow fftWindowList[] = {
         IQFrontEnd::FFTWindow::RECTANGULAR,
         IQFrontEnd::FFTWindow::BLACKMAN,
         IQFrontEnd::FFTWindow::NUTTALL
     };
 
+    // 0 picks a thread count from the number of cores, leaving some for the rest of the DSP
+    int fftThreadCount(int threads) {
+        if (threads > 0) { return threads; }
+        return std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, 4);
+    }
+
     void updateFFTSpeeds() {
-        gui::waterfall.setFFTHoldSpeed((float)fftHoldSpeed / ((float)fftRate * 10.0f));
+        sigpath::iqFrontEnd.setFFTHoldSpeed((float)fftHoldSpeed / ((float)fftRate * 10.0f));
         gui::waterfall.setFFTSmoothingSpeed(std::min<float>((float)fftSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f));
         gui::waterfall.setSNRSmoothingSpeed(std::min<float>((float)snrSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f));
     }
@@ -90,6 +114,9 @@ namespace displaymenu {
         fullWaterfallUpdate = core::configManager.conf["fullWaterfallUpdate"];
         gui::waterfall.setFullWaterfallUpdate(fullWaterfallUpdate);
 
+        waterfallQuantization = std::clamp<int>((int)core::configManager.conf["waterfallQuantization"], SPECTRUM_QUANT_FLOAT, SPECTRUM_QUANT_8BIT);
+        gui::waterfall.setHistoryQuantization((SpectrumQuantization)waterfallQuantization);
+
         fftSizeId = 3;
         int fftSize = core::configManager.conf["fftSize"];
         for (int i = 0; i < 7; i++) {
@@ -106,11 +133,32 @@ namespace displaymenu {
         selectedWindow = std::clamp<int>((int)core::configManager.conf["fftWindow"], 0, (sizeof(fftWindowList) / sizeof(IQFrontEnd::FFTWindow)) - 1);
         sigpath::iqFrontEnd.setFFTWindow(fftWindowList[selectedWindow]);
 
+        double fftOverlap = core::configManager.conf["fftOverlap"];
+        fftOverlapId = 0;
+        for (int i = 0; i < sizeof(fftOverlaps) / sizeof(double); i++) {
+            if (fftOverlap == fftOverlaps[i]) {
+                fftOverlapId = i;
+                break;
+            }
+        }
+        sigpath::iqFrontEnd.setFFTOverlap(fftOverlaps[fftOverlapId]);
+
+        fftAveraging = std::max<int>((int)core::configManager.conf["fftAveraging"], 1);
+        sigpath::iqFrontEnd.setFFTAveraging(fftAveraging);
+
+        fftThreads = std::max<int>((int)core::configManager.conf["fftThreads"], 0);
+        sigpath::iqFrontEnd.setFFTThreads(fftThreadCount(fftThreads));
+
+        fftPlanRigor = std::clamp<int>((int)core::configManager.conf["fftPlanRigor"], dsp::fft::PLAN_RIGOR_ESTIMATE, dsp::fft::PLAN_RIGOR_PATIENT);
+
         gui::menu.locked = core::configManager.conf["lockMenuOrder"];
 
         fftHold = core::configManager.conf["fftHold"];
+        fftMinHold = core::configManager.conf["fftMinHold"];
         fftHoldSpeed = core::configManager.conf["fftHoldSpeed"];
         gui::waterfall.setFFTHold(fftHold);
+        gui::waterfall.setFFTMinHold(fftMinHold);
+        sigpath::iqFrontEnd.setFFTHold(fftHold, fftMinHold);
         fftSmoothing = core::configManager.conf["fftSmoothing"];
         fftSmoothingSpeed = core::configManager.conf["fftSmoothingSpeed"];
         gui::waterfall.setFFTSmoothing(fftSmoothing);
@@ -162,6 +210,7 @@ namespace displaymenu {
 
         if (ImGui::Checkbox("FFT Hold##_sdrpp", &fftHold)) {
             gui::waterfall.setFFTHold(fftHold);
+            sigpath::iqFrontEnd.setFFTHold(fftHold, fftMinHold);
             core::configManager.acquire();
             core::configManager.conf["fftHold"] = fftHold;
             core::configManager.release(true);
@@ -175,6 +224,14 @@ namespace displaymenu {
             core::configManager.release(true);
         }
 
+        if (ImGui::Checkbox("FFT Min Hold##_sdrpp", &fftMinHold)) {
+            gui::waterfall.setFFTMinHold(fftMinHold);
+            sigpath::iqFrontEnd.setFFTHold(fftHold, fftMinHold);
+            core::configManager.acquire();
+            core::configManager.conf["fftMinHold"] = fftMinHold;
+            core::configManager.release(true);
+        }
+
         if (ImGui::Checkbox("FFT Smoothing##_sdrpp", &fftSmoothing)) {
             gui::waterfall.setFFTSmoothing(fftSmoothing);
             core::configManager.acquire();
@@ -245,6 +302,62 @@ namespace displaymenu {
             core::configManager.release(true);
         }
 
+        ImGui::LeftLabel("FFT Overlap");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo("##sdrpp_fft_overlap", &fftOverlapId, fftOverlapsStr)) {
+            sigpath::iqFrontEnd.setFFTOverlap(fftOverlaps[fftOverlapId]);
+            core::configManager.acquire();
+            core::configManager.conf["fftOverlap"] = fftOverlaps[fftOverlapId];
+            core::configManager.release(true);
+        }
+
+        ImGui::LeftLabel("FFT Averaging");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt("##sdrpp_fft_averaging", &fftAveraging, 1, 4)) {
+            fftAveraging = std::clamp<int>(fftAveraging, 1, 64);
+            sigpath::iqFrontEnd.setFFTAveraging(fftAveraging);
+            core::configManager.acquire();
+            core::configManager.conf["fftAveraging"] = fftAveraging;
+            core::configManager.release(true);
+        }
+
+        ImGui::LeftLabel("FFT Threads");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt("##sdrpp_fft_threads", &fftThreads, 1, 1)) {
+            fftThreads = std::clamp<int>(fftThreads, 0, 16);
+            sigpath::iqFrontEnd.setFFTThreads(fftThreadCount(fftThreads));
+            core::configManager.acquire();
+            core::configManager.conf["fftThreads"] = fftThreads;
+            core::configManager.release(true);
+        }
+        if (!fftThreads && ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Automatic (%d)", fftThreadCount(fftThreads));
+        }
+
+        ImGui::LeftLabel("FFT Planning");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo("##sdrpp_fft_plan_rigor", &fftPlanRigor, "Estimate\0Measure\0Patient\0")) {
+            dsp::fft::setPlanRigor((dsp::fft::PlanRigor)fftPlanRigor);
+            core::configManager.acquire();
+            core::configManager.conf["fftPlanRigor"] = fftPlanRigor;
+            core::configManager.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Applies to FFTs created from now on");
+        }
+
+        ImGui::LeftLabel("Waterfall History");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo("##sdrpp_wf_quantization", &waterfallQuantization, "Float\0" "16 bit\0" "8 bit\0")) {
+            gui::waterfall.setHistoryQuantization((SpectrumQuantization)waterfallQuantization);
+            core::configManager.acquire();
+            core::configManager.conf["waterfallQuantization"] = waterfallQuantization;
+            core::configManager.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Storage of the waterfall lines, 8 bit uses less memory than float at 0.5dB resolution");
+        }
+
         if (colorMapNames.size() > 0) {
             ImGui::LeftLabel("Color Map");
             ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
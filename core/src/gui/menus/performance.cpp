@@ -0,0 +1,126 @@
+#include <gui/menus/performance.h>
+#include <gui/gui.h>
+#include <gui/style.h>
+#include <dsp/profiler.h>
+#include <utils/flog.h>
+#include <core.h>
+#include <json.hpp>
+#include <fstream>
+#include <chrono>
+
+using nlohmann::json;
+
+namespace performancemenu {
+    bool profiling = false;
+    std::vector<dsp::profiler::BlockReport> reports;
+    std::chrono::steady_clock::time_point lastReport;
+
+    void init() {
+        core::configManager.acquire();
+        profiling = core::configManager.conf["profiling"];
+        core::configManager.release();
+        dsp::profiler::setEnabled(profiling);
+        lastReport = std::chrono::steady_clock::now();
+    }
+
+    json toJSON(const std::vector<dsp::profiler::BlockReport>& reports) {
+        json blocks = json::array();
+        for (auto& rep : reports) {
+            json b;
+            b["name"] = rep.name;
+            b["sampleRate"] = rep.sampleRate;
+            b["runTime"] = rep.runTime;
+            b["load"] = rep.load;
+            b["readWait"] = rep.readWait;
+            b["swapWait"] = rep.swapWait;
+            b["occupancy"] = rep.occupancy;
+            blocks.push_back(b);
+        }
+        return blocks;
+    }
+
+    bool dumpJSON(std::string path) {
+        json data;
+        data["profiling"] = profiling;
+        data["blocks"] = toJSON(reports);
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            flog::error("Could not write performance report to '{0}'", path);
+            return false;
+        }
+        file << data.dump(4);
+        file.close();
+        flog::info("Wrote performance report to '{0}'", path);
+        return true;
+    }
+
+    void draw(void* ctx) {
+        float menuWidth = ImGui::GetContentRegionAvail().x;
+
+        if (ImGui::Checkbox("Profile DSP Blocks##_sdrpp_perf", &profiling)) {
+            dsp::profiler::setEnabled(profiling);
+            if (!profiling) { reports.clear(); }
+            core::configManager.acquire();
+            core::configManager.conf["profiling"] = profiling;
+            core::configManager.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Measure the throughput and load of every block. Adds a small overhead to each run.");
+        }
+
+        if (!profiling) { return; }
+
+        // Refresh the rates once per second, the first report after enabling only sets the reference
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            reports = dsp::profiler::report();
+            lastReport = now;
+        }
+
+        if (ImGui::Button("Dump JSON##_sdrpp_perf", ImVec2(menuWidth, 0))) {
+            dumpJSON((std::string)core::args["root"] + "/performance.json");
+        }
+
+        if (ImGui::BeginTable("Performance Table##_sdrpp_perf", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Block", ImGuiTableColumnFlags_WidthStretch, 3.0f);
+            ImGui::TableSetupColumn("MS/s");
+            ImGui::TableSetupColumn("Load");
+            ImGui::TableSetupColumn("Wait");
+            ImGui::TableSetupColumn("Fill");
+            ImGui::TableHeadersRow();
+
+            for (auto& rep : reports) {
+                ImGui::TableNextRow();
+
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(rep.name.c_str());
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::TextUnformatted(rep.name.c_str());
+                    ImGui::Separator();
+                    ImGui::Text("Rate: %.3f MS/s", rep.sampleRate * 1e-6);
+                    ImGui::Text("Run time: %.1f us", rep.runTime * 1e6);
+                    ImGui::Text("Load: %.1f%%", rep.load * 100.0);
+                    ImGui::Text("Waiting for input: %.1f%%", rep.readWait * 100.0);
+                    ImGui::Text("Waiting for output: %.1f%%", rep.swapWait * 100.0);
+                    ImGui::Text("Input fill: %.0f%%", rep.occupancy * 100.0);
+                    ImGui::EndTooltip();
+                }
+
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%.2f", rep.sampleRate * 1e-6);
+
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.0f%%", rep.load * 100.0);
+
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%.0f%%", (rep.readWait + rep.swapWait) * 100.0);
+
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("%.0f%%", rep.occupancy * 100.0);
+            }
+
+            ImGui::EndTable();
+        }
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+
+namespace performancemenu {
+    void init();
+    void draw(void* ctx);
+    bool dumpJSON(std::string path);
+}
@@ -14,6 +14,8 @@ namespace sourcemenu {
     int decimationPower = 0;
     bool iqCorrection = false;
     bool invertIQ = false;
+    int channelizerThreshold = 0;
+    int channelizerChannelsId = 2;
 
     EventHandler<std::string> sourceRegisteredHandler;
     EventHandler<std::string> sourceUnregisterHandler;
@@ -52,6 +54,14 @@ namespace sourcemenu {
                                    "32\0"
                                    "64\0";
 
+    const char* channelizerChannelsTxt = "64\0"
+                                         "128\0"
+                                         "256\0"
+                                         "512\0"
+                                         "1024\0"
+                                         "2048\0"
+                                         "4096\0";
+
     void updateOffset() {
         if (offsetMode == OFFSET_MODE_CUSTOM) { effectiveOffset = customOffset; }
         else if (offsetMode == OFFSET_MODE_SPYVERTER) {
@@ -147,6 +157,11 @@ namespace sourcemenu {
         invertIQ = core::configManager.conf["invertIQ"];
         sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
         sigpath::iqFrontEnd.setInvertIQ(invertIQ);
+        channelizerThreshold = core::configManager.conf["channelizerThreshold"];
+        int channelizerChannels = core::configManager.conf["channelizerChannels"];
+        channelizerChannelsId = std::clamp<int>(log2(channelizerChannels) - 6, 0, 6);
+        sigpath::iqFrontEnd.setChannelizerThreshold(channelizerThreshold);
+        sigpath::iqFrontEnd.setChannelizerChannels(64 << channelizerChannelsId);
         updateOffset();
 
         refreshSources();
@@ -230,5 +245,25 @@ namespace sourcemenu {
             core::configManager.release(true);
         }
         if (running) { style::endDisabled(); }
+
+        // Number of VFOs after which new ones are served by the channelizer, 0 to disable
+        ImGui::LeftLabel("Channelizer VFOs");
+        ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt("##source_chan_thresh", &channelizerThreshold)) {
+            channelizerThreshold = std::max<int>(channelizerThreshold, 0);
+            sigpath::iqFrontEnd.setChannelizerThreshold(channelizerThreshold);
+            core::configManager.acquire();
+            core::configManager.conf["channelizerThreshold"] = channelizerThreshold;
+            core::configManager.release(true);
+        }
+
+        ImGui::LeftLabel("Channelizer Channels");
+        ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo("##source_chan_count", &channelizerChannelsId, channelizerChannelsTxt)) {
+            sigpath::iqFrontEnd.setChannelizerChannels(64 << channelizerChannelsId);
+            core::configManager.acquire();
+            core::configManager.conf["channelizerChannels"] = 64 << channelizerChannelsId;
+            core::configManager.release(true);
+        }
     }
 }
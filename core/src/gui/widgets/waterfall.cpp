@@ -7,6 +7,7 @@
 #include <utils/flog.h>
 #include <gui/gui.h>
 #include <gui/style.h>
+#include <dsp/simd/simd.h>
 
 float DEFAULT_COLOR_MAP[][3] = {
     { 0x00, 0x00, 0x20 },
@@ -62,7 +63,11 @@ inline void printAndScale(double freq, char* buf) {
     }
 }
 
-inline void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out) {
+// Pixel width from which the max of a pixel is searched with the SIMD kernel instead of a plain loop
+#define ZOOM_KERNEL_MIN_WIDTH 16
+
+// Each pixel gets the max of the bins it covers, or their min for traces that hold minimums
+inline void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out, bool min = false) {
     // NOTE: REMOVE THAT SHIT, IT'S JUST A HACKY FIX
     if (offset < 0) {
         offset = 0;
@@ -81,8 +86,22 @@ inline void doZoom(int offset, int width, int inSize, int outSize, float* in, fl
         maxVal = -INFINITY;
         sId = (int)id;
         uFactor = (sId + sFactor > inSize) ? sFactor - ((sId + sFactor) - inSize) : sFactor;
-        for (int j = 0; j < uFactor; j++) {
-            if (in[sId + j] > maxVal) { maxVal = in[sId + j]; }
+        if (min) {
+            float minVal = INFINITY;
+            for (int j = 0; j < uFactor; j++) {
+                if (in[sId + j] < minVal) { minVal = in[sId + j]; }
+            }
+            out[i] = minVal;
+            id += factor;
+            continue;
+        }
+        if (uFactor >= ZOOM_KERNEL_MIN_WIDTH) {
+            maxVal = dsp::simd::selectedKernels().max_32f(&in[sId], uFactor);
+        }
+        else {
+            for (int j = 0; j < uFactor; j++) {
+                if (in[sId + j] > maxVal) { maxVal = in[sId + j]; }
+            }
         }
         out[i] = maxVal;
         id += factor;
@@ -105,7 +124,9 @@ namespace ImGui {
         lastWidgetSize.y = 0;
         latestFFT = new float[dataWidth];
         latestFFTHold = new float[dataWidth];
+        latestFFTMinHold = new float[dataWidth];
         waterfallFb = new uint32_t[1];
+        palletIdBuf = (int32_t*)volk_malloc(dataWidth * sizeof(int32_t), volk_get_alignment());
 
         viewBandwidth = 1.0;
         wholeBandwidth = 1.0;
@@ -185,6 +206,18 @@ namespace ImGui {
             }
         }
 
+        // Min hold
+        if (fftMinHold && latestFFT != NULL && latestFFTMinHold != NULL && fftLines != 0) {
+            for (int i = 1; i < dataWidth; i++) {
+                double aPos = fftAreaMax.y - ((latestFFTMinHold[i - 1] - fftMin) * scaleFactor);
+                double bPos = fftAreaMax.y - ((latestFFTMinHold[i] - fftMin) * scaleFactor);
+                aPos = std::clamp<double>(aPos, fftAreaMin.y + 1, fftAreaMax.y);
+                bPos = std::clamp<double>(bPos, fftAreaMin.y + 1, fftAreaMax.y);
+                window->DrawList->AddLine(ImVec2(fftAreaMin.x + i - 1, roundf(aPos)),
+                                          ImVec2(fftAreaMin.x + i, roundf(bPos)), traceHold, 1.0);
+            }
+        }
+
         FFTRedrawArgs args;
         args.min = fftAreaMin;
         args.max = fftAreaMax;
@@ -206,13 +239,24 @@ namespace ImGui {
     }
 
     void WaterFall::drawWaterfall() {
-        if (waterfallUpdate) {
+        // Upload the whole texture only when needed, otherwise just the new lines
+        if (waterfallUpdate || texWidth != dataWidth || texHeight != waterfallHeight) {
             waterfallUpdate = false;
+            waterfallNewLines = 0;
             updateWaterfallTexture();
         }
+        else if (waterfallNewLines) {
+            updateWaterfallTextureLines();
+        }
         {
+            // The texture is circular, draw from the newest line to the end, then from the start to the oldest line
             std::lock_guard<std::mutex> lck(texMtx);
-            window->DrawList->AddImage((void*)(intptr_t)textureId, wfMin, wfMax);
+            float split = (float)currentFFTLine / (float)waterfallHeight;
+            float splitY = wfMin.y + (waterfallHeight - currentFFTLine);
+            window->DrawList->AddImage((void*)(intptr_t)textureId, wfMin, ImVec2(wfMax.x, splitY), ImVec2(0, split), ImVec2(1, 1));
+            if (currentFFTLine) {
+                window->DrawList->AddImage((void*)(intptr_t)textureId, ImVec2(wfMin.x, splitY), wfMax, ImVec2(0, 0), ImVec2(1, split));
+            }
         }
         
         ImVec2 mPos = ImGui::GetMousePos();
@@ -492,7 +536,7 @@ namespace ImGui {
                         ImGui::Text("Bandwidth Locked: %s", _vfo->bandwidthLocked ? "Yes" : "No");
 
                         float strength, snr;
-                        if (calculateVFOSignalInfo(waterfallVisible ? &rawFFTs[currentFFTLine * rawFFTSize] : rawFFTs, _vfo, strength, snr)) {
+                        if (calculateVFOSignalInfo(rawFFT, _vfo, strength, snr)) {
                             ImGui::Text("Strength: %0.1fdBFS", strength);
                             ImGui::Text("SNR: %0.1fdB", snr);
                         }
@@ -598,32 +642,27 @@ namespace ImGui {
     }
 
     void WaterFall::updateWaterfallFb() {
-        if (!waterfallVisible || rawFFTs == NULL) {
+        if (!waterfallVisible || rawFFT == NULL) {
             return;
         }
         double offsetRatio = viewOffset / (wholeBandwidth / 2.0);
-        int drawDataSize;
-        int drawDataStart;
+        int drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
+        int drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
         // TODO: Maybe put on the stack for faster alloc?
         float* tempData = new float[dataWidth];
-        float pixel;
-        float dataRange = waterfallMax - waterfallMin;
-        int count = std::min<float>(waterfallHeight, fftLines);
-        if (rawFFTs != NULL && fftLines >= 0) {
-            for (int i = 0; i < count; i++) {
-                drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
-                drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
-                doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[((i + currentFFTLine) % waterfallHeight) * rawFFTSize], tempData);
-                for (int j = 0; j < dataWidth; j++) {
-                    pixel = (std::clamp<float>(tempData[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
-                    waterfallFb[(i * dataWidth) + j] = waterfallPallet[(int)(pixel * (WATERFALL_RESOLUTION - 1))];
-                }
-            }
+        int count = std::min<int>(waterfallHeight, history.getStoredLines());
 
-            for (int i = count; i < waterfallHeight; i++) {
-                for (int j = 0; j < dataWidth; j++) {
-                    waterfallFb[(i * dataWidth) + j] = (uint32_t)255 << 24;
-                }
+        // The pyramid reduces each pixel in a number of steps that doesn't depend on the zoom
+        for (int i = 0; i < count; i++) {
+            int line = (i + currentFFTLine) % waterfallHeight;
+            history.zoom(i, drawDataStart, drawDataSize, dataWidth, tempData);
+            mapToPallet(tempData, &waterfallFb[line * dataWidth]);
+        }
+
+        for (int i = count; i < waterfallHeight; i++) {
+            int line = (i + currentFFTLine) % waterfallHeight;
+            for (int j = 0; j < dataWidth; j++) {
+                waterfallFb[(line * dataWidth) + j] = (uint32_t)255 << 24;
             }
         }
         delete[] tempData;
@@ -706,8 +745,38 @@ namespace ImGui {
         glBindTexture(GL_TEXTURE_2D, textureId);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dataWidth, waterfallHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)waterfallFb);
+        texWidth = dataWidth;
+        texHeight = waterfallHeight;
+    }
+
+    void WaterFall::updateWaterfallTextureLines() {
+        std::lock_guard<std::mutex> lck(texMtx);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        // The new lines start at the newest one and may wrap around the end of the framebuffer
+        int first = std::min<int>(waterfallNewLines, waterfallHeight - currentFFTLine);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, currentFFTLine, dataWidth, first, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)&waterfallFb[currentFFTLine * dataWidth]);
+        if (waterfallNewLines > first) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dataWidth, waterfallNewLines - first, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)waterfallFb);
+        }
+        waterfallNewLines = 0;
+    }
+
+    void WaterFall::mapToPallet(float* in, uint32_t* out) {
+        // Convert to pallet indices all at once, then clamp them to the range of the waterfall.
+        // The conversion saturates, so -INF (empty bins) ends up at the bottom of the pallet.
+        float scale = (float)(WATERFALL_RESOLUTION - 1) / (waterfallMax - waterfallMin);
+        int32_t minId = roundf(waterfallMin * scale);
+        int32_t maxId = minId + (WATERFALL_RESOLUTION - 1);
+        volk_32f_s32f_convert_32i(palletIdBuf, in, scale, dataWidth);
+        for (int i = 0; i < dataWidth; i++) {
+            out[i] = waterfallPallet[std::clamp<int32_t>(palletIdBuf[i], minId, maxId) - minId];
+        }
     }
 
     void WaterFall::onPositionChange() {
@@ -722,7 +791,6 @@ namespace ImGui {
             return;
         }
 
-        int lastWaterfallHeight = waterfallHeight;
 
         if (waterfallVisible) {
             FFTAreaHeight = std::min<int>(FFTAreaHeight, widgetSize.y - (50.0f * style::uiScale));
@@ -736,24 +804,13 @@ namespace ImGui {
         dataWidth = widgetSize.x - (60.0f * style::uiScale);
 
         if (waterfallVisible) {
-            // Raw FFT resize
-            fftLines = std::min<int>(fftLines, waterfallHeight) - 1;
-            if (rawFFTs != NULL) {
-                if (currentFFTLine != 0) {
-                    float* tempWF = new float[currentFFTLine * rawFFTSize];
-                    int moveCount = lastWaterfallHeight - currentFFTLine;
-                    memcpy(tempWF, rawFFTs, currentFFTLine * rawFFTSize * sizeof(float));
-                    memmove(rawFFTs, &rawFFTs[currentFFTLine * rawFFTSize], moveCount * rawFFTSize * sizeof(float));
-                    memcpy(&rawFFTs[moveCount * rawFFTSize], tempWF, currentFFTLine * rawFFTSize * sizeof(float));
-                    delete[] tempWF;
-                }
-                currentFFTLine = 0;
-                rawFFTs = (float*)realloc(rawFFTs, waterfallHeight * rawFFTSize * sizeof(float));
-            }
-            else {
-                rawFFTs = (float*)malloc(waterfallHeight * rawFFTSize * sizeof(float));
-            }
-            // ==============
+            // History resize, keeps the newest lines
+            history.setLineCount(waterfallHeight);
+            currentFFTLine = 0;
+            fftLines = history.getStoredLines();
+        }
+        else {
+            history.setLineCount(1);
         }
 
         // Reallocate display FFT
@@ -768,6 +825,12 @@ namespace ImGui {
         }
         latestFFTHold = new float[dataWidth];
 
+        // Reallocate min hold FFT
+        if (latestFFTMinHold != NULL) {
+            delete[] latestFFTMinHold;
+        }
+        latestFFTMinHold = new float[dataWidth];
+
         // Reallocate smoothing buffer
         if (fftSmoothing) {
             if (smoothingBuf) { delete[] smoothingBuf; }
@@ -782,9 +845,14 @@ namespace ImGui {
             waterfallFb = new uint32_t[dataWidth * waterfallHeight];
             memset(waterfallFb, 0, dataWidth * waterfallHeight * sizeof(uint32_t));
         }
+
+        // Reallocate pallet index buffer
+        if (palletIdBuf) { volk_free(palletIdBuf); }
+        palletIdBuf = (int32_t*)volk_malloc(dataWidth * sizeof(int32_t), volk_get_alignment());
         for (int i = 0; i < dataWidth; i++) {
             latestFFT[i] = -1000.0f; // Hide everything
             latestFFTHold[i] = -1000.0f;
+            latestFFTMinHold[i] = -1000.0f;
         }
 
         fftAreaMin = ImVec2(widgetPos.x + (50.0f * style::uiScale), widgetPos.y + (9.0f * style::uiScale));
@@ -874,39 +942,33 @@ namespace ImGui {
     }
 
     float* WaterFall::getFFTBuffer() {
-        if (rawFFTs == NULL) { return NULL; }
+        if (rawFFT == NULL) { return NULL; }
         buf_mtx.lock();
-        if (waterfallVisible) {
-            currentFFTLine--;
-            fftLines++;
-            currentFFTLine = ((currentFFTLine + waterfallHeight) % waterfallHeight);
-            fftLines = std::min<float>(fftLines, waterfallHeight);
-            return &rawFFTs[currentFFTLine * rawFFTSize];
-        }
-        return rawFFTs;
+        return rawFFT;
+    }
+
+    float* WaterFall::getFFTHoldBuffer(bool min) {
+        // NOTE: Must be called between getFFTBuffer and pushFFT
+        if (min) { return fftMinHold ? rawFFTMinHold : NULL; }
+        return fftHold ? rawFFTHold : NULL;
     }
 
     void WaterFall::pushFFT() {
-        if (rawFFTs == NULL) { return; }
+        if (rawFFT == NULL) { return; }
         std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
         double offsetRatio = viewOffset / (wholeBandwidth / 2.0);
         int drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
         int drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
 
+        history.push(rawFFT);
+        doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, rawFFT, latestFFT);
         if (waterfallVisible) {
-            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[currentFFTLine * rawFFTSize], latestFFT);
-            memmove(&waterfallFb[dataWidth], waterfallFb, dataWidth * (waterfallHeight - 1) * sizeof(uint32_t));
-            float pixel;
-            float dataRange = waterfallMax - waterfallMin;
-            for (int j = 0; j < dataWidth; j++) {
-                pixel = (std::clamp<float>(latestFFT[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
-                int id = (int)(pixel * (WATERFALL_RESOLUTION - 1));
-                waterfallFb[j] = waterfallPallet[id];
-            }
-            waterfallUpdate = true;
+            currentFFTLine = (currentFFTLine - 1 + waterfallHeight) % waterfallHeight;
+            fftLines = std::min<int>(fftLines + 1, waterfallHeight);
+            mapToPallet(latestFFT, &waterfallFb[currentFFTLine * dataWidth]);
+            waterfallNewLines = std::min<int>(waterfallNewLines + 1, waterfallHeight);
         }
         else {
-            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, rawFFTs, latestFFT);
             fftLines = 1;
         }
 
@@ -923,19 +985,20 @@ namespace ImGui {
             float dummy;
             if (snrSmoothing) {
                 float newSNR = 0.0f;
-                calculateVFOSignalInfo(waterfallVisible ? &rawFFTs[currentFFTLine * rawFFTSize] : rawFFTs, vfos[selectedVFO], dummy, newSNR);
+                calculateVFOSignalInfo(rawFFT, vfos[selectedVFO], dummy, newSNR);
                 selectedVFOSNR = (snrSmoothingBeta*selectedVFOSNR) + (snrSmoothingAlpha*newSNR);
             }
             else {
-                calculateVFOSignalInfo(waterfallVisible ? &rawFFTs[currentFFTLine * rawFFTSize] : rawFFTs, vfos[selectedVFO], dummy, selectedVFOSNR);
+                calculateVFOSignalInfo(rawFFT, vfos[selectedVFO], dummy, selectedVFOSNR);
             }
         }
 
-        // If FFT hold is enabled, update it
-        if (fftHold && latestFFT != NULL && latestFFTHold != NULL && fftLines != 0) {
-            for (int i = 1; i < dataWidth; i++) {
-                latestFFTHold[i] = std::max<float>(latestFFT[i], latestFFTHold[i] - fftHoldSpeed);
-            }
+        // If FFT hold is enabled, zoom the hold computed along with the FFT
+        if (fftHold && rawFFTHold != NULL && latestFFTHold != NULL) {
+            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, rawFFTHold, latestFFTHold);
+        }
+        if (fftMinHold && rawFFTMinHold != NULL && latestFFTMinHold != NULL) {
+            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, rawFFTMinHold, latestFFTMinHold, true);
         }
 
         buf_mtx.unlock();
@@ -1133,24 +1196,35 @@ namespace ImGui {
 
     void WaterFall::setRawFFTSize(int size) {
         std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        std::lock_guard<std::recursive_mutex> lck2(latestFFTMtx);
         rawFFTSize = size;
-        int wfSize = std::max<int>(1, waterfallHeight);
-        if (rawFFTs != NULL) {
-            rawFFTs = (float*)realloc(rawFFTs, rawFFTSize * wfSize * sizeof(float));
-        }
-        else {
-            rawFFTs = (float*)malloc(rawFFTSize * wfSize * sizeof(float));
-        }
+        rawFFT = (float*)realloc(rawFFT, rawFFTSize * sizeof(float));
+        memset(rawFFT, 0, rawFFTSize * sizeof(float));
+        history.init(rawFFTSize, waterfallVisible ? std::max<int>(1, waterfallHeight) : 1, historyQuant);
         fftLines = 0;
-        memset(rawFFTs, 0, rawFFTSize * waterfallHeight * sizeof(float));
+
+        // Reallocate hold buffers
+        rawFFTHold = (float*)realloc(rawFFTHold, rawFFTSize * sizeof(float));
+        rawFFTMinHold = (float*)realloc(rawFFTMinHold, rawFFTSize * sizeof(float));
+        for (int i = 0; i < rawFFTSize; i++) {
+            rawFFTHold[i] = -1000.0f;
+            rawFFTMinHold[i] = -1000.0f;
+        }
+
         updateWaterfallFb();
     }
 
+    int WaterFall::getRawFFTSize() {
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        return rawFFTSize;
+    }
+
     void WaterFall::setBandPlanPos(int pos) {
         bandPlanPos = pos;
     }
 
     void WaterFall::setFFTHold(bool hold) {
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
         fftHold = hold;
         if (fftHold && latestFFTHold) {
             for (int i = 0; i < dataWidth; i++) {
@@ -1159,8 +1233,24 @@ namespace ImGui {
         }
     }
 
-    void WaterFall::setFFTHoldSpeed(float speed) {
-        fftHoldSpeed = speed;
+    void WaterFall::setFFTMinHold(bool hold) {
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        fftMinHold = hold;
+        if (fftMinHold && latestFFTMinHold) {
+            for (int i = 0; i < dataWidth; i++) {
+                latestFFTMinHold[i] = -1000.0;
+            }
+        }
+    }
+
+    void WaterFall::setHistoryQuantization(SpectrumQuantization quant) {
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        std::lock_guard<std::recursive_mutex> lck2(latestFFTMtx);
+        historyQuant = quant;
+        if (rawFFT == NULL) { return; }
+        history.init(rawFFTSize, history.getLineCount(), historyQuant);
+        fftLines = 0;
+        updateWaterfallFb();
     }
 
     void WaterFall::setFFTSmoothing(bool enabled) {
@@ -1216,6 +1306,16 @@ namespace ImGui {
         latestFFTMtx.unlock();
     }
 
+    bool WaterFall::getSpectrumRange(double lowFreq, double highFreq, float& min, float& max, int age) {
+        // The history is only modified with latestFFTMtx held, so this can be used along with acquireLatestFFT
+        std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
+        if (rawFFT == NULL || wholeBandwidth <= 0.0) { return false; }
+        double lowerEdge = centerFreq - (wholeBandwidth / 2.0);
+        int start = floor(((lowFreq - lowerEdge) / wholeBandwidth) * (double)rawFFTSize);
+        int end = ceil(((highFreq - lowerEdge) / wholeBandwidth) * (double)rawFFTSize);
+        return history.getRange(age, start, std::max<int>(end, start + 1), min, max);
+    }
+
     void WaterfallVFO::setOffset(double offset) {
         generalOffset = offset;
         if (reference == REF_CENTER) {
@@ -1383,12 +1483,14 @@ namespace ImGui {
 
     void WaterFall::showWaterfall() {
         buf_mtx.lock();
-        if (rawFFTs == NULL) {
+        if (rawFFT == NULL) {
             flog::error("Null rawFFT");
         }
         waterfallVisible = true;
+        latestFFTMtx.lock();
+        history.clear();
+        latestFFTMtx.unlock();
         onResize();
-        memset(rawFFTs, 0, waterfallHeight * rawFFTSize * sizeof(float));
         updateWaterfallFb();
         buf_mtx.unlock();
     }
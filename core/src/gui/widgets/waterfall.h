@@ -5,6 +5,7 @@
 #include <imgui/imgui.h>
 #include <imgui/imgui_internal.h>
 #include <utils/event.h>
+#include <utils/spectrum_pyramid.h>
 
 #include <utils/opengl_include_code.h>
 
@@ -88,6 +89,7 @@ namespace ImGui {
 
         void draw();
         float* getFFTBuffer();
+        float* getFFTHoldBuffer(bool min);
         void pushFFT();
 
         void updatePallette(float colors[][3], int colorCount);
@@ -134,13 +136,16 @@ namespace ImGui {
         int getFFTHeight();
 
         void setRawFFTSize(int size);
+        int getRawFFTSize();
 
         void setFullWaterfallUpdate(bool fullUpdate);
 
         void setBandPlanPos(int pos);
 
         void setFFTHold(bool hold);
-        void setFFTHoldSpeed(float speed);
+        void setFFTMinHold(bool hold);
+
+        void setHistoryQuantization(SpectrumQuantization quant);
 
         void setFFTSmoothing(bool enabled);
         void setFFTSmoothingSpeed(float speed);
@@ -151,6 +156,9 @@ namespace ImGui {
         float* acquireLatestFFT(int& width);
         void releaseLatestFFT();
 
+        // Min and max level of the raw FFT between two absolute frequencies, age 0 being the newest line
+        bool getSpectrumRange(double lowFreq, double highFreq, float& min, float& max, int age = 0);
+
         bool centerFreqMoved = false;
         bool vfoFreqChanged = false;
         bool bandplanEnabled = false;
@@ -228,10 +236,15 @@ namespace ImGui {
         void onResize();
         void updateWaterfallFb();
         void updateWaterfallTexture();
+        void updateWaterfallTextureLines();
+        void mapToPallet(float* in, uint32_t* out);
         void updateAllVFOs(bool checkRedrawRequired = false);
         bool calculateVFOSignalInfo(float* fftLine, WaterfallVFO* vfo, float& strength, float& snr);
 
         bool waterfallUpdate = false;
+        int waterfallNewLines = 0;
+        int texWidth = 0;
+        int texHeight = 0;
 
         uint32_t waterfallPallet[WATERFALL_RESOLUTION];
 
@@ -281,16 +294,22 @@ namespace ImGui {
         float waterfallMin;
         float waterfallMax;
 
-        //std::vector<std::vector<float>> rawFFTs;
         int rawFFTSize;
-        float* rawFFTs = NULL;
+        float* rawFFT = NULL;
+        float* rawFFTHold = NULL;
+        float* rawFFTMinHold = NULL;
         float* latestFFT = NULL;
         float* latestFFTHold = NULL;
+        float* latestFFTMinHold = NULL;
         float* smoothingBuf = NULL;
         int currentFFTLine = 0;
         int fftLines = 0;
 
-        uint32_t* waterfallFb;
+        SpectrumPyramid history; // Raw FFT lines shown on the waterfall, age 0 is the newest. Modified with buf_mtx and latestFFTMtx held
+        SpectrumQuantization historyQuant = SPECTRUM_QUANT_FLOAT;
+
+        uint32_t* waterfallFb;   // Circular, the line of age i in the history is at (currentFFTLine + i) % waterfallHeight
+        int32_t* palletIdBuf = NULL;
 
         bool draggingFW = false;
         int FFTAreaHeight;
@@ -304,7 +323,7 @@ namespace ImGui {
         int bandPlanPos = BANDPLAN_POS_BOTTOM;
 
         bool fftHold = false;
-        float fftHoldSpeed = 0.3f;
+        bool fftMinHold = false;
 
         bool fftSmoothing = false;
         float fftSmoothingAlpha = 0.5;
@@ -0,0 +1,234 @@
+#include "headless.h"
+#include "core.h"
+#include <utils/flog.h>
+#include <config.h>
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <signal.h>
+#include <gui/gui.h>
+#include <gui/smgui.h>
+#include <signal_path/signal_path.h>
+#include <dsp/fft/plan.h>
+
+// Example profile, every key is optional and falls back to the values of config.json:
+// {
+//     "source": "RTL-SDR",
+//     "frequency": 100000000,
+//     "moduleInstances": {
+//         "Radio": { "module": "radio", "enabled": true },
+//         "Recorder": { "module": "recorder", "enabled": true }
+//     },
+//     "vfoOffsets": { "Radio": 150000 },
+//     "startCommands": [ { "instance": "Radio", "code": 1, "int": 1 }, { "instance": "Recorder", "code": 2 } ],
+//     "stopCommands": [ { "instance": "Recorder", "code": 3 } ]
+// }
+// Commands are calls to the module interfaces, "int", "float", "double" or "bool" is given as the input argument if present.
+
+namespace headless {
+    dsp::stream<dsp::complex_t> dummyStream;
+    EventHandler<VFOManager::VFO*> vfoCreatedHandler;
+    json vfoOffsets;
+    std::atomic<bool> stopRequested = false;
+
+    void signalHandler(int sig) {
+        stopRequested = true;
+    }
+
+    void vfoAddedHandler(VFOManager::VFO* vfo, void* ctx) {
+        std::string name = vfo->getName();
+        if (!vfoOffsets.contains(name)) { return; }
+        sigpath::vfoManager.setCenterOffset(name, vfoOffsets[name]);
+    }
+
+    void callCommands(const json& commands) {
+        for (auto& cmd : commands) {
+            if (!cmd.contains("instance") || !cmd["instance"].is_string()) {
+                flog::error("Command is missing instance key");
+                continue;
+            }
+            if (!cmd.contains("code") || !cmd["code"].is_number_integer()) {
+                flog::error("Command is missing code key");
+                continue;
+            }
+            std::string instance = cmd["instance"];
+            int code = cmd["code"];
+
+            flog::info("Calling {0} interface with code {1}", instance, code);
+            if (cmd.contains("int")) {
+                int val = cmd["int"];
+                core::modComManager.callInterface(instance, code, &val, NULL);
+            }
+            else if (cmd.contains("float")) {
+                float val = cmd["float"];
+                core::modComManager.callInterface(instance, code, &val, NULL);
+            }
+            else if (cmd.contains("double")) {
+                double val = cmd["double"];
+                core::modComManager.callInterface(instance, code, &val, NULL);
+            }
+            else if (cmd.contains("bool")) {
+                bool val = cmd["bool"];
+                core::modComManager.callInterface(instance, code, &val, NULL);
+            }
+            else {
+                core::modComManager.callInterface(instance, code, NULL, NULL);
+            }
+        }
+    }
+
+    int main(std::string profilePath) {
+        flog::info("=====| HEADLESS MODE |=====");
+
+        // Load profile
+        json profile = json::object();
+        if (!std::filesystem::is_regular_file(profilePath)) {
+            flog::error("Headless profile {0} does not exist", profilePath);
+            return -1;
+        }
+        try {
+            std::ifstream file(profilePath);
+            file >> profile;
+            file.close();
+        }
+        catch (const std::exception& e) {
+            flog::error("Could not load headless profile {0}: {1}", profilePath, e.what());
+            return -1;
+        }
+        if (!profile.is_object()) {
+            flog::error("Headless profile {0} is not a JSON object", profilePath);
+            return -1;
+        }
+
+        // Load config, the profile takes precedence over it but is never written to it
+        core::configManager.acquire();
+        std::string modulesDir = core::configManager.conf["modulesDirectory"];
+        std::vector<std::string> modules = core::configManager.conf["modules"];
+        json modList = profile.contains("moduleInstances") ? profile["moduleInstances"] : core::configManager.conf["moduleInstances"];
+        std::string sourceName = profile.contains("source") ? profile["source"] : core::configManager.conf["source"];
+        double frequency = profile.contains("frequency") ? profile["frequency"] : core::configManager.conf["frequency"];
+        vfoOffsets = profile.contains("vfoOffsets") ? profile["vfoOffsets"] : core::configManager.conf["vfoOffsets"];
+        int decimationPower = core::configManager.conf["decimationPower"];
+        bool iqCorrection = core::configManager.conf["iqCorrection"];
+        bool invertIQ = core::configManager.conf["invertIQ"];
+        int channelizerThreshold = core::configManager.conf["channelizerThreshold"];
+        int channelizerChannels = core::configManager.conf["channelizerChannels"];
+        core::configManager.release();
+        modulesDir = std::filesystem::absolute(modulesDir).string();
+
+        // Initialize SmGui in server mode so that module menus are never drawn
+        SmGui::init(true);
+
+        // Set default values for waterfall in case no source init's it, it is only used to keep the tuning state
+        gui::waterfall.setBandwidth(8000000);
+        gui::waterfall.setViewBandwidth(8000000);
+
+        // Init DSP without the FFT since nothing displays it
+        sigpath::iqFrontEnd.init(&dummyStream, 8000000, true, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL, NULL, NULL, NULL, NULL);
+        sigpath::iqFrontEnd.start();
+
+        vfoCreatedHandler.handler = vfoAddedHandler;
+        vfoCreatedHandler.ctx = NULL;
+        sigpath::vfoManager.onVfoCreated.bindHandler(&vfoCreatedHandler);
+
+        flog::info("Loading modules");
+        if (std::filesystem::is_directory(modulesDir)) {
+            for (const auto& file : std::filesystem::directory_iterator(modulesDir)) {
+                std::string path = file.path().generic_string();
+                if (file.path().extension().generic_string() != SDRPP_MOD_EXTENTSION) {
+                    continue;
+                }
+                if (!file.is_regular_file()) { continue; }
+                flog::info("Loading {0}", path);
+                core::moduleManager.loadModule(path);
+            }
+        }
+        else {
+            flog::warn("Module directory {0} does not exist, not loading modules from directory", modulesDir);
+        }
+
+        // Load additional modules specified through config
+        for (auto const& path : modules) {
+            std::string apath = std::filesystem::absolute(path).string();
+            flog::info("Loading {0}", apath);
+            core::moduleManager.loadModule(apath);
+        }
+
+        // Create module instances
+        for (auto const& [name, _module] : modList.items()) {
+            if (!_module.contains("module") || !_module["module"].is_string()) {
+                flog::error("Module instance {0} is missing module key", name);
+                continue;
+            }
+            std::string mod = _module["module"];
+            bool enabled = _module.contains("enabled") ? (bool)_module["enabled"] : true;
+            if (core::moduleManager.modules.find(mod) == core::moduleManager.modules.end()) {
+                flog::error("Module {0} for instance {1} is not loaded", mod, name);
+                continue;
+            }
+            flog::info("Initializing {0} ({1})", name, mod);
+            core::moduleManager.createInstance(name, mod);
+            if (!enabled) { core::moduleManager.disableInstance(name); }
+        }
+
+        // Configure the front end and sinks the way the source and sink menus would
+        sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
+        sigpath::iqFrontEnd.setInvertIQ(invertIQ);
+        sigpath::iqFrontEnd.setChannelizerThreshold(channelizerThreshold);
+        sigpath::iqFrontEnd.setChannelizerChannels(channelizerChannels);
+        core::configManager.acquire();
+        sigpath::sinkManager.loadSinksFromConfig();
+        core::configManager.release();
+
+        // Select the source
+        auto sources = sigpath::sourceManager.getSourceNames();
+        if (sources.empty()) {
+            flog::error("No source module is loaded");
+            return -1;
+        }
+        if (std::find(sources.begin(), sources.end(), sourceName) == sources.end()) {
+            flog::warn("Source {0} is not available, using {1} instead", sourceName, sources[0]);
+            sourceName = sources[0];
+        }
+        sigpath::sourceManager.selectSource(sourceName);
+        sigpath::iqFrontEnd.setDecimation(1 << decimationPower);
+
+        gui::waterfall.setCenterFrequency(frequency);
+        sigpath::sourceManager.tune(frequency);
+
+        core::moduleManager.doPostInitAll();
+
+        // Stop cleanly on Ctrl+C or when killed by a service manager
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+
+        // Start the source the way the play button does so that modules see the same state
+        gui::mainWindow.setPlayState(true);
+        if (profile.contains("startCommands")) { callCommands(profile["startCommands"]); }
+
+        flog::info("Ready, running {0} at {1} Hz", sourceName, frequency);
+        while (!stopRequested) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+
+        flog::info("Stopping");
+        if (profile.contains("stopCommands")) { callCommands(profile["stopCommands"]); }
+        gui::mainWindow.setPlayState(false);
+
+        // Shut down all modules
+        for (auto& [name, mod] : core::moduleManager.modules) {
+            mod.end();
+        }
+
+        sigpath::iqFrontEnd.stop();
+
+        dsp::fft::stopPlanCache();
+
+        core::configManager.disableAutoSave();
+        core::configManager.save();
+
+        flog::info("Exiting successfully");
+        return 0;
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+
+namespace headless {
+    // Run the source, VFOs and modules without any GUI until SIGINT or SIGTERM is received.
+    // The profile is a JSON file selecting what to run, see headless.cpp for its keys.
+    int main(std::string profilePath);
+}
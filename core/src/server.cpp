@@ -8,72 +8,109 @@
 #include <signal_path/signal_path.h>
 #include <gui/smgui.h>
 #include <utils/optionlist.h>
-#include "dsp/compression/sample_stream_compressor.h"
+#include "server_compression.h"
 #include "dsp/sink/handler_sink.h"
-#include <zstd.h>
+#include "dsp/channel/rx_vfo.h"
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <utils/spectrum_pyramid.h>
+
+// Maximum number of baseband buffers waiting for the compression worker before the oldest ones are dropped
+#define SERVER_FRAME_QUEUE_SIZE     16
+
+// Samples of int16 in one zstd job of a multi-threaded frame, the queued buffers are merged up to one job per thread
+#define SERVER_BATCH_JOB_SAMPLES    ((SERVER_COMPRESSION_MT_MIN_SIZE / 2) / 4)
+
+// Maximum number of VFOs a single client can have
+#define SERVER_MAX_VFOS_PER_CLIENT  16
+
+// Maximum number of values in a spectrum frame
+#define SERVER_MAX_FFT_COUNT        65536
 
 namespace server {
+    // VFO computed on the server for a client, only its output is sent
+    struct RemoteVFO {
+        ClientSession* session;
+        uint32_t id;
+        std::string name;
+        dsp::channel::RxVFO* vfo;
+        dsp::sink::Handler<dsp::complex_t> sink;
+        std::atomic<dsp::compression::PCMType> pcmType;
+        std::atomic<int> compressionLevel;
+        Encoder encoder;
+    };
+
     dsp::stream<dsp::complex_t> dummyInput;
-    dsp::compression::SampleStreamCompressor comp;
-    dsp::sink::Handler<uint8_t> hnd;
-    net::Conn client;
-    uint8_t* rbuf = NULL;
-    uint8_t* sbuf = NULL;
-    uint8_t* bbuf = NULL;
-
-    PacketHeader* r_pkt_hdr = NULL;
-    uint8_t* r_pkt_data = NULL;
-    CommandHeader* r_cmd_hdr = NULL;
-    uint8_t* r_cmd_data = NULL;
-
-    PacketHeader* s_pkt_hdr = NULL;
-    uint8_t* s_pkt_data = NULL;
-    CommandHeader* s_cmd_hdr = NULL;
-    uint8_t* s_cmd_data = NULL;
-
-    PacketHeader* bb_pkt_hdr = NULL;
-    uint8_t* bb_pkt_data = NULL;
+    dsp::stream<dsp::complex_t> basebandStream;
+    dsp::sink::Handler<dsp::complex_t> hnd;
+
+    // VFOs of each client, only accessed while holding cmdMtx
+    std::map<ClientSession*, std::map<uint32_t, RemoteVFO*>> remoteVFOs;
+
+    // Spectrum requested by a client
+    struct RemoteFFT {
+        FFTParams params;
+        std::chrono::steady_clock::time_point lastFrame;
+    };
+
+    // Spectrum shared by all clients. The FFT size is the one of the server's config and only runs while a
+    // client wants it. The line is kept in a pyramid to cut out each client's window quickly.
+    std::mutex fftMtx;
+    std::map<ClientSession*, RemoteFFT> remoteFFTs;
+    std::vector<float> fftBuffer;
+    SpectrumPyramid fftLine;
+    int fftSize = 65536;
+    std::vector<float> fftZoomBuf;
+
+    // Connected clients. Commands from all clients and everything touching the shared source or SmGui is
+    // serialized by cmdMtx, which must be taken before clientsMtx when both are needed.
+    std::mutex clientsMtx;
+    std::vector<std::shared_ptr<ClientSession>> clients;
+    std::recursive_mutex cmdMtx;
+    int nextClientId = 0;
+    int maxClients = 8;
+
+    // Baseband buffers handed from the DSP thread to the compression worker
+    std::mutex frameMtx;
+    std::condition_variable frameCnd;
+    std::deque<std::vector<dsp::complex_t>> frames;
+    std::vector<std::vector<dsp::complex_t>> freeFrames;
+    std::atomic<bool> anyBaseband = false;
+    uint64_t framesDropped = 0;
+    std::thread compWorkerThread;
+    int compressionThreads = 1;
 
     SmGui::DrawListElem dummyElem;
 
-    ZSTD_CCtx* cctx;
-
     net::Listener listener;
 
     OptionList<std::string, std::string> sourceList;
     int sourceId = 0;
     bool running = false;
-    bool compression = false;
-    double sampleRate = 1000000.0;
+    std::atomic<double> sampleRate = 1000000.0;
 
     int main() {
         flog::info("=====| SERVER MODE |=====");
 
-        // Init DSP
-        comp.init(&dummyInput, dsp::compression::PCM_TYPE_I8);
-        hnd.init(&comp.out, _testServerHandler, NULL);
-        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        comp.start();
+        // Init DSP. The IQ frontend runs without decimation, it splits the baseband between the clients, the VFOs
+        // and the FFT when a client asks for it. The baseband is encoded off the DSP thread by the compression worker.
+        core::configManager.acquire();
+        fftSize = core::configManager.conf["fftSize"];
+        core::configManager.release();
+        fftBuffer.resize(fftSize);
+        fftLine.init(fftSize, 1, SPECTRUM_QUANT_FLOAT);
+        sigpath::iqFrontEnd.init(&dummyInput, sampleRate, false, 1, false, fftSize, 20.0, IQFrontEnd::FFTWindow::NUTTALL, _acquireFFTBuffer, _releaseFFTBuffer, _getFFTHoldBuffer, NULL);
+        sigpath::iqFrontEnd.setFFTEnabled(false);
+        sigpath::iqFrontEnd.bindIQStream(&basebandStream);
+        hnd.init(&basebandStream, _basebandHandler, NULL);
+        sigpath::iqFrontEnd.start();
         hnd.start();
-
-        // Initialize headers
-        r_pkt_hdr = (PacketHeader*)rbuf;
-        r_pkt_data = &rbuf[sizeof(PacketHeader)];
-        r_cmd_hdr = (CommandHeader*)r_pkt_data;
-        r_cmd_data = &rbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        s_pkt_hdr = (PacketHeader*)sbuf;
-        s_pkt_data = &sbuf[sizeof(PacketHeader)];
-        s_cmd_hdr = (CommandHeader*)s_pkt_data;
-        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        bb_pkt_hdr = (PacketHeader*)bbuf;
-        bb_pkt_data = &bbuf[sizeof(PacketHeader)];
-
-        // Initialize compressor
-        cctx = ZSTD_createCCtx();
+        maxClients = std::max<int>((int)core::args["max-clients"], 1);
+        compressionThreads = core::args["compression-threads"];
+        if (compressionThreads <= 0) { compressionThreads = std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, 8); }
+        compWorkerThread = std::thread(_compressionWorker);
 
         // Load config
         core::configManager.acquire();
@@ -154,16 +191,28 @@ namespace server {
         listener = net::listen(host, port);
         listener->acceptAsync(_clientHandler, NULL);
 
-        flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        flog::info("Ready, listening on {0}:{1} for up to {2} clients", host, port, maxClients);
+        while(1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            _cleanupClients();
+        }
 
         return 0;
     }
 
     void _clientHandler(net::Conn conn, void* ctx) {
-        // Reject if someone else is already connected
-        if (client && client->isOpen()) {
-            flog::info("REJECTED Connection from {0}:{1}, another client is already connected.", "TODO", "TODO");
+        // Make room for the new client if some have left
+        _cleanupClients();
+
+        int count;
+        {
+            std::lock_guard<std::mutex> lck(clientsMtx);
+            count = clients.size();
+        }
+
+        // Reject if the server is full
+        if (count >= maxClients) {
+            flog::info("REJECTED Connection, {0} clients are already connected.", count);
             
             // Issue a disconnect command to the client
             uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
@@ -178,81 +227,406 @@ namespace server {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
             conn->close();
-
-            flog::info("Closing the open client...");
-            client->close();
-            client = {};
             
             // Start another async accept
             listener->acceptAsync(_clientHandler, NULL);
             return;
         }
 
-        flog::info("Connection from {0}:{1}", "TODO", "TODO");
-        client = std::move(conn);
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        auto session = std::make_shared<ClientSession>(std::move(conn), nextClientId++);
+        flog::info("Client {0} connected ({1}/{2})", session->id, count + 1, maxClients);
+        {
+            std::lock_guard<std::mutex> lck(clientsMtx);
+            clients.push_back(session);
+        }
+        session->conn->readAsync(sizeof(PacketHeader), session->rbuf, _packetHandler, session.get());
 
-        // Perform settings reset
-        sigpath::sourceManager.stop();
-        comp.setPCMType(dsp::compression::PCM_TYPE_I16);
-        compression = false;
+        // New clients start with the default settings and the current samplerate, the source is left alone
+        // since other clients may be using it
+        {
+            std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+            sendSampleRate(session.get(), sampleRate);
+        }
 
-        sendSampleRate(sampleRate);
+        listener->acceptAsync(_clientHandler, NULL);
+    }
 
-        // TODO: Wait otherwise someone else could connect
+    void _cleanupClients() {
+        // Remove the clients that are gone
+        std::vector<std::shared_ptr<ClientSession>> closed;
+        {
+            std::lock_guard<std::mutex> lck(clientsMtx);
+            for (auto it = clients.begin(); it != clients.end();) {
+                if ((*it)->isOpen() && !(*it)->closeRequested) {
+                    it++;
+                    continue;
+                }
+                closed.push_back(*it);
+                it = clients.erase(it);
+            }
+        }
+        if (closed.empty()) { return; }
+
+        // Their VFOs go first. The connections are closed without holding the command lock since that waits for
+        // their read thread, which may be waiting for the lock itself.
+        {
+            std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+            std::lock_guard<std::mutex> lck2(fftMtx);
+            for (auto& session : closed) {
+                session->closeRequested = true;
+                removeVFOs(session.get());
+                remoteFFTs.erase(session.get());
+            }
+        }
+        for (auto& session : closed) {
+            session->close();
+            flog::info("Client {0} removed, {1} sample packets were dropped for it", session->id, session->getDropped());
+        }
 
-        listener->acceptAsync(_clientHandler, NULL);
+        // Stop the source and FFT if nobody is using them anymore
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+        updateSourceState();
+        updateFFTState();
     }
 
     void _packetHandler(int count, uint8_t* buf, void* ctx) {
+        ClientSession* session = (ClientSession*)ctx;
         PacketHeader* hdr = (PacketHeader*)buf;
 
-        // Read the rest of the data (TODO: CHECK SIZE OR SHIT WILL BE FUCKED + ADD TIMEOUT)
+        // Refuse sizes that don't fit the buffer, the stream can't be resynchronized after that (TODO: ADD TIMEOUT)
+        if (hdr->size < sizeof(PacketHeader) || hdr->size > SERVER_MAX_PACKET_SIZE) {
+            flog::error("Client {0} sent a packet of invalid size {1}", session->id, hdr->size);
+            session->closeRequested = true;
+            return;
+        }
+
+        // Read the rest of the data
         int len = 0;
         int read = 0;
         int goal = hdr->size - sizeof(PacketHeader);
         while (len < goal) {
-            read = client->read(goal - len, &buf[sizeof(PacketHeader) + len]);
+            read = session->conn->read(goal - len, &buf[sizeof(PacketHeader) + len]);
             if (read < 0) { return; };
             len += read;
         }
 
         // Parse and process
-        if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
-            CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
-            commandHandler((Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
-        }
-        else {
-            sendError(ERROR_INVALID_PACKET);
+        {
+            std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+            if (session->closeRequested) { return; }
+            if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
+                CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+                commandHandler(session, (Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            }
+            else {
+                sendError(session, ERROR_INVALID_PACKET);
+            }
         }
 
         // Start another async read
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        session->conn->readAsync(sizeof(PacketHeader), session->rbuf, _packetHandler, session);
     }
 
-    void _testServerHandler(uint8_t* data, int count, void* ctx) {
-        // Compress data if needed and fill out header fields
-        if (compression) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + (uint32_t)ZSTD_compressCCtx(cctx, &bbuf[sizeof(PacketHeader)], SERVER_MAX_PACKET_SIZE-sizeof(PacketHeader), data, count, 1);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx) {
+        if (!anyBaseband) { return; }
+
+        // Reuse a buffer that was already sent
+        std::vector<dsp::complex_t> frame;
+        {
+            std::lock_guard<std::mutex> lck(frameMtx);
+            if (!freeFrames.empty()) {
+                frame = std::move(freeFrames.back());
+                freeFrames.pop_back();
+            }
         }
-        else {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-            memcpy(&bbuf[sizeof(PacketHeader)], data, count);
+        frame.assign(data, data + count);
+
+        // Queue it for the compression worker, dropping the oldest buffer if it can't keep up
+        {
+            std::lock_guard<std::mutex> lck(frameMtx);
+            if (frames.size() >= SERVER_FRAME_QUEUE_SIZE) {
+                freeFrames.push_back(std::move(frames.front()));
+                frames.pop_front();
+                if (!(framesDropped++ % 100)) {
+                    flog::warn("Compression can't keep up with the samplerate, {0} buffers dropped so far", framesDropped);
+                }
+            }
+            frames.push_back(std::move(frame));
+        }
+        frameCnd.notify_all();
+    }
+
+    void _compressionWorker() {
+        Encoder encoder(compressionThreads);
+        std::vector<std::shared_ptr<ClientSession>> subscribers;
+        std::map<int, SharedPacket> encoded;
+        std::vector<std::vector<dsp::complex_t>> batch;
+        size_t batchSize = std::min<size_t>((size_t)compressionThreads * SERVER_BATCH_JOB_SAMPLES, STREAM_BUFFER_SIZE);
+
+        while (true) {
+            // Wait for samples
+            std::vector<dsp::complex_t> frame;
+            {
+                std::unique_lock<std::mutex> lck(frameMtx);
+                frameCnd.wait(lck, []() { return !frames.empty(); });
+                frame = std::move(frames.front());
+                frames.pop_front();
+
+                // Baseband buffers are usually too small to be split between the zstd threads. Once the worker is
+                // behind, the buffers that queued up are encoded as one so that every thread gets a job. Nothing
+                // waits for more buffers, so this adds no latency.
+                size_t size = frame.size();
+                while (compressionThreads > 1 && !frames.empty() && size < batchSize && size + frames.front().size() <= STREAM_BUFFER_SIZE) {
+                    size += frames.front().size();
+                    batch.push_back(std::move(frames.front()));
+                    frames.pop_front();
+                }
+            }
+
+            // Merge outside of the lock to not hold up the DSP thread
+            if (!batch.empty()) {
+                for (auto& b : batch) { frame.insert(frame.end(), b.begin(), b.end()); }
+                std::lock_guard<std::mutex> lck(frameMtx);
+                for (auto& b : batch) { freeFrames.push_back(std::move(b)); }
+                batch.clear();
+            }
+
+            {
+                std::lock_guard<std::mutex> lck(clientsMtx);
+                subscribers = clients;
+            }
+
+            // Encode once per combination of settings and share the result between the clients using it
+            encoded.clear();
+            double duration = frame.size() / sampleRate;
+            for (auto& session : subscribers) {
+                if (!session->streaming || !session->baseband) { continue; }
+                EncoderSettings settings = { session->pcmType, session->compressionLevel, session->preprocessing };
+                if (session->autoCompression) {
+                    session->rateController.configure(settings.pcmType, settings.preprocessing, session->targetBitrate);
+                    settings = session->rateController.getSettings();
+                }
+                auto it = encoded.find(settings.key());
+                if (it == encoded.end()) {
+                    PacketType type = settings.level ? PACKET_TYPE_BASEBAND_COMPRESSED : PACKET_TYPE_BASEBAND;
+                    it = encoded.emplace(settings.key(), encoder.encodePacket(type, NULL, 0, frame.data(), frame.size(), settings)).first;
+                }
+                if (!it->second) { continue; }
+                session->send(it->second, true);
+
+                // Follow the link of clients in automatic mode
+                if (!session->autoCompression) { continue; }
+                if (session->rateController.update(it->second->size(), duration, session->getDropped(), session->getSent())) {
+                    settings = session->rateController.getSettings();
+                    flog::info("Client {0} baseband now {1} bit at zstd level {2} ({3} kbit/s measured)", session->id, 8 << settings.pcmType, settings.level, (int)(session->rateController.getBitrate() / 1000.0));
+                }
+            }
+            subscribers.clear();
+
+            // Give the buffer back to the DSP thread
+            {
+                std::lock_guard<std::mutex> lck(frameMtx);
+                freeFrames.push_back(std::move(frame));
+            }
+        }
+    }
+
+    void _vfoHandler(dsp::complex_t* data, int count, void* ctx) {
+        RemoteVFO* rvfo = (RemoteVFO*)ctx;
+        if (!rvfo->session->streaming) { return; }
+
+        // VFOs are narrow enough to be encoded directly on their own DSP thread
+        VFOHeader vhdr;
+        vhdr.id = rvfo->id;
+        EncoderSettings settings = { rvfo->pcmType, rvfo->compressionLevel, dsp::compression::PREPROCESS_NONE };
+        vhdr.compressed = settings.level;
+        SharedPacket pkt = rvfo->encoder.encodePacket(PACKET_TYPE_VFO, &vhdr, sizeof(vhdr), data, count, settings);
+        if (pkt) { rvfo->session->send(pkt, true); }
+    }
+
+    float* _acquireFFTBuffer(void* ctx) {
+        return fftBuffer.data();
+    }
+
+    void _releaseFFTBuffer(void* ctx) {
+        std::lock_guard<std::mutex> lck(fftMtx);
+        fftLine.push(fftBuffer.data());
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& [session, fft] : remoteFFTs) {
+            // Send at the rate of the client, the FFT runs at the fastest rate requested
+            if (!session->streaming) { continue; }
+            if (now - fft.lastFrame < std::chrono::duration<double>(0.95 / fft.params.rate)) { continue; }
+            fft.lastFrame = now;
+            SharedPacket pkt = encodeFFT(fft.params);
+            if (pkt) { session->send(pkt, true); }
+        }
+    }
+
+    float* _getFFTHoldBuffer(void* ctx, bool min) {
+        return NULL;
+    }
+
+    SharedPacket encodeFFT(const FFTParams& params) {
+        // Cut the window of the client out of the spectrum, its bins don't have to match those of the server
+        double ratio = (double)fftSize / (double)params.bins;
+        fftZoomBuf.resize(params.count);
+        fftLine.zoom(0, params.start * ratio, params.width * ratio, params.count, fftZoomBuf.data());
+
+        // Quantize relative to the range of the window
+        float min = INFINITY;
+        float max = -INFINITY;
+        for (float v : fftZoomBuf) {
+            if (v == -INFINITY) { continue; }
+            min = std::min<float>(min, v);
+            max = std::max<float>(max, v);
+        }
+        if (min > max) { return NULL; }
+        float step = std::max<float>((max - min) / 254.0f, 0.001f);
+
+        auto pkt = std::make_shared<std::vector<uint8_t>>(sizeof(PacketHeader) + sizeof(FFTHeader) + params.count);
+        PacketHeader* hdr = (PacketHeader*)pkt->data();
+        FFTHeader* fhdr = (FFTHeader*)&(*pkt)[sizeof(PacketHeader)];
+        uint8_t* data = &(*pkt)[sizeof(PacketHeader) + sizeof(FFTHeader)];
+        hdr->type = PACKET_TYPE_FFT;
+        hdr->size = pkt->size();
+        fhdr->bins = params.bins;
+        fhdr->start = params.start;
+        fhdr->width = params.width;
+        fhdr->count = params.count;
+        fhdr->min = min;
+        fhdr->step = step;
+        for (int i = 0; i < params.count; i++) {
+            float v = fftZoomBuf[i];
+            data[i] = (v == -INFINITY) ? 0 : (uint8_t)std::clamp<int>(roundf((v - min) / step) + 1, 1, 255);
         }
 
-        // Write to network
-        if (client && client->isOpen()) { client->write(bb_pkt_hdr->size, bbuf); }
+        return pkt;
+    }
+
+    bool checkFFTParams(const FFTParams& params) {
+        if (!params.enabled) { return true; }
+        if (!params.bins || !params.width || !params.count || params.count > params.width || params.count > SERVER_MAX_FFT_COUNT) { return false; }
+        if ((uint64_t)params.start + params.width > params.bins) { return false; }
+        return params.rate > 0.0f && params.rate <= 200.0f;
+    }
+
+    void updateFFTState() {
+        // Run the FFT as fast as the fastest client wants it, and only if one does
+        float rate = 0.0f;
+        {
+            std::lock_guard<std::mutex> lck(fftMtx);
+            for (auto& [session, fft] : remoteFFTs) {
+                rate = std::max<float>(rate, fft.params.rate);
+            }
+        }
+        if (rate > 0.0f) { sigpath::iqFrontEnd.setFFTRate(rate); }
+        sigpath::iqFrontEnd.setFFTEnabled(rate > 0.0f);
     }
 
     void setInput(dsp::stream<dsp::complex_t>* stream) {
-        comp.setInput(stream);
+        sigpath::iqFrontEnd.setInput(stream);
+    }
+
+    bool checkVFOParams(const VFOParams& params) {
+        double inSr = sigpath::iqFrontEnd.getEffectiveSamplerate();
+        if (params.sampleType > dsp::compression::PCM_TYPE_F32) { return false; }
+        if (params.compression > SERVER_MAX_COMPRESSION_LEVEL) { return false; }
+        if (params.sampleRate <= 0 || params.sampleRate > inSr) { return false; }
+        if (params.bandwidth <= 0 || params.bandwidth > params.sampleRate) { return false; }
+        return fabs(params.offset) <= inSr / 2.0;
+    }
+
+    Error addVFO(ClientSession* session, const VFOParams& params) {
+        auto& vfos = remoteVFOs[session];
+        if (vfos.find(params.id) != vfos.end() || vfos.size() >= SERVER_MAX_VFOS_PER_CLIENT || !checkVFOParams(params)) {
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        RemoteVFO* rvfo = new RemoteVFO;
+        rvfo->session = session;
+        rvfo->id = params.id;
+        rvfo->name = "Client " + std::to_string(session->id) + " VFO " + std::to_string(params.id);
+        rvfo->vfo = sigpath::iqFrontEnd.addVFO(rvfo->name, params.sampleRate, params.bandwidth, params.offset);
+        if (!rvfo->vfo) {
+            delete rvfo;
+            return ERROR_INVALID_ARGUMENT;
+        }
+        rvfo->pcmType = (dsp::compression::PCMType)params.sampleType;
+        rvfo->compressionLevel = params.compression;
+        rvfo->sink.init(&rvfo->vfo->out, _vfoHandler, rvfo);
+        rvfo->sink.start();
+        vfos[params.id] = rvfo;
+
+        flog::info("Client {0} added VFO {1} ({2} Hz offset, {3} S/s)", session->id, params.id, params.offset, params.sampleRate);
+        return ERROR_NONE;
+    }
+
+    Error updateVFO(ClientSession* session, const VFOParams& params) {
+        auto& vfos = remoteVFOs[session];
+        auto it = vfos.find(params.id);
+        if (it == vfos.end() || !checkVFOParams(params)) { return ERROR_INVALID_ARGUMENT; }
+
+        RemoteVFO* rvfo = it->second;
+        rvfo->pcmType = (dsp::compression::PCMType)params.sampleType;
+        rvfo->compressionLevel = params.compression;
+        rvfo->vfo->setOutSamplerate(params.sampleRate, params.bandwidth);
+        rvfo->vfo->setOffset(params.offset);
+        return ERROR_NONE;
+    }
+
+    void removeVFO(RemoteVFO* rvfo) {
+        // The sink has to stop reading before the VFO is deleted
+        rvfo->sink.stop();
+        sigpath::iqFrontEnd.removeVFO(rvfo->name);
+        delete rvfo;
+    }
+
+    Error removeVFO(ClientSession* session, uint32_t id) {
+        auto& vfos = remoteVFOs[session];
+        auto it = vfos.find(id);
+        if (it == vfos.end()) { return ERROR_INVALID_ARGUMENT; }
+        removeVFO(it->second);
+        vfos.erase(it);
+        return ERROR_NONE;
+    }
+
+    void removeVFOs(ClientSession* session) {
+        auto it = remoteVFOs.find(session);
+        if (it == remoteVFOs.end()) { return; }
+        for (auto& [id, rvfo] : it->second) {
+            removeVFO(rvfo);
+        }
+        remoteVFOs.erase(it);
+    }
+
+    void updateSourceState() {
+        bool streaming = false;
+        bool baseband = false;
+        {
+            std::lock_guard<std::mutex> lck(clientsMtx);
+            for (auto& session : clients) {
+                if (!session->streaming) { continue; }
+                streaming = true;
+                if (session->baseband) { baseband = true; }
+            }
+        }
+        anyBaseband = baseband;
+
+        // The source runs as long as at least one client wants samples
+        if (streaming && !running) {
+            sigpath::sourceManager.start();
+            running = true;
+        }
+        else if (!streaming && running) {
+            sigpath::sourceManager.stop();
+            running = false;
+        }
     }
 
-    void commandHandler(Command cmd, uint8_t* data, int len) {
+    void commandHandler(ClientSession* session, Command cmd, uint8_t* data, int len) {
         if (cmd == COMMAND_GET_UI) {
-            sendUI(COMMAND_GET_UI, "", dummyElem);
+            sendUI(session, COMMAND_GET_UI, "", dummyElem);
         }
         else if (cmd == COMMAND_UI_ACTION && len >= 3) {
             // Check if sending back data is needed
@@ -263,48 +637,93 @@ namespace server {
             // Load id
             SmGui::DrawListElem diffId;
             int count = SmGui::DrawList::loadItem(diffId, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
-            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(ERROR_INVALID_ARGUMENT); return; } 
+            if (count < 0) { sendError(session, ERROR_INVALID_ARGUMENT); return; }
+            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(session, ERROR_INVALID_ARGUMENT); return; } 
             i += count;
             len -= count;
 
             // Load value
             SmGui::DrawListElem diffValue;
             count = SmGui::DrawList::loadItem(diffValue, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            if (count < 0) { sendError(session, ERROR_INVALID_ARGUMENT); return; }
             i += count;
             len -= count;
 
             // Render and send back
             if (sendback) {
-                sendUI(COMMAND_UI_ACTION, diffId.str, diffValue);
+                sendUI(session, COMMAND_UI_ACTION, diffId.str, diffValue);
             }
             else {
                 renderUI(NULL, diffId.str, diffValue);
             }
         }
         else if (cmd == COMMAND_START) {
-            sigpath::sourceManager.start();
-            running = true;
+            session->streaming = true;
+            updateSourceState();
         }
         else if (cmd == COMMAND_STOP) {
-            sigpath::sourceManager.stop();
-            running = false;
+            session->streaming = false;
+            updateSourceState();
         }
         else if (cmd == COMMAND_SET_FREQUENCY && len == 8) {
+            // The tuner is shared, the last client to tune wins
             sigpath::sourceManager.tune(*(double*)data);
-            sendCommandAck(COMMAND_SET_FREQUENCY, 0);
+            session->sendCommandAck(COMMAND_SET_FREQUENCY, 0);
         }
         else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1) {
             dsp::compression::PCMType type = (dsp::compression::PCMType)*(uint8_t*)data;
-            comp.setPCMType(type);
+            if (type > dsp::compression::PCM_TYPE_F32) { sendError(session, ERROR_INVALID_ARGUMENT); return; }
+            session->pcmType = type;
         }
         else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
-            compression = *(uint8_t*)data;
+            session->compressionLevel = *(uint8_t*)data ? SERVER_DEFAULT_COMPRESSION_LEVEL : 0;
+            session->preprocessing = dsp::compression::PREPROCESS_NONE;
+            session->autoCompression = false;
+        }
+        else if (cmd == COMMAND_SET_COMPRESSION && len == sizeof(CompressionParams)) {
+            CompressionParams params;
+            memcpy(&params, data, sizeof(CompressionParams));
+            if (params.level > SERVER_MAX_COMPRESSION_LEVEL || (params.preprocessing & ~dsp::compression::PREPROCESS_ALL)) {
+                sendError(session, ERROR_INVALID_ARGUMENT);
+                return;
+            }
+            session->compressionLevel = params.level;
+            session->preprocessing = params.preprocessing;
+            session->targetBitrate = params.targetBitrate * 1000.0;
+            session->autoCompression = params.automatic;
+        }
+        else if ((cmd == COMMAND_ADD_VFO || cmd == COMMAND_UPDATE_VFO) && len == sizeof(VFOParams)) {
+            VFOParams params;
+            memcpy(&params, data, sizeof(VFOParams));
+            session->s_cmd_data[0] = (cmd == COMMAND_ADD_VFO) ? addVFO(session, params) : updateVFO(session, params);
+            session->sendCommandAck(cmd, 1);
+        }
+        else if (cmd == COMMAND_REMOVE_VFO && len == sizeof(uint32_t)) {
+            session->s_cmd_data[0] = removeVFO(session, *(uint32_t*)data);
+            session->sendCommandAck(cmd, 1);
+        }
+        else if (cmd == COMMAND_SET_FFT && len == sizeof(FFTParams)) {
+            FFTParams params;
+            memcpy(&params, data, sizeof(FFTParams));
+            if (!checkFFTParams(params)) { sendError(session, ERROR_INVALID_ARGUMENT); return; }
+            {
+                std::lock_guard<std::mutex> lck(fftMtx);
+                if (params.enabled) {
+                    remoteFFTs[session].params = params;
+                }
+                else {
+                    remoteFFTs.erase(session);
+                }
+            }
+            updateFFTState();
+        }
+        else if (cmd == COMMAND_SET_BASEBAND && len == 1) {
+            session->baseband = *(uint8_t*)data;
+            updateSourceState();
         }
         else {
             flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
-            sendError(ERROR_INVALID_COMMAND);
+            sendError(session, ERROR_INVALID_COMMAND);
         }
     }
 
@@ -343,49 +762,38 @@ namespace server {
         }
     }
 
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
+    void sendUI(ClientSession* session, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
         // Render UI
         SmGui::DrawList dl;
         renderUI(&dl, diffId, diffValue);
 
         // Create response
         int size = dl.getSize();
-        dl.store(s_cmd_data, size);
+        dl.store(session->s_cmd_data, size);
 
         // Send to network
-        sendCommandAck(originCmd, size);
+        session->sendCommandAck(originCmd, size);
     }
 
-    void sendError(Error err) {
-        PacketHeader* hdr = (PacketHeader*)sbuf;
-        s_pkt_data[0] = err;
-        sendPacket(PACKET_TYPE_ERROR, 1);
+    void sendError(ClientSession* session, Error err) {
+        session->s_pkt_data[0] = err;
+        session->sendPacket(PACKET_TYPE_ERROR, 1);
     }
 
-    void sendSampleRate(double sampleRate) {
-        *(double*)s_cmd_data = sampleRate;
-        sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
+    void sendSampleRate(ClientSession* session, double sampleRate) {
+        *(double*)session->s_cmd_data = sampleRate;
+        session->sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
     }
 
     void setInputSampleRate(double samplerate) {
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         sampleRate = samplerate;
-        if (!client || !client->isOpen()) { return; }
-        sendSampleRate(sampleRate);
-    }
-
-    void sendPacket(PacketType type, int len) {
-        s_pkt_hdr->type = type;
-        s_pkt_hdr->size = sizeof(PacketHeader) + len;
-        client->write(s_pkt_hdr->size, sbuf);
-    }
+        sigpath::iqFrontEnd.setSampleRate(sampleRate);
 
-    void sendCommand(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
-    }
-
-    void sendCommandAck(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+        // All clients share the source so they all need to know
+        std::lock_guard<std::mutex> lck2(clientsMtx);
+        for (auto& session : clients) {
+            sendSampleRate(session.get(), sampleRate);
+        }
     }
-}
+}
\ No newline at end of file
@@ -3,25 +3,41 @@
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <server_protocol.h>
+#include <server_session.h>
 
 namespace server {
     void setInput(dsp::stream<dsp::complex_t>* stream);
     int main();
 
     void _clientHandler(net::Conn conn, void* ctx);
+    void _cleanupClients();
     void _packetHandler(int count, uint8_t* buf, void* ctx);
-    void _testServerHandler(uint8_t* data, int count, void* ctx);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx);
+    void _compressionWorker();
+    void _vfoHandler(dsp::complex_t* data, int count, void* ctx);
 
+    struct RemoteVFO;
+    bool checkVFOParams(const VFOParams& params);
+    Error addVFO(ClientSession* session, const VFOParams& params);
+    Error updateVFO(ClientSession* session, const VFOParams& params);
+    Error removeVFO(ClientSession* session, uint32_t id);
+    void removeVFO(RemoteVFO* rvfo);
+    void removeVFOs(ClientSession* session);
+
+    float* _acquireFFTBuffer(void* ctx);
+    void _releaseFFTBuffer(void* ctx);
+    float* _getFFTHoldBuffer(void* ctx, bool min);
+    SharedPacket encodeFFT(const FFTParams& params);
+    bool checkFFTParams(const FFTParams& params);
+    void updateFFTState();
+
+    void updateSourceState();
     void drawMenu();
 
-    void commandHandler(Command cmd, uint8_t* data, int len);
+    void commandHandler(ClientSession* session, Command cmd, uint8_t* data, int len);
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendError(Error err);
-    void sendSampleRate(double sampleRate);
+    void sendUI(ClientSession* session, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
+    void sendError(ClientSession* session, Error err);
+    void sendSampleRate(ClientSession* session, double sampleRate);
     void setInputSampleRate(double samplerate);
-
-    void sendPacket(PacketType type, int len);
-    void sendCommand(Command cmd, int len);
-    void sendCommandAck(Command cmd, int len);
 }
@@ -0,0 +1,210 @@
+#include "server_compression.h"
+#include <dsp/compression/sample_stream_compressor.h>
+#include <utils/flog.h>
+#include <algorithm>
+#include <math.h>
+
+// Levels of each sample type tried by the rate controller
+#define RATE_CONTROLLER_LEVELS          { 1, 3, 7 }
+
+// Time over which the bitrate is measured
+#define RATE_CONTROLLER_INTERVAL        1.0
+
+// Bounds of the time to wait before trying a better step after the last change
+#define RATE_CONTROLLER_MIN_HOLD        2.0
+#define RATE_CONTROLLER_MAX_HOLD        60.0
+
+// Fraction of the target bitrate a better step must be expected to stay under
+#define RATE_CONTROLLER_HEADROOM        0.9
+
+namespace server {
+    Encoder::Encoder(int threads) : threads(threads) {
+        cctx = ZSTD_createCCtx();
+    }
+
+    Encoder::~Encoder() {
+        ZSTD_freeCCtx(cctx);
+        delete[] pcmBuf;
+        delete[] encBuf;
+    }
+
+    size_t Encoder::encode(const dsp::complex_t* data, int count, const EncoderSettings& settings, uint8_t* out, size_t outSize) {
+        count = std::min<int>(count, STREAM_BUFFER_SIZE);
+        reserve(count);
+        size_t size = dsp::compression::SampleStreamCompressor::process(count, settings.pcmType, data, pcmBuf, settings.preprocessing);
+
+        // Send as is if not compressed
+        if (!settings.level) {
+            if (size > outSize) { return 0; }
+            memcpy(out, pcmBuf, size);
+            return size;
+        }
+
+        configure(settings.level, size);
+        size_t compSize = ZSTD_compress2(cctx, out, outSize, pcmBuf, size);
+        if (ZSTD_isError(compSize)) {
+            flog::error("Failed to compress samples: {0}", ZSTD_getErrorName(compSize));
+            return 0;
+        }
+        return compSize;
+    }
+
+    SharedPacket Encoder::encodePacket(PacketType type, const void* prefix, int prefixLen, const dsp::complex_t* data, int count, const EncoderSettings& settings) {
+        reserve(count);
+        size_t size = encode(data, count, settings, encBuf, maxEncodedSize(bufCount));
+        if (!size) { return NULL; }
+
+        // Copy to a packet of the exact size since it stays queued for as long as the slowest client needs
+        int offset = sizeof(PacketHeader) + prefixLen;
+        auto pkt = std::make_shared<std::vector<uint8_t>>(offset + size);
+        PacketHeader* hdr = (PacketHeader*)pkt->data();
+        hdr->type = type;
+        hdr->size = pkt->size();
+        if (prefixLen) { memcpy(&(*pkt)[sizeof(PacketHeader)], prefix, prefixLen); }
+        memcpy(&(*pkt)[offset], encBuf, size);
+
+        return pkt;
+    }
+
+    size_t Encoder::maxEncodedSize(int count) {
+        return ZSTD_compressBound((std::min<int>(count, STREAM_BUFFER_SIZE) * sizeof(dsp::complex_t)) + 8);
+    }
+
+    void Encoder::reserve(int count) {
+        // Grow to the largest buffer seen so that narrow streams such as VFOs don't need room for a whole baseband buffer
+        count = std::min<int>(count, STREAM_BUFFER_SIZE);
+        if (count <= bufCount) { return; }
+        delete[] pcmBuf;
+        delete[] encBuf;
+        pcmBuf = new uint8_t[count * sizeof(dsp::complex_t) + 8];
+        encBuf = new uint8_t[maxEncodedSize(count)];
+        bufCount = count;
+    }
+
+    void Encoder::configure(int level, size_t size) {
+        if (level != curLevel) {
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+            curLevel = level;
+        }
+
+        // Split large buffers between the worker threads, small ones aren't worth the synchronisation
+        int workers = 0;
+        if (threads > 1 && mtSupported && size >= SERVER_COMPRESSION_MT_MIN_SIZE) {
+            workers = std::min<int>(threads, size / (SERVER_COMPRESSION_MT_MIN_SIZE / 2));
+        }
+        if (workers != curWorkers) {
+            if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers))) {
+                flog::warn("zstd was built without multithreading support, compressing on a single thread");
+                mtSupported = false;
+                workers = 0;
+                ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, 0);
+            }
+            curWorkers = workers;
+            curJobSize = 0;
+        }
+        if (!workers) { return; }
+
+        // One job per worker
+        size_t jobSize = (size + workers - 1) / workers;
+        if (jobSize != curJobSize) {
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_jobSize, jobSize);
+            curJobSize = jobSize;
+        }
+    }
+
+    void RateController::configure(dsp::compression::PCMType maxType, int preprocessing, double targetBitrate) {
+        if (maxType == this->maxType && preprocessing == this->preprocessing && targetBitrate == this->targetBitrate) { return; }
+        this->maxType = maxType;
+        this->preprocessing = preprocessing;
+        this->targetBitrate = targetBitrate;
+
+        // Every level of every sample type from the best one allowed down to int8
+        steps.clear();
+        for (int type = maxType; type >= dsp::compression::PCM_TYPE_I8; type--) {
+            for (int level : RATE_CONTROLLER_LEVELS) {
+                steps.push_back({ { (dsp::compression::PCMType)type, level, preprocessing }, 0.0 });
+            }
+        }
+        step = 0;
+        linkCapacity = 0.0;
+        started = false;
+        probing = false;
+        holdTime = RATE_CONTROLLER_MIN_HOLD;
+    }
+
+    bool RateController::update(size_t size, double duration, uint64_t dropped, uint64_t sent) {
+        auto now = std::chrono::steady_clock::now();
+        if (!started) {
+            intervalStart = now;
+            lastChange = now;
+            lastDropped = dropped;
+            lastSent = sent;
+            intervalSize = 0;
+            intervalDuration = 0.0;
+            started = true;
+        }
+        intervalSize += size;
+        intervalDuration += duration;
+
+        double elapsed = std::chrono::duration<double>(now - intervalStart).count();
+        if (elapsed < RATE_CONTROLLER_INTERVAL || intervalDuration <= 0.0) { return false; }
+
+        // Bitrate needed to send the samples in real time, and what the link did
+        bitrate = (intervalSize * 8.0) / intervalDuration;
+        steps[step].bitrate = bitrate;
+        bool congested = (dropped != lastDropped);
+        double linkRate = ((sent - lastSent) * 8.0) / elapsed;
+        intervalStart = now;
+        intervalSize = 0;
+        intervalDuration = 0.0;
+        lastDropped = dropped;
+        lastSent = sent;
+
+        // Packets of the previous step can still be dropped while the queue of the session drains after going down
+        double held = std::chrono::duration<double>(now - lastChange).count();
+        if (!probing && held < 2.0 * RATE_CONTROLLER_INTERVAL) { congested = false; }
+        int last = steps.size() - 1;
+        if (congested || (targetBitrate > 0.0 && bitrate > targetBitrate)) {
+            if (step == last) { return false; }
+
+            // A better step that failed right away is tried less often
+            if (probing && held < holdTime) { holdTime = std::min<double>(holdTime * 2.0, RATE_CONTROLLER_MAX_HOLD); }
+            probing = false;
+
+            // Skip the steps that are known not to fit
+            if (congested) { linkCapacity = linkRate; }
+            double limit = (targetBitrate > 0.0) ? targetBitrate : linkRate;
+            if (congested && targetBitrate > 0.0) { limit = std::min<double>(limit, linkRate); }
+            int next = step + 1;
+            while (next < last && estimate(next) > limit) { next++; }
+            setStep(next, now);
+            return true;
+        }
+
+        // Stable for long enough, the hold time goes back down
+        if (held > 4.0 * holdTime) {
+            holdTime = std::max<double>(holdTime / 2.0, RATE_CONTROLLER_MIN_HOLD);
+        }
+        if (!step || held < holdTime) { return false; }
+        if (targetBitrate > 0.0 && estimate(step - 1) > targetBitrate * RATE_CONTROLLER_HEADROOM) { return false; }
+
+        // A step that doesn't fit in what the link did when it was last saturated is only tried once in a while
+        if (linkCapacity > 0.0 && estimate(step - 1) > linkCapacity * RATE_CONTROLLER_HEADROOM && held < RATE_CONTROLLER_MAX_HOLD) { return false; }
+        probing = true;
+        setStep(step - 1, now);
+        return true;
+    }
+
+    double RateController::estimate(int i) {
+        if (steps[i].bitrate > 0.0) { return steps[i].bitrate; }
+
+        // Scale the current bitrate by the size of the samples
+        static const double sampleSize[] = { 1.0, 2.0, 4.0 };
+        return bitrate * sampleSize[steps[i].settings.pcmType] / sampleSize[steps[step].settings.pcmType];
+    }
+
+    void RateController::setStep(int i, std::chrono::steady_clock::time_point now) {
+        step = i;
+        lastChange = now;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <server_protocol.h>
+#include <dsp/types.h>
+#include <dsp/compression/pcm_type.h>
+#include <dsp/compression/preprocessing.h>
+#include <zstd.h>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+// zstd level used by clients that only turn compression on
+#define SERVER_DEFAULT_COMPRESSION_LEVEL    1
+
+// Highest zstd level a client can ask for, the higher ones are too slow for any useful samplerate
+#define SERVER_MAX_COMPRESSION_LEVEL        19
+
+// Buffers at least this large are split between the zstd worker threads, in chunks of at least half of it
+#define SERVER_COMPRESSION_MT_MIN_SIZE      (1024 * 1024)
+
+namespace server {
+    typedef std::shared_ptr<const std::vector<uint8_t>> SharedPacket;
+
+    // How a buffer of samples is encoded
+    struct EncoderSettings {
+        dsp::compression::PCMType pcmType;
+        int level;          // zstd level, 0 for no compression
+        int preprocessing;  // dsp::compression::Preprocessing flags
+
+        // Unique for each combination, used to share the encoded buffers between clients
+        int key() const { return (level << 8) | (preprocessing << 4) | pcmType; }
+
+        bool operator==(const EncoderSettings& b) const { return key() == b.key(); }
+        bool operator!=(const EncoderSettings& b) const { return key() != b.key(); }
+    };
+
+    // Encodes buffers of samples in the format of SampleStreamCompressor and compresses them with zstd. Large buffers
+    // are compressed as multi-threaded zstd frames, which the usual single-threaded decoder reads just the same.
+    class Encoder {
+    public:
+        // Up to threads threads are used for large buffers, with 0 or 1 everything runs on the calling thread.
+        // The buffers are sized on first use from the number of samples encoded.
+        Encoder(int threads = 0);
+        ~Encoder();
+
+        // Encode count samples to out. Returns the size of the encoded data or 0 on failure.
+        size_t encode(const dsp::complex_t* data, int count, const EncoderSettings& settings, uint8_t* out, size_t outSize);
+
+        // Encode count samples to a packet, after a prefix of prefixLen bytes. Returns NULL on failure.
+        SharedPacket encodePacket(PacketType type, const void* prefix, int prefixLen, const dsp::complex_t* data, int count, const EncoderSettings& settings);
+
+        // Largest size encode() can output for count samples
+        static size_t maxEncodedSize(int count);
+
+    private:
+        void reserve(int count);
+        void configure(int level, size_t size);
+
+        uint8_t* pcmBuf = NULL;
+        uint8_t* encBuf = NULL;
+        int bufCount = 0;
+        ZSTD_CCtx* cctx;
+        int threads;
+        bool mtSupported = true;
+        int curLevel = -1;
+        int curWorkers = -1;
+        size_t curJobSize = 0;
+    };
+
+    // Picks the sample type and zstd level of the baseband of a client so that it fits in its link. The settings go
+    // through steps of decreasing bitrate, from the best sample type the client asked for at the lowest level down to
+    // int8 at the highest level. The bitrate is measured every second. With a target bitrate, the steps are taken to
+    // stay under it. Packets dropped by the session mean the link is saturated, what it managed is then remembered and
+    // a better step is tried after a hold time that doubles every time the link couldn't take it.
+    class RateController {
+    public:
+        // Restarts from the best step when the parameters changed. The target is in bits per second, 0 to follow the link.
+        void configure(dsp::compression::PCMType maxType, int preprocessing, double targetBitrate);
+
+        // Account for a buffer encoded with the current settings, duration being that of its samples in seconds.
+        // dropped and sent are the totals of the session. Returns true when the settings changed.
+        bool update(size_t size, double duration, uint64_t dropped, uint64_t sent);
+
+        EncoderSettings getSettings() { return steps[step].settings; }
+
+        // Last measured bitrate in bits per second
+        double getBitrate() { return bitrate; }
+
+    private:
+        struct Step {
+            EncoderSettings settings;
+            double bitrate;     // Last measured, 0 if never used
+        };
+
+        double estimate(int i);
+        void setStep(int i, std::chrono::steady_clock::time_point now);
+
+        std::vector<Step> steps = { { { dsp::compression::PCM_TYPE_I16, SERVER_DEFAULT_COMPRESSION_LEVEL, dsp::compression::PREPROCESS_NONE }, 0.0 } };
+        int step = 0;
+        dsp::compression::PCMType maxType = dsp::compression::PCM_TYPE_F32;
+        int preprocessing = -1;
+        double targetBitrate = 0.0;
+
+        double bitrate = 0.0;
+        double linkCapacity = 0.0;  // What the link managed when it was last saturated, 0 if never
+        size_t intervalSize = 0;
+        double intervalDuration = 0.0;
+        uint64_t lastDropped = 0;
+        uint64_t lastSent = 0;
+        bool started = false;
+        std::chrono::steady_clock::time_point intervalStart;
+        std::chrono::steady_clock::time_point lastChange;
+        double holdTime;
+        bool probing = false;
+    };
+}
@@ -27,6 +27,11 @@ namespace server {
         COMMAND_GET_SAMPLERATE,
         COMMAND_SET_SAMPLE_TYPE,
         COMMAND_SET_COMPRESSION,
+        COMMAND_ADD_VFO,
+        COMMAND_UPDATE_VFO,
+        COMMAND_REMOVE_VFO,
+        COMMAND_SET_BASEBAND,
+        COMMAND_SET_FFT,
 
         // Server to client
         COMMAND_SET_SAMPLERATE = 0x80,
@@ -49,5 +54,55 @@ namespace server {
     struct CommandHeader {
         uint32_t cmd;
     };
+
+    // Argument of COMMAND_ADD_VFO and COMMAND_UPDATE_VFO, COMMAND_REMOVE_VFO only takes the ID. The ID is chosen by
+    // the client, the acks of the three commands contain a single byte Error code.
+    struct VFOParams {
+        uint32_t id;
+        uint8_t sampleType;
+        uint8_t compression;    // zstd level, 0 for none
+        double offset;
+        double sampleRate;
+        double bandwidth;
+    };
+
+    // Precedes the samples of a PACKET_TYPE_VFO packet, they are in the same format as baseband packets and
+    // compressed with zstd if compressed is not zero
+    struct VFOHeader {
+        uint32_t id;
+        uint32_t compressed;
+    };
+    // Argument of COMMAND_SET_COMPRESSION, which also takes a single byte to turn compression on or off at the default
+    // level with no preprocessing. In automatic mode, the server picks the sample type, from the one set with
+    // COMMAND_SET_SAMPLE_TYPE down to int8, and the level to keep the baseband under targetBitrate, or under what
+    // the link manages when it is zero.
+    struct CompressionParams {
+        uint8_t level;          // zstd level, 0 for none
+        uint8_t preprocessing;  // dsp::compression::Preprocessing flags
+        uint8_t automatic;
+        uint32_t targetBitrate; // kbit/s
+    };
+
+    // Argument of COMMAND_SET_FFT. The client describes its spectrum as bins spanning the whole bandwidth, of which
+    // only [start, start + width) is visible, and asks for the visible part reduced to count values.
+    struct FFTParams {
+        uint8_t enabled;
+        uint32_t bins;
+        uint32_t start;
+        uint32_t width;
+        uint32_t count;
+        float rate;
+    };
+
+    // Precedes the count bytes of a PACKET_TYPE_FFT packet. Each byte is a power of min + (value - 1) * step dB,
+    // zero meaning no data. The other fields are those of the request the frame was made for.
+    struct FFTHeader {
+        uint32_t bins;
+        uint32_t start;
+        uint32_t width;
+        uint32_t count;
+        float min;
+        float step;
+    };
 #pragma pack(pop)
 }
\ No newline at end of file
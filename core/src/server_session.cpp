@@ -0,0 +1,102 @@
+#include "server_session.h"
+#include <utils/flog.h>
+
+namespace server {
+    ClientSession::ClientSession(net::Conn conn, int id) : id(id) {
+        this->conn = std::move(conn);
+
+        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        s_pkt_hdr = (PacketHeader*)sbuf;
+        s_pkt_data = &sbuf[sizeof(PacketHeader)];
+        s_cmd_hdr = (CommandHeader*)s_pkt_data;
+        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+
+        workerThread = std::thread(&ClientSession::sendWorker, this);
+    }
+
+    ClientSession::~ClientSession() {
+        close();
+        delete[] rbuf;
+        delete[] sbuf;
+    }
+
+    void ClientSession::close() {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            stopWorker = true;
+        }
+        queueCnd.notify_all();
+
+        // Closing the connection first unblocks a write stuck on a slow link
+        if (conn) { conn->close(); }
+        if (workerThread.joinable()) { workerThread.join(); }
+    }
+
+    bool ClientSession::isOpen() {
+        return conn && conn->isOpen();
+    }
+
+    void ClientSession::send(SharedPacket pkt, bool droppable) {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (stopWorker) { return; }
+
+            // Drop the oldest samples to keep the latency bounded when the link can't keep up
+            if (droppable && droppableCount >= SERVER_SESSION_QUEUE_SIZE) {
+                for (auto it = queue.begin(); it != queue.end(); it++) {
+                    if (!it->droppable) { continue; }
+                    queue.erase(it);
+                    droppableCount--;
+                    dropped++;
+                    break;
+                }
+            }
+
+            queue.push_back({ pkt, droppable });
+            if (droppable) { droppableCount++; }
+        }
+        queueCnd.notify_all();
+    }
+
+    void ClientSession::sendPacket(PacketType type, int len) {
+        s_pkt_hdr->type = type;
+        s_pkt_hdr->size = sizeof(PacketHeader) + len;
+        send(std::make_shared<const std::vector<uint8_t>>(sbuf, sbuf + s_pkt_hdr->size), false);
+    }
+
+    void ClientSession::sendCommand(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::sendCommandAck(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::sendWorker() {
+        while (true) {
+            // Wait for a packet
+            QueueEntry entry;
+            {
+                std::unique_lock<std::mutex> lck(queueMtx);
+                queueCnd.wait(lck, [this]() { return !queue.empty() || stopWorker; });
+                if (stopWorker) { return; }
+                entry = queue.front();
+                queue.pop_front();
+                if (entry.droppable) { droppableCount--; }
+            }
+
+            // Send it, a write error means the client is gone
+            if (!conn->write(entry.pkt->size(), (uint8_t*)entry.pkt->data())) {
+                flog::info("Client {0} disconnected", id);
+                std::lock_guard<std::mutex> lck(queueMtx);
+                stopWorker = true;
+                queue.clear();
+                return;
+            }
+            sent += entry.pkt->size();
+        }
+    }
+}
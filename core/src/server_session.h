@@ -0,0 +1,89 @@
+#pragma once
+#include <utils/networking.h>
+#include <dsp/stream.h>
+#include <server_protocol.h>
+#include <server_compression.h>
+#include <dsp/compression/pcm_type.h>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+// Maximum number of sample packets waiting to be sent to a client before the oldest ones are dropped
+#define SERVER_SESSION_QUEUE_SIZE   64
+
+namespace server {
+    // State of one connected client. Packets are queued and sent by a thread of the session so that a slow link
+    // only ever delays its own client. Sample packets are dropped, oldest first, when the queue is full while
+    // control packets (acks, UI, sample rate) are always sent and in order.
+    class ClientSession {
+    public:
+        ClientSession(net::Conn conn, int id);
+        ~ClientSession();
+
+        void close();
+        bool isOpen();
+
+        // Queue a packet that is shared with other clients
+        void send(SharedPacket pkt, bool droppable);
+
+        // Queue a packet built in the send buffer (sbuf)
+        void sendPacket(PacketType type, int len);
+        void sendCommand(Command cmd, int len);
+        void sendCommandAck(Command cmd, int len);
+
+        uint64_t getDropped() { return dropped; }
+
+        // Bytes written to the connection so far
+        uint64_t getSent() { return sent; }
+
+        const int id;
+        net::Conn conn;
+
+        // Receive buffer, only used by the read thread of the connection
+        uint8_t* rbuf = NULL;
+
+        // Send buffer, only used while holding the command lock of the server
+        uint8_t* sbuf = NULL;
+        PacketHeader* s_pkt_hdr = NULL;
+        uint8_t* s_pkt_data = NULL;
+        CommandHeader* s_cmd_hdr = NULL;
+        uint8_t* s_cmd_data = NULL;
+
+        // Samples requested by the client. The baseband can be turned off by clients only using VFOs.
+        std::atomic<bool> streaming = false;
+        std::atomic<bool> baseband = true;
+        std::atomic<dsp::compression::PCMType> pcmType = dsp::compression::PCM_TYPE_I16;
+
+        // Compression of the baseband. In automatic mode, the sample type and level are chosen by the rate controller,
+        // which is only used by the compression worker of the server.
+        std::atomic<int> compressionLevel = 0;
+        std::atomic<int> preprocessing = 0;
+        std::atomic<bool> autoCompression = false;
+        std::atomic<double> targetBitrate = 0.0;
+        RateController rateController;
+
+        // Set when the client sent something invalid, the connection can't be closed from its own read thread
+        std::atomic<bool> closeRequested = false;
+
+    private:
+        struct QueueEntry {
+            SharedPacket pkt;
+            bool droppable;
+        };
+
+        void sendWorker();
+
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        std::deque<QueueEntry> queue;
+        int droppableCount = 0;
+        bool stopWorker = false;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<uint64_t> sent = 0;
+        std::thread workerThread;
+    };
+}
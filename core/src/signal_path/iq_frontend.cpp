@@ -1,4 +1,5 @@
 #include "iq_frontend.h"
+#include "../dsp/window/rectangular.h"
 #include "../dsp/window/blackman.h"
 #include "../dsp/window/nuttall.h"
 #include <utils/flog.h>
@@ -8,13 +9,9 @@
 IQFrontEnd::~IQFrontEnd() {
     if (!_init) { return; }
     stop();
-    dsp::buffer::free(fftWindowBuf);
-    fftwf_destroy_plan(fftwPlan);
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
 }
 
-void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx) {
+void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), float* (*getFFTHoldBuffer)(void* ctx, bool min), void* fftCtx) {
     _sampleRate = sampleRate;
     _decimRatio = decimRatio;
     _fftSize = fftSize;
@@ -22,6 +19,7 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
     _fftWindow = fftWindow;
     _acquireFFTBuffer = acquireFFTBuffer;
     _releaseFFTBuffer = releaseFFTBuffer;
+    _getFFTHoldBuffer = getFFTHoldBuffer;
     _fftCtx = fftCtx;
 
     effectiveSr = _sampleRate / _decimRatio;
@@ -40,31 +38,21 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     split.init(preproc.out);
 
-    // TODO: Do something to avoid basically repeating this code twice
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.init(&fftIn, fftSize, skip);
-    fftSink.init(&reshape.out, handler, this);
+    // Only bound to the splitter while channelized VFOs exist
+    channelizer.init(&channelizerIn, 256, effectiveSr);
 
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
-    if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 0; }
-    }
-    else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize); }
-    }
-    else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize); }
-    }
-
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
+    // The FFT is only computed when something consumes it, it isn't in headless mode
+    _fftEnabled = (acquireFFTBuffer != NULL);
+    spectrum.init(&fftIn, effectiveSr, _fftSize, _fftRate, getWindowFunction(_fftWindow), handler, this);
 
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
+    if (_fftEnabled) { split.bindStream(&fftIn); }
 
-    split.bindStream(&fftIn);
+    // Names shown in the performance menu
+    inBuf.setProfileName("IQ Buffer");
+    preproc.setProfileName("IQ Preprocessing");
+    split.setProfileName("IQ Splitter");
+    channelizer.setProfileName("Channelizer");
+    spectrum.setProfileName("Spectrum");
 
     _init = true;
 }
@@ -84,12 +72,13 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
     _sampleRate = sampleRate;
     effectiveSr = _sampleRate / _decimRatio;
     dcBlock.setRate(genDCBlockRate(effectiveSr));
+    channelizer.setSamplerate(effectiveSr);
     for (auto& [name, vfo] : vfos) {
         vfo->setInSamplerate(effectiveSr);
     }
 
     // Reconfigure the FFT
-    updateFFTPath();
+    spectrum.setSampleRate(effectiveSr);
 
     // Restart blocks
     dcBlock.tempStart();
@@ -144,9 +133,21 @@ dsp::channel::RxVFO* IQFrontEnd::addVFO(std::string name, double sampleRate, dou
         return NULL;
     }
 
+    // Past the threshold, serve the VFO from the channelizer. It'll use its own input stream
+    if (channelizerThreshold > 0 && vfos.size() >= channelizerThreshold) {
+        if (channelizedVFOs.empty()) { bindIQStream(&channelizerIn); }
+        dsp::channel::ChannelizedRxVFO* vfo = new dsp::channel::ChannelizedRxVFO(&split, &channelizer, effectiveSr, sampleRate, bandwidth, offset);
+        vfo->setProfileName("VFO " + name);
+        channelizedVFOs[name] = vfo;
+        vfos[name] = vfo;
+        vfo->start();
+        return vfo;
+    }
+
     // Create VFO and its input stream
     dsp::stream<dsp::complex_t>* vfoIn = new dsp::stream<dsp::complex_t>;
     dsp::channel::RxVFO* vfo = new dsp::channel::RxVFO(vfoIn, effectiveSr, sampleRate, bandwidth, offset);
+    vfo->setProfileName("VFO " + name);
 
     // Register them
     vfoStreams[name] = vfoIn;
@@ -166,6 +167,18 @@ void IQFrontEnd::removeVFO(std::string name) {
         return;
     }
 
+    // Channelized VFOs unbind their own input when deleted
+    if (channelizedVFOs.find(name) != channelizedVFOs.end()) {
+        dsp::channel::ChannelizedRxVFO* vfo = channelizedVFOs[name];
+        vfo->stop();
+        channelizedVFOs.erase(name);
+        vfos.erase(name);
+        detachedVFOs.erase(name);
+        delete vfo;
+        if (channelizedVFOs.empty()) { unbindIQStream(&channelizerIn); }
+        return;
+    }
+
     // Remove the VFO and stream from registry
     dsp::stream<dsp::complex_t>* vfoIn = vfoStreams[name];
     dsp::channel::RxVFO* vfo = vfos[name];
@@ -173,28 +186,117 @@ void IQFrontEnd::removeVFO(std::string name) {
     // Stop the VFO
     vfo->stop();
 
-    unbindIQStream(vfoIn);
+    // A detached VFO's input is already unbound
+    if (detachedVFOs.find(name) == detachedVFOs.end()) { unbindIQStream(vfoIn); }
     vfoStreams.erase(name);
     vfos.erase(name);
+    detachedVFOs.erase(name);
 
     // Delete the VFO and its input stream
     delete vfo;
     delete vfoIn;
 }
 
+void IQFrontEnd::detachVFO(std::string name) {
+    if (vfos.find(name) == vfos.end()) {
+        flog::error("[IQFrontEnd] Tried to detach a VFO that doesn't exist.");
+        return;
+    }
+    if (detachedVFOs.find(name) != detachedVFOs.end()) { return; }
+
+    // Channelized VFOs are bound to the channelizer or the splitter depending on their parameters
+    vfos[name]->stop();
+    if (channelizedVFOs.find(name) != channelizedVFOs.end()) {
+        channelizedVFOs[name]->setInputDetached(true);
+    }
+    else {
+        unbindIQStream(vfoStreams[name]);
+    }
+    detachedVFOs.insert(name);
+}
+
+void IQFrontEnd::attachVFO(std::string name) {
+    if (detachedVFOs.find(name) == detachedVFOs.end()) { return; }
+    if (channelizedVFOs.find(name) != channelizedVFOs.end()) {
+        channelizedVFOs[name]->setInputDetached(false);
+    }
+    else {
+        bindIQStream(vfoStreams[name]);
+    }
+    detachedVFOs.erase(name);
+    vfos[name]->start();
+}
+
+void IQFrontEnd::setChannelizerThreshold(int vfoCount) {
+    // Only affects VFOs created from now on
+    channelizerThreshold = vfoCount;
+}
+
+void IQFrontEnd::setChannelizerChannels(int channels) {
+    channelizer.setChannelCount(channels);
+
+    // The channel layout changed, let the VFOs pick their channel again
+    for (auto& [name, vfo] : channelizedVFOs) {
+        vfo->setInSamplerate(effectiveSr);
+    }
+}
+
+void IQFrontEnd::setFFTEnabled(bool enabled) {
+    if (!_acquireFFTBuffer || enabled == _fftEnabled) { return; }
+    _fftEnabled = enabled;
+
+    // The splitter must never write to the FFT input while the spectrum isn't reading it
+    if (_fftEnabled) {
+        spectrum.start();
+        split.bindStream(&fftIn);
+    }
+    else {
+        split.unbindStream(&fftIn);
+        spectrum.stop();
+    }
+}
+
 void IQFrontEnd::setFFTSize(int size) {
     _fftSize = size;
-    updateFFTPath(true);
+
+    // Lines of the new size must not reach the waterfall before it is resized
+    spectrum.tempStop();
+    spectrum.setFFTSize(_fftSize);
+
+    // Update waterfall (TODO: This is annoying, it makes this module non testable and will constantly clear the waterfall for any reason)
+    if (_fftEnabled) { gui::waterfall.setRawFFTSize(_fftSize); }
+
+    spectrum.tempStart();
 }
 
 void IQFrontEnd::setFFTRate(double rate) {
     _fftRate = rate;
-    updateFFTPath();
+    spectrum.setRate(_fftRate);
 }
 
 void IQFrontEnd::setFFTWindow(FFTWindow fftWindow) {
     _fftWindow = fftWindow;
-    updateFFTPath();
+    spectrum.setWindow(getWindowFunction(_fftWindow));
+}
+
+void IQFrontEnd::setFFTOverlap(double overlap) {
+    spectrum.setOverlap(overlap);
+}
+
+void IQFrontEnd::setFFTAveraging(int frames) {
+    spectrum.setAveraging(frames);
+}
+
+void IQFrontEnd::setFFTThreads(int count) {
+    spectrum.setWorkerCount(count);
+}
+
+void IQFrontEnd::setFFTHold(bool peak, bool min) {
+    spectrum.setHold(peak, min);
+}
+
+void IQFrontEnd::setFFTHoldSpeed(float speed) {
+    spectrum.setHoldSpeed(speed);
 }
 
 void IQFrontEnd::flushInputBuffer() {
@@ -208,17 +310,18 @@ void IQFrontEnd::start() {
     // Start pre-proc chain (automatically start all bound blocks)
     preproc.start();
 
-    // Start IQ splitter
+    // Start IQ splitter and channelizer
     split.start();
+    channelizer.start();
 
-    // Start all VFOs
+    // Start all VFOs, except those fed by something else
     for (auto& [name, vfo] : vfos) {
+        if (detachedVFOs.find(name) != detachedVFOs.end()) { continue; }
         vfo->start();
     }
 
-    // Start FFT chain
-    reshape.start();
-    fftSink.start();
+    // Start FFT
+    if (_fftEnabled) { spectrum.start(); }
 }
 
 void IQFrontEnd::stop() {
@@ -228,82 +331,46 @@ void IQFrontEnd::stop() {
     // Stop pre-proc chain (automatically start all bound blocks)
     preproc.stop();
 
-    // Stop IQ splitter
+    // Stop IQ splitter and channelizer
     split.stop();
+    channelizer.stop();
 
     // Stop all VFOs
     for (auto& [name, vfo] : vfos) {
         vfo->stop();
     }
 
-    // Stop FFT chain
-    reshape.stop();
-    fftSink.stop();
+    // Stop FFT
+    spectrum.stop();
 }
 
 double IQFrontEnd::getEffectiveSamplerate() {
     return effectiveSr;
 }
 
-void IQFrontEnd::handler(dsp::complex_t* data, int count, void* ctx) {
+void IQFrontEnd::handler(float* data, int size, void* ctx) {
     IQFrontEnd* _this = (IQFrontEnd*)ctx;
 
-    // Apply window
-    volk_32fc_32f_multiply_32fc((lv_32fc_t*)_this->fftInBuf, (lv_32fc_t*)data, _this->fftWindowBuf, _this->_nzFFTSize);
-
-    // Execute FFT
-    fftwf_execute(_this->fftwPlan);
-
     // Aquire buffer
     float* fftBuf = _this->_acquireFFTBuffer(_this->_fftCtx);
 
-    // Convert the complex output of the FFT to dB amplitude
+    // Copy the spectrum and hold
     if (fftBuf) {
-        volk_32fc_s32f_power_spectrum_32f(fftBuf, (lv_32fc_t*)_this->fftOutBuf, _this->_fftSize, _this->_fftSize);
+        memcpy(fftBuf, data, size * sizeof(float));
+        float* peakHold = _this->spectrum.getPeakHold();
+        float* peakHoldBuf = _this->_getFFTHoldBuffer(_this->_fftCtx, false);
+        if (peakHold && peakHoldBuf) { memcpy(peakHoldBuf, peakHold, size * sizeof(float)); }
+        float* minHold = _this->spectrum.getMinHold();
+        float* minHoldBuf = _this->_getFFTHoldBuffer(_this->_fftCtx, true);
+        if (minHold && minHoldBuf) { memcpy(minHoldBuf, minHold, size * sizeof(float)); }
     }
 
     // Release buffer
     _this->_releaseFFTBuffer(_this->_fftCtx);
 }
 
-void IQFrontEnd::updateFFTPath(bool updateWaterfall) {
-    // Temp stop branch
-    reshape.tempStop();
-    fftSink.tempStop();
-
-    // Update reshaper settings
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.setKeep(_nzFFTSize);
-    reshape.setSkip(skip);
-
-    // Update window
-    dsp::buffer::free(fftWindowBuf);
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
-    if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 1.0f * ((i % 2) ? -1.0f : 1.0f); }
-    }
-    else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
-    }
-    else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
-    }
-
-    // Update FFT plan
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
-
-    // Update waterfall (TODO: This is annoying, it makes this module non testable and will constantly clear the waterfall for any reason)
-    if (updateWaterfall) { gui::waterfall.setRawFFTSize(_fftSize); }
-
-    // Restart branch
-    reshape.tempStart();
-    fftSink.tempStart();
-}
\ No newline at end of file
+double (*IQFrontEnd::getWindowFunction(FFTWindow fftWindow))(double n, double N) {
+    if (fftWindow == FFTWindow::BLACKMAN) { return dsp::window::blackman; }
+    if (fftWindow == FFTWindow::NUTTALL) { return dsp::window::nuttall; }
+    return dsp::window::rectangular;
+}
@@ -1,14 +1,14 @@
 #pragma once
 #include "../dsp/buffer/frame_buffer.h"
-#include "../dsp/buffer/reshaper.h"
 #include "../dsp/multirate/power_decimator.h"
 #include "../dsp/correction/dc_blocker.h"
 #include "../dsp/chain.h"
 #include "../dsp/routing/splitter.h"
 #include "../dsp/channel/rx_vfo.h"
-#include "../dsp/sink/handler_sink.h"
+#include "../dsp/channel/channelized_rx_vfo.h"
 #include "../dsp/math/conjugate.h"
-#include <fftw3.h>
+#include "spectrum_engine.h"
+#include <set>
 
 class IQFrontEnd {
 public:
@@ -20,7 +20,7 @@ public:
         NUTTALL
     };
 
-    void init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx);
+    void init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), float* (*getFFTHoldBuffer)(void* ctx, bool min), void* fftCtx);
 
     void setInput(dsp::stream<dsp::complex_t>* in);
     void setSampleRate(double sampleRate);
@@ -37,9 +37,24 @@ public:
     dsp::channel::RxVFO* addVFO(std::string name, double sampleRate, double bandwidth, double offset);
     void removeVFO(std::string name);
 
+    // Stop a VFO and disconnect its input so that it can't hold up the others, for when its output is fed by
+    // something else. attachVFO() connects and starts it again.
+    void detachVFO(std::string name);
+    void attachVFO(std::string name);
+
+    void setChannelizerThreshold(int vfoCount);
+    void setChannelizerChannels(int channels);
+
+    // Only possible if FFT buffer callbacks were given to init()
+    void setFFTEnabled(bool enabled);
     void setFFTSize(int size);
     void setFFTRate(double rate);
     void setFFTWindow(FFTWindow fftWindow);
+    void setFFTOverlap(double overlap);
+    void setFFTAveraging(int frames);
+    void setFFTThreads(int count);
+    void setFFTHold(bool peak, bool min);
+    void setFFTHoldSpeed(float speed);
 
     void flushInputBuffer();
 
@@ -49,19 +64,13 @@ public:
     double getEffectiveSamplerate();
 
 protected:
-    static void handler(dsp::complex_t* data, int count, void* ctx);
-    void updateFFTPath(bool updateWaterfall = false);
+    static void handler(float* data, int size, void* ctx);
+    static double (*getWindowFunction(FFTWindow fftWindow))(double n, double N);
 
     static inline double genDCBlockRate(double sampleRate) {
         return 50.0 / sampleRate;
     }
 
-    static inline void genReshapeParams(double sampleRate, int size, double rate, int& skip, int& nzSampCount) {
-        int fftInterval = round(sampleRate / rate);
-        nzSampCount = std::min<int>(fftInterval, size);
-        skip = fftInterval - nzSampCount;
-    }
-
     // Input buffer
     dsp::buffer::SampleFrameBuffer<dsp::complex_t> inBuf;
 
@@ -76,12 +85,18 @@ protected:
 
     // FFT
     dsp::stream<dsp::complex_t> fftIn;
-    dsp::buffer::Reshaper<dsp::complex_t> reshape;
-    dsp::sink::Handler<dsp::complex_t> fftSink;
+    SpectrumEngine spectrum;
 
     // VFOs
     std::map<std::string, dsp::stream<dsp::complex_t>*> vfoStreams;
     std::map<std::string, dsp::channel::RxVFO*> vfos;
+    std::set<std::string> detachedVFOs;
+
+    // Channelizer, used for new VFOs once there are at least channelizerThreshold of them (0 means never)
+    dsp::stream<dsp::complex_t> channelizerIn;
+    dsp::channel::PFBChannelizer channelizer;
+    std::map<std::string, dsp::channel::ChannelizedRxVFO*> channelizedVFOs;
+    int channelizerThreshold = 0;
 
     // Parameters
     double _sampleRate;
@@ -91,14 +106,9 @@ protected:
     FFTWindow _fftWindow;
     float* (*_acquireFFTBuffer)(void* ctx);
     void (*_releaseFFTBuffer)(void* ctx);
+    float* (*_getFFTHoldBuffer)(void* ctx, bool min);
     void* _fftCtx;
-
-    // Processing data
-    int _nzFFTSize;
-    float* fftWindowBuf;
-    fftwf_complex *fftInBuf, *fftOutBuf;
-    fftwf_plan fftwPlan;
-    float* fftDbOut;
+    bool _fftEnabled = true;
 
     double effectiveSr;
 
@@ -0,0 +1,306 @@
+#include "spectrum_engine.h"
+
+SpectrumEngine::~SpectrumEngine() {
+    if (!base_type::_block_init) { return; }
+    base_type::stop();
+    destroy();
+}
+
+void SpectrumEngine::init(dsp::stream<dsp::complex_t>* in, double sampleRate, int fftSize, double rate, double (*window)(double n, double N), void (*handler)(float* data, int size, void* ctx), void* ctx) {
+    _sampleRate = sampleRate;
+    _fftSize = fftSize;
+    _rate = rate;
+    _window = window;
+    _handler = handler;
+    _ctx = ctx;
+    generate();
+    base_type::init(in);
+}
+
+void SpectrumEngine::setSampleRate(double sampleRate) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _sampleRate = sampleRate;
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setFFTSize(int size) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _fftSize = size;
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setRate(double rate) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _rate = rate;
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setWindow(double (*window)(double n, double N)) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _window = window;
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setOverlap(double overlap) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _overlap = std::clamp<double>(overlap, 0.0, 0.9);
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setAveraging(int frames) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _averaging = std::max<int>(frames, 1);
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setWorkerCount(int count) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    base_type::tempStop();
+    destroy();
+    _workerCount = std::max<int>(count, 1);
+    generate();
+    base_type::tempStart();
+}
+
+void SpectrumEngine::setHold(bool peak, bool min) {
+    std::lock_guard<std::mutex> lck(deliverMtx);
+    if ((peak && !_peakHold) || (min && !_minHold)) { holdValid = false; }
+    _peakHold = peak;
+    _minHold = min;
+}
+
+void SpectrumEngine::setHoldSpeed(float speed) {
+    std::lock_guard<std::mutex> lck(deliverMtx);
+    _holdSpeed = speed;
+}
+
+int SpectrumEngine::run() {
+    int count = base_type::_in->read();
+    if (count < 0) { return -1; }
+
+    // Skip what's left of the gap between the previous line and the next one
+    int offset = std::min<int>(skip, count);
+    skip -= offset;
+    pending.insert(pending.end(), &base_type::_in->readBuf[offset], &base_type::_in->readBuf[count]);
+    base_type::_in->flush();
+
+    // Dispatch all complete lines
+    int readPos = 0;
+    while (pending.size() - readPos >= lineSize) {
+        // Get a free buffer or drop the line if all workers are behind
+        dsp::complex_t* buf = NULL;
+        {
+            std::lock_guard<std::mutex> lck(jobMtx);
+            if (!freeBuffers.empty()) {
+                buf = freeBuffers.back();
+                freeBuffers.pop_back();
+            }
+        }
+        if (buf) {
+            memcpy(buf, &pending[readPos], lineSize * sizeof(dsp::complex_t));
+            {
+                std::lock_guard<std::mutex> lck(jobMtx);
+                jobs.push_back({ nextJobId++, buf });
+            }
+            jobCV.notify_one();
+        }
+        else {
+            droppedLines++;
+        }
+
+        // Move on to the start of the next line, it may not have been received yet
+        int consumed = std::min<int>(lineInterval, pending.size() - readPos);
+        skip = lineInterval - consumed;
+        readPos += consumed;
+    }
+    pending.erase(pending.begin(), pending.begin() + readPos);
+
+    return count;
+}
+
+void SpectrumEngine::doStart() {
+    base_type::doStart();
+    stopWorkers = false;
+    for (auto& w : workers) {
+        w->thread = std::thread(&SpectrumEngine::worker, this, w);
+    }
+}
+
+void SpectrumEngine::doStop() {
+    base_type::doStop();
+
+    // Stop the workers
+    {
+        std::lock_guard<std::mutex> lck(jobMtx);
+        std::lock_guard<std::mutex> lck2(deliverMtx);
+        stopWorkers = true;
+    }
+    jobCV.notify_all();
+    deliverCV.notify_all();
+    for (auto& w : workers) {
+        if (w->thread.joinable()) { w->thread.join(); }
+    }
+
+    // Drop everything that was in flight
+    for (auto& job : jobs) {
+        freeBuffers.push_back(job.samples);
+    }
+    jobs.clear();
+    nextJobId = 0;
+    nextDeliverId = 0;
+    pending.clear();
+    skip = 0;
+}
+
+void SpectrumEngine::generate() {
+    // Frames are never longer than the interval between lines, the rest of the FFT is zero padded
+    lineInterval = std::max<int>(round(_sampleRate / _rate), 1);
+    nzSize = std::min<int>(_fftSize, lineInterval);
+    hop = std::max<int>(round((double)nzSize * (1.0 - _overlap)), 1);
+    lineSize = ((_averaging - 1) * hop) + nzSize;
+
+    // Generate window, alternating the sign centers the spectrum
+    windowBuf = dsp::buffer::alloc<float>(nzSize);
+    for (int i = 0; i < nzSize; i++) {
+        windowBuf[i] = _window(i, nzSize) * ((i % 2) ? -1.0f : 1.0f);
+    }
+
+    // Allocate line buffers, one being computed by each worker and the rest waiting
+    int bufCount = _workerCount * (SPECTRUM_ENGINE_QUEUE_PER_WORKER + 1);
+    for (int i = 0; i < bufCount; i++) {
+        dsp::complex_t* buf = dsp::buffer::alloc<dsp::complex_t>(lineSize);
+        allBuffers.push_back(buf);
+        freeBuffers.push_back(buf);
+    }
+
+    // Create workers, each with their own plan
+    for (int i = 0; i < _workerCount; i++) {
+        Worker* w = new Worker;
+        w->fftIn = (dsp::complex_t*)fftwf_malloc(_fftSize * sizeof(dsp::complex_t));
+        w->fftOut = (dsp::complex_t*)fftwf_malloc(_fftSize * sizeof(dsp::complex_t));
+        w->plan.init(_fftSize, w->fftIn, w->fftOut);
+        w->power = dsp::buffer::alloc<float>(_fftSize);
+        w->frame = dsp::buffer::alloc<float>(_fftSize);
+        dsp::buffer::clear(w->fftIn, _fftSize);
+        workers.push_back(w);
+    }
+
+    // Allocate hold buffers
+    peakHold = dsp::buffer::alloc<float>(_fftSize);
+    minHold = dsp::buffer::alloc<float>(_fftSize);
+    holdValid = false;
+}
+
+void SpectrumEngine::destroy() {
+    dsp::buffer::free(windowBuf);
+    for (auto& buf : allBuffers) {
+        dsp::buffer::free(buf);
+    }
+    allBuffers.clear();
+    freeBuffers.clear();
+    for (auto& w : workers) {
+        fftwf_free(w->fftIn);
+        fftwf_free(w->fftOut);
+        dsp::buffer::free(w->power);
+        dsp::buffer::free(w->frame);
+        delete w;
+    }
+    workers.clear();
+    dsp::buffer::free(peakHold);
+    dsp::buffer::free(minHold);
+}
+
+void SpectrumEngine::worker(Worker* w) {
+    while (true) {
+        // Wait for a line to compute
+        Job job;
+        {
+            std::unique_lock<std::mutex> lck(jobMtx);
+            jobCV.wait(lck, [=]() { return !jobs.empty() || stopWorkers; });
+            if (stopWorkers) { return; }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        compute(w, job.samples);
+
+        // Release the samples before waiting for the previous lines to be delivered
+        {
+            std::lock_guard<std::mutex> lck(jobMtx);
+            freeBuffers.push_back(job.samples);
+        }
+
+        deliver(w, job.id);
+    }
+}
+
+void SpectrumEngine::compute(Worker* w, const dsp::complex_t* samples) {
+    // Sum the power of all frames
+    for (int i = 0; i < _averaging; i++) {
+        volk_32fc_32f_multiply_32fc((lv_32fc_t*)w->fftIn, (lv_32fc_t*)&samples[i * hop], windowBuf, nzSize);
+        w->plan.execute();
+        if (!i) {
+            volk_32fc_magnitude_squared_32f(w->power, (lv_32fc_t*)w->fftOut, _fftSize);
+            continue;
+        }
+        volk_32fc_magnitude_squared_32f(w->frame, (lv_32fc_t*)w->fftOut, _fftSize);
+        volk_32f_x2_add_32f(w->power, w->power, w->frame, _fftSize);
+    }
+
+    // Average and convert to dB, normalized the same way as the power spectrum of a single frame
+    volk_32f_s32f_multiply_32f(w->power, w->power, 1.0f / ((float)_averaging * (float)_fftSize * (float)_fftSize), _fftSize);
+    volk_32f_log2_32f(w->frame, w->power, _fftSize);
+    volk_32f_s32f_multiply_32f(w->frame, w->frame, 10.0f * log10f(2.0f), _fftSize);
+}
+
+void SpectrumEngine::deliver(Worker* w, uint64_t id) {
+    // Wait for the previous lines to be delivered
+    std::unique_lock<std::mutex> lck(deliverMtx);
+    deliverCV.wait(lck, [=]() { return nextDeliverId == id || stopWorkers; });
+    if (stopWorkers) { return; }
+
+    // Update hold
+    if (_peakHold || _minHold) {
+        if (!holdValid) {
+            memcpy(peakHold, w->frame, _fftSize * sizeof(float));
+            memcpy(minHold, w->frame, _fftSize * sizeof(float));
+            holdValid = true;
+        }
+        else {
+            for (int i = 0; i < _fftSize; i++) {
+                peakHold[i] = std::max<float>(w->frame[i], peakHold[i] - _holdSpeed);
+                minHold[i] = std::min<float>(w->frame[i], minHold[i] + _holdSpeed);
+            }
+        }
+    }
+
+    _handler(w->frame, _fftSize, _ctx);
+
+    nextDeliverId++;
+    deliverCV.notify_all();
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "../dsp/sink.h"
+#include "../dsp/buffer/buffer.h"
+#include "../dsp/fft/plan.h"
+#include <volk/volk.h>
+#include <atomic>
+#include <deque>
+
+// Number of lines allowed to wait for a worker, per worker, before new lines get dropped
+#define SPECTRUM_ENGINE_QUEUE_PER_WORKER    2
+
+// Computes the spectrum lines of the waterfall on a pool of worker threads, each with its own FFTW plan.
+// Each line is the linear power average of one or more overlapping frames. Lines are passed to the
+// handler in order, along with the peak and min hold that are updated before calling it.
+class SpectrumEngine : public dsp::Sink<dsp::complex_t> {
+    using base_type = dsp::Sink<dsp::complex_t>;
+public:
+    SpectrumEngine() {}
+
+    ~SpectrumEngine();
+
+    void init(dsp::stream<dsp::complex_t>* in, double sampleRate, int fftSize, double rate, double (*window)(double n, double N), void (*handler)(float* data, int size, void* ctx), void* ctx);
+
+    void setSampleRate(double sampleRate);
+    void setFFTSize(int size);
+    void setRate(double rate);
+    void setWindow(double (*window)(double n, double N));
+    void setOverlap(double overlap);
+    void setAveraging(int frames);
+    void setWorkerCount(int count);
+    void setHold(bool peak, bool min);
+    void setHoldSpeed(float speed);
+
+    // NOTE: Only valid from within the handler, NULL if disabled
+    inline float* getPeakHold() { return _peakHold ? peakHold : NULL; }
+    inline float* getMinHold() { return _minHold ? minHold : NULL; }
+
+    inline uint64_t getDroppedLines() { return droppedLines; }
+
+    int run();
+
+protected:
+    struct Job {
+        uint64_t id;
+        dsp::complex_t* samples;
+    };
+
+    struct Worker {
+        std::thread thread;
+        dsp::complex_t* fftIn;
+        dsp::complex_t* fftOut;
+        dsp::fft::Plan plan;
+        float* power;
+        float* frame;
+    };
+
+    void doStart() override;
+    void doStop() override;
+
+    void generate();
+    void destroy();
+    void worker(Worker* w);
+    void compute(Worker* w, const dsp::complex_t* samples);
+    void deliver(Worker* w, uint64_t id);
+
+    // Parameters
+    double _sampleRate;
+    int _fftSize;
+    double _rate;
+    double (*_window)(double n, double N);
+    double _overlap = 0.0;
+    int _averaging = 1;
+    int _workerCount = 1;
+    bool _peakHold = false;
+    bool _minHold = false;
+    float _holdSpeed = 0.0f;
+    void (*_handler)(float* data, int size, void* ctx);
+    void* _ctx;
+
+    // Framing
+    int nzSize;
+    int hop;
+    int lineInterval;
+    int lineSize;
+    float* windowBuf = NULL;
+    std::vector<dsp::complex_t> pending;
+    int skip = 0;
+
+    // Workers
+    std::vector<Worker*> workers;
+    std::mutex jobMtx;
+    std::condition_variable jobCV;
+    std::deque<Job> jobs;
+    std::vector<dsp::complex_t*> freeBuffers;
+    std::vector<dsp::complex_t*> allBuffers;
+    bool stopWorkers = false;
+    uint64_t nextJobId = 0;
+    std::atomic<uint64_t> droppedLines = 0;
+
+    // In order delivery
+    std::mutex deliverMtx;
+    std::condition_variable deliverCV;
+    uint64_t nextDeliverId = 0;
+    float* peakHold = NULL;
+    float* minHold = NULL;
+    bool holdValid = false;
+};
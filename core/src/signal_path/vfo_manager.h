@@ -55,6 +55,7 @@ public:
     std::string getName();
     int getReference(std::string name);
     bool vfoExists(std::string name);
+    VFOManager::VFO* getVFO(std::string name);
 
     void updateFromWaterfall(ImGui::WaterFall* wtf);
 
@@ -0,0 +1,192 @@
+#include "disk.h"
+#include <utils/flog.h>
+#include <string.h>
+#include <algorithm>
+#include <volk/volk.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace disk {
+    // Must be a multiple of the logical block size of any disk for direct IO
+    const size_t STAGING_SIZE       = 4 * 1024 * 1024;
+    const size_t STAGING_ALIGNMENT  = 4096;
+    const uint64_t PREALLOC_STEP    = 64 * 1024 * 1024;
+
+    Writer::~Writer() {
+        close();
+    }
+
+    bool Writer::open(std::string path, bool direct) {
+        close();
+
+#ifdef _WIN32
+        file = fopen(path.c_str(), "wb");
+        if (!file) { return false; }
+        this->direct = false;
+#else
+        // Try opening for direct IO first, some filesystems (tmpfs, some network filesystems) refuse it
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        fd = -1;
+#ifdef O_DIRECT
+        if (direct) { fd = ::open(path.c_str(), flags | O_DIRECT, 0644); }
+#endif
+        this->direct = (fd >= 0);
+        if (fd < 0) { fd = ::open(path.c_str(), flags, 0644); }
+        if (fd < 0) { return false; }
+#ifdef __APPLE__
+        // No O_DIRECT on MacOS, F_NOCACHE has the same effect
+        if (direct) { this->direct = (fcntl(fd, F_NOCACHE, 1) != -1); }
+#endif
+#endif
+
+        staging = (uint8_t*)volk_malloc(STAGING_SIZE, STAGING_ALIGNMENT);
+        staged = 0;
+        stagedPos = 0;
+        lastFlushPos = 0;
+        lastFlushLen = 0;
+        preallocated = 0;
+        canPreallocate = true;
+        return true;
+    }
+
+    bool Writer::isOpen() {
+#ifdef _WIN32
+        return file != NULL;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    void Writer::close() {
+        if (!isOpen()) { return; }
+
+        flushStaging(true);
+
+#ifdef _WIN32
+        fclose(file);
+        file = NULL;
+#else
+        ::close(fd);
+        fd = -1;
+#endif
+        volk_free(staging);
+        staging = NULL;
+    }
+
+    void Writer::write(const uint8_t* data, size_t len) {
+        if (!isOpen()) { return; }
+        while (len) {
+            size_t toCopy = std::min<size_t>(len, STAGING_SIZE - staged);
+            memcpy(&staging[staged], data, toCopy);
+            staged += toCopy;
+            data += toCopy;
+            len -= toCopy;
+            if (staged == STAGING_SIZE) { flushStaging(false); }
+        }
+    }
+
+    void Writer::patch(uint64_t pos, const uint8_t* data, size_t len) {
+        if (!isOpen()) { return; }
+
+        // Part still in the staging buffer
+        uint64_t end = pos + len;
+        if (end > stagedPos) {
+            uint64_t start = std::max<uint64_t>(pos, stagedPos);
+            memcpy(&staging[start - stagedPos], &data[start - pos], end - start);
+            len = (pos < stagedPos) ? (stagedPos - pos) : 0;
+        }
+        if (!len) { return; }
+
+        // Part already on disk. This is small and unaligned so it can't be done with direct IO.
+        bool wasDirect = direct;
+        if (wasDirect) { setDirect(false); }
+        writeAt(pos, data, len);
+        if (wasDirect) { setDirect(true); }
+    }
+
+    void Writer::flushStaging(bool final) {
+        if (!staged) { return; }
+
+        // The last block of the file is usually not a whole number of disk blocks
+        if (final && direct && (staged % STAGING_ALIGNMENT)) { setDirect(false); }
+
+        preallocate(stagedPos + staged);
+        if (!writeAt(stagedPos, staging, staged) && direct) {
+            // Some filesystems accept O_DIRECT on open but fail the writes, use the page cache for them instead
+            flog::warn("Direct IO write failed, falling back to buffered writes");
+            setDirect(false);
+            writeAt(stagedPos, staging, staged);
+        }
+
+#if defined(__linux__)
+        if (!direct) {
+            // Start writeback now instead of letting dirty pages pile up, then drop what the previous flush wrote
+            // from the cache since it is never going to be read back
+            sync_file_range(fd, stagedPos, staged, SYNC_FILE_RANGE_WRITE);
+            if (lastFlushLen) { posix_fadvise(fd, lastFlushPos, lastFlushLen, POSIX_FADV_DONTNEED); }
+        }
+#endif
+        lastFlushPos = stagedPos;
+        lastFlushLen = staged;
+
+        stagedPos += staged;
+        staged = 0;
+    }
+
+    bool Writer::setDirect(bool enabled) {
+#if defined(O_DIRECT) && !defined(_WIN32)
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1) { return false; }
+        flags = enabled ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+        if (fcntl(fd, F_SETFL, flags) == -1) { return false; }
+        direct = enabled;
+        return true;
+#elif defined(__APPLE__)
+        if (fcntl(fd, F_NOCACHE, enabled ? 1 : 0) == -1) { return false; }
+        direct = enabled;
+        return true;
+#else
+        return !enabled;
+#endif
+    }
+
+    void Writer::preallocate(uint64_t end) {
+#if defined(__linux__)
+        // Reserve space in large steps. FALLOC_FL_KEEP_SIZE keeps the file size to what was actually written
+        // and fails instead of writing zeros on filesystems that can't do it.
+        if (!canPreallocate || end <= preallocated) { return; }
+        uint64_t newEnd = ((end / PREALLOC_STEP) + 1) * PREALLOC_STEP;
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, preallocated, newEnd - preallocated)) {
+            canPreallocate = false;
+            return;
+        }
+        preallocated = newEnd;
+#endif
+    }
+
+    bool Writer::writeAt(uint64_t pos, const uint8_t* data, size_t len) {
+#ifdef _WIN32
+        if (_fseeki64(file, pos, SEEK_SET)) { return false; }
+        return fwrite(data, 1, len, file) == len;
+#else
+        while (len) {
+            ssize_t ret = pwrite(fd, data, len, pos);
+            if (ret < 0) {
+                if (errno == EINTR) { continue; }
+                flog::error("Failed to write to disk: {0}", strerror(errno));
+                return false;
+            }
+            data += ret;
+            pos += ret;
+            len -= ret;
+        }
+        return true;
+#endif
+    }
+}
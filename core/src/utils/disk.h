@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace disk {
+    // Sequential file writer meant for long recordings. Data is staged in an aligned buffer and written in large blocks,
+    // bypassing the page cache (O_DIRECT, F_NOCACHE) when the filesystem allows it, and space is preallocated ahead of
+    // the write position to avoid fragmentation. Falls back to plain buffered writes wherever that isn't available.
+    class Writer {
+    public:
+        Writer() {}
+        ~Writer();
+
+        bool open(std::string path, bool direct = true);
+        bool isOpen();
+        void close();
+
+        // Append data at the end of the file
+        void write(const uint8_t* data, size_t len);
+
+        // Overwrite data that was already appended, used to fill in headers
+        void patch(uint64_t pos, const uint8_t* data, size_t len);
+
+        // Logical size of the file, including what is still staged
+        uint64_t tell() { return stagedPos + staged; }
+
+        // Whether the page cache is bypassed
+        bool isDirect() { return direct; }
+
+    private:
+        void flushStaging(bool final);
+        bool setDirect(bool enabled);
+        void preallocate(uint64_t end);
+        bool writeAt(uint64_t pos, const uint8_t* data, size_t len);
+
+#ifdef _WIN32
+        FILE* file = NULL;
+#else
+        int fd = -1;
+#endif
+        bool direct = false;
+        bool canPreallocate = true;
+        uint64_t preallocated = 0;
+
+        uint8_t* staging = NULL;
+        size_t staged = 0;
+        uint64_t stagedPos = 0;     // File offset of the start of the staging buffer
+        uint64_t lastFlushPos = 0;  // Start of the previous flush, dropped from the page cache when not using direct IO
+        size_t lastFlushLen = 0;
+    };
+}
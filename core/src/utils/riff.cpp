@@ -1,11 +1,41 @@
 #include "riff.h"
 #include <string.h>
 #include <stdexcept>
+#include <ctype.h>
+#include <utils/flog.h>
 
 namespace riff {
     const char* RIFF_SIGNATURE      = "RIFF";
+    const char* RF64_SIGNATURE      = "RF64";
+    const char* W64_SIGNATURE       = "riff";
     const char* LIST_SIGNATURE      = "LIST";
+    const char* DS64_SIGNATURE      = "ds64";
+    const char* DATA_SIGNATURE      = "data";
     const size_t RIFF_LABEL_SIZE    = 4;
+    const size_t W64_LABEL_SIZE     = 16;
+    const size_t W64_ALIGNMENT      = 8;
+    const uint32_t RF64_SIZE_IN_DS64 = 0xFFFFFFFF;
+
+    // All W64 GUIDs except the one of the RIFF chunk end with this, after the four character code
+    const uint8_t W64_GUID_SUFFIX[12]       = { 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const uint8_t W64_RIFF_GUID_SUFFIX[12]  = { 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+    const uint8_t W64_LIST_GUID_SUFFIX[12]  = { 0x2F, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+
+    void w64GUID(const char id[4], uint8_t guid[16]) {
+        // The RIFF and LIST chunks use lower case codes and a different suffix
+        if (!memcmp(id, RIFF_SIGNATURE, RIFF_LABEL_SIZE) || !memcmp(id, W64_SIGNATURE, RIFF_LABEL_SIZE)) {
+            memcpy(guid, W64_SIGNATURE, RIFF_LABEL_SIZE);
+            memcpy(&guid[4], W64_RIFF_GUID_SUFFIX, sizeof(W64_RIFF_GUID_SUFFIX));
+            return;
+        }
+        if (!memcmp(id, LIST_SIGNATURE, RIFF_LABEL_SIZE)) {
+            memcpy(guid, "list", RIFF_LABEL_SIZE);
+            memcpy(&guid[4], W64_LIST_GUID_SUFFIX, sizeof(W64_LIST_GUID_SUFFIX));
+            return;
+        }
+        for (int i = 0; i < RIFF_LABEL_SIZE; i++) { guid[i] = tolower(id[i]); }
+        memcpy(&guid[4], W64_GUID_SUFFIX, sizeof(W64_GUID_SUFFIX));
+    }
 
     // Writer::Writer(const Writer&& b) {
     //     //file = std::move(b.file);
@@ -15,12 +45,12 @@ namespace riff {
         close();
     }
 
-    bool Writer::open(std::string path, const char form[4]) {
+    bool Writer::open(std::string path, const char form[4], Format format) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
 
         // Open file
-        file = std::ofstream(path, std::ios::out | std::ios::binary);
-        if (!file.is_open()) { return false; }
+        if (!file.open(path)) { return false; }
+        _format = format;
 
         // Begin RIFF chunk
         beginRIFF(form);
@@ -30,7 +60,7 @@ namespace riff {
 
     bool Writer::isOpen() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        return file.is_open();
+        return file.isOpen();
     }
 
     void Writer::close() {
@@ -45,12 +75,18 @@ namespace riff {
         file.close();
     }
 
+    void Writer::setSampleCount(uint64_t count) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (_format != FORMAT_RF64 || !isOpen()) { return; }
+        file.patch(ds64Pos + DS64_SAMPLE_COUNT, (uint8_t*)&count, sizeof(count));
+    }
+
     void Writer::beginList(const char id[4]) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
 
         // Create chunk with the LIST ID and write id
         beginChunk(LIST_SIGNATURE);
-        write((uint8_t*)id, RIFF_LABEL_SIZE);
+        writeLabel(id);
     }
 
     void Writer::endList() {
@@ -59,7 +95,7 @@ namespace riff {
         if (chunks.empty()) {
             throw std::runtime_error("No chunk to end");
         }
-        if (memcmp(chunks.top().hdr.id, LIST_SIGNATURE, RIFF_LABEL_SIZE)) {
+        if (memcmp(chunks.top().id, LIST_SIGNATURE, RIFF_LABEL_SIZE)) {
             throw std::runtime_error("Top chunk not LIST chunk");
         }
 
@@ -69,12 +105,25 @@ namespace riff {
     void Writer::beginChunk(const char id[4]) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
 
-        // Create and write header
+        // Create descriptor
         ChunkDesc desc;
-        desc.pos = file.tellp();
-        memcpy(desc.hdr.id, id, sizeof(desc.hdr.id));
-        desc.hdr.size = 0;
-        file.write((char*)&desc.hdr, sizeof(ChunkHeader));
+        desc.pos = file.tell();
+        memcpy(desc.id, id, sizeof(desc.id));
+        desc.size = 0;
+
+        // Write header with a placeholder size
+        if (_format == FORMAT_W64) {
+            uint8_t guid[W64_LABEL_SIZE];
+            uint64_t size = 0;
+            w64GUID(id, guid);
+            file.write(guid, sizeof(guid));
+            file.write((uint8_t*)&size, sizeof(size));
+        }
+        else {
+            uint32_t size = 0;
+            file.write((uint8_t*)id, RIFF_LABEL_SIZE);
+            file.write((uint8_t*)&size, sizeof(size));
+        }
 
         // Save descriptor
         chunks.push(desc);
@@ -91,17 +140,39 @@ namespace riff {
         ChunkDesc desc = chunks.top();
         chunks.pop();
 
-        // Write size
-        auto pos = file.tellp();
-        auto npos = desc.pos;
-        npos += 4;
-        file.seekp(npos);
-        file.write((char*)&desc.hdr.size, sizeof(desc.hdr.size));
-        file.seekp(pos);
+        // Write size and get the space taken by the chunk in its parent
+        uint64_t total;
+        if (_format == FORMAT_W64) {
+            // W64 sizes include the header and chunks are aligned to 8 bytes
+            uint64_t size = desc.size + W64_LABEL_SIZE + sizeof(uint64_t);
+            file.patch(desc.pos + W64_LABEL_SIZE, (uint8_t*)&size, sizeof(size));
+            uint64_t padding = (W64_ALIGNMENT - (size % W64_ALIGNMENT)) % W64_ALIGNMENT;
+            if (padding) {
+                uint8_t zeros[W64_ALIGNMENT] = { 0 };
+                file.write(zeros, padding);
+            }
+            total = size + padding;
+        }
+        else {
+            uint32_t size = desc.size;
+            if (_format == FORMAT_RF64 && (!memcmp(desc.id, RF64_SIGNATURE, RIFF_LABEL_SIZE) || !memcmp(desc.id, DATA_SIGNATURE, RIFF_LABEL_SIZE))) {
+                // The real sizes of the file and data are in the ds64 chunk
+                size = RF64_SIZE_IN_DS64;
+                uint64_t offset = memcmp(desc.id, DATA_SIGNATURE, RIFF_LABEL_SIZE) ? DS64_RIFF_SIZE : DS64_DATA_SIZE;
+                file.patch(ds64Pos + offset, (uint8_t*)&desc.size, sizeof(desc.size));
+            }
+            else if (desc.size > 0xFFFFFFFF) {
+                // Readers have to find the real size from the length of the file
+                flog::warn("RIFF chunk '{0}' is larger than 4GB, its size will be wrong", std::string(desc.id, RIFF_LABEL_SIZE));
+                size = 0xFFFFFFFF;
+            }
+            file.patch(desc.pos + RIFF_LABEL_SIZE, (uint8_t*)&size, sizeof(size));
+            total = desc.size + sizeof(ChunkHeader);
+        }
 
         // If parent chunk, increment its size by the size of the sub-chunk plus the size of its header)
         if (!chunks.empty()) {
-            chunks.top().hdr.size += desc.hdr.size + sizeof(ChunkHeader);
+            chunks.top().size += total;
         }
     }
 
@@ -111,8 +182,8 @@ namespace riff {
         if (chunks.empty()) {
             throw std::runtime_error("No chunk to write into");
         }
-        file.write((char*)data, len);
-        chunks.top().hdr.size += len;
+        file.write(data, len);
+        chunks.top().size += len;
     }
 
     void Writer::beginRIFF(const char form[4]) {
@@ -123,8 +194,17 @@ namespace riff {
         }
 
         // Create chunk with RIFF ID and write form
-        beginChunk(RIFF_SIGNATURE);
-        write((uint8_t*)form, RIFF_LABEL_SIZE);
+        beginChunk((_format == FORMAT_RF64) ? RF64_SIGNATURE : RIFF_SIGNATURE);
+        writeLabel(form);
+
+        // RF64 requires the ds64 chunk to be the first one, it is filled in when the chunks end
+        if (_format == FORMAT_RF64) {
+            uint8_t ds64[DS64_SIZE] = { 0 };
+            beginChunk(DS64_SIGNATURE);
+            ds64Pos = file.tell();
+            write(ds64, sizeof(ds64));
+            endChunk();
+        }
     }
 
     void Writer::endRIFF() {
@@ -133,10 +213,22 @@ namespace riff {
         if (chunks.empty()) {
             throw std::runtime_error("No chunk to end");
         }
-        if (memcmp(chunks.top().hdr.id, RIFF_SIGNATURE, RIFF_LABEL_SIZE)) {
+        const char* sig = (_format == FORMAT_RF64) ? RF64_SIGNATURE : RIFF_SIGNATURE;
+        if (memcmp(chunks.top().id, sig, RIFF_LABEL_SIZE)) {
             throw std::runtime_error("Top chunk not RIFF chunk");
         }
 
         endChunk();
     }
-}
\ No newline at end of file
+
+    void Writer::writeLabel(const char id[4]) {
+        if (_format == FORMAT_W64) {
+            uint8_t guid[W64_LABEL_SIZE];
+            w64GUID(id, guid);
+            write(guid, sizeof(guid));
+        }
+        else {
+            write((uint8_t*)id, RIFF_LABEL_SIZE);
+        }
+    }
+}
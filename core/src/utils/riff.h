@@ -4,6 +4,7 @@
 #include <string>
 #include <stack>
 #include <stdint.h>
+#include "disk.h"
 
 namespace riff {
 #pragma pack(push, 1)
@@ -13,21 +14,44 @@ namespace riff {
     };
 #pragma pack(pop)
 
+    // Sizes are 64bit so that chunks over 4GB can be tracked in RF64 and W64 files
     struct ChunkDesc {
-        ChunkHeader hdr;
-        std::streampos pos;
+        char id[4];
+        uint64_t size;
+        uint64_t pos;
+    };
+
+    enum Format {
+        FORMAT_RIFF,    // Standard RIFF, limited to 4GB
+        FORMAT_RF64,    // EBU Tech 3306, RIFF with the sizes of the file and data chunk in a ds64 chunk
+        FORMAT_W64      // Sony Wave64, GUID chunk IDs and 64bit sizes
     };
 
+    // Byte offset of the fields of the ds64 chunk payload
+    enum {
+        DS64_RIFF_SIZE      = 0,
+        DS64_DATA_SIZE      = 8,
+        DS64_SAMPLE_COUNT   = 16,
+        DS64_TABLE_LENGTH   = 24,
+        DS64_SIZE           = 28
+    };
+
+    // W64 GUID of a RIFF four character code
+    void w64GUID(const char id[4], uint8_t guid[16]);
+
     class Writer {
     public:
         Writer() {}
         // Writer(const Writer&& b);
         ~Writer();
 
-        bool open(std::string path, const char form[4]);
+        bool open(std::string path, const char form[4], Format format = FORMAT_RIFF);
         bool isOpen();
         void close();
 
+        // Sample count stored in the ds64 chunk, only used by RF64
+        void setSampleCount(uint64_t count);
+
         void beginList(const char id[4]);
         void endList();
 
@@ -39,10 +63,13 @@ namespace riff {
     private:
         void beginRIFF(const char form[4]);
         void endRIFF();
+        void writeLabel(const char id[4]);
 
         std::recursive_mutex mtx;
-        std::ofstream file;
+        disk::Writer file;
         std::stack<ChunkDesc> chunks;
+        Format _format = FORMAT_RIFF;
+        uint64_t ds64Pos = 0;
     };
 
     // class Reader {
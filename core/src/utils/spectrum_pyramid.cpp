@@ -0,0 +1,302 @@
+#include "spectrum_pyramid.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#define SPECTRUM_PYRAMID_8BIT_STEP      0.5f
+#define SPECTRUM_PYRAMID_16BIT_STEP     0.005f
+#define SPECTRUM_PYRAMID_FIRST_LEVEL    4   // Smallest stored blocks are 16 bins, smaller ones are read from the line
+
+template <class Q>
+inline float quantStep() {
+    return std::is_same_v<Q, uint8_t> ? SPECTRUM_PYRAMID_8BIT_STEP : SPECTRUM_PYRAMID_16BIT_STEP;
+}
+
+SpectrumPyramid::~SpectrumPyramid() {
+    free(data);
+    free(refs);
+}
+
+void SpectrumPyramid::init(int bins, int lines, SpectrumQuantization quantization) {
+    binCount = bins;
+    lineCount = std::max<int>(lines, 1);
+    quant = quantization;
+    if (quant == SPECTRUM_QUANT_8BIT) { valueSize = sizeof(uint8_t); }
+    else if (quant == SPECTRUM_QUANT_16BIT) { valueSize = sizeof(uint16_t); }
+    else { valueSize = sizeof(float); }
+
+    // Each level halves the number of values until one is left
+    levelSize.clear();
+    levelOffset.clear();
+    levelSize.push_back(binCount);
+    levelOffset.push_back(0);
+    lineSize = binCount;
+    for (int l = 1; levelSize.back() > 1; l++) {
+        int size = (levelSize.back() + 1) / 2;
+        levelSize.push_back(size);
+        levelOffset.push_back(lineSize);
+        if (l >= SPECTRUM_PYRAMID_FIRST_LEVEL) { lineSize += 2 * size; }
+    }
+
+    data = (uint8_t*)realloc(data, (size_t)lineCount * lineSize * valueSize);
+    refs = (float*)realloc(refs, lineCount * sizeof(float));
+    clear();
+}
+
+void SpectrumPyramid::setLineCount(int lines) {
+    lines = std::max<int>(lines, 1);
+    if (lines == lineCount || !data) {
+        lineCount = lines;
+        return;
+    }
+
+    // Copy the newest lines to a new buffer, oldest first so that the newest ends up at the end
+    int keep = std::min<int>(storedLines, lines);
+    size_t lineBytes = (size_t)lineSize * valueSize;
+    uint8_t* newData = (uint8_t*)malloc(lines * lineBytes);
+    float* newRefs = (float*)malloc(lines * sizeof(float));
+    for (int i = 0; i < keep; i++) {
+        int age = keep - 1 - i;
+        memcpy(&newData[i * lineBytes], getLine(age), lineBytes);
+        newRefs[i] = getRef(age);
+    }
+    free(data);
+    free(refs);
+    data = newData;
+    refs = newRefs;
+    lineCount = lines;
+    storedLines = keep;
+    newest = (keep > 0) ? keep - 1 : lineCount - 1;
+}
+
+void SpectrumPyramid::clear() {
+    storedLines = 0;
+    newest = lineCount - 1;
+}
+
+void SpectrumPyramid::push(const float* line) {
+    if (!data) { return; }
+    newest = (newest + 1) % lineCount;
+    storedLines = std::min<int>(storedLines + 1, lineCount);
+    if (quant == SPECTRUM_QUANT_8BIT) { pushQuantized<uint8_t>(line); }
+    else if (quant == SPECTRUM_QUANT_16BIT) { pushQuantized<uint16_t>(line); }
+    else { pushQuantized<float>(line); }
+}
+
+void SpectrumPyramid::zoom(int age, double start, double width, int count, float* out, bool min) {
+    if (age >= storedLines) {
+        for (int i = 0; i < count; i++) { out[i] = -INFINITY; }
+        return;
+    }
+    if (quant == SPECTRUM_QUANT_8BIT) { zoomQuantized<uint8_t>(age, start, width, count, out, min); }
+    else if (quant == SPECTRUM_QUANT_16BIT) { zoomQuantized<uint16_t>(age, start, width, count, out, min); }
+    else { zoomQuantized<float>(age, start, width, count, out, min); }
+}
+
+bool SpectrumPyramid::getRange(int age, int start, int end, float& min, float& max) {
+    start = std::max<int>(start, 0);
+    end = std::min<int>(end, binCount);
+    if (age >= storedLines || start >= end) { return false; }
+    float ref = getRef(age);
+    if (quant == SPECTRUM_QUANT_8BIT) {
+        uint8_t qmin, qmax;
+        range<uint8_t>((uint8_t*)getLine(age), start, end, qmin, qmax);
+        min = decode(qmin, ref);
+        max = decode(qmax, ref);
+    }
+    else if (quant == SPECTRUM_QUANT_16BIT) {
+        uint16_t qmin, qmax;
+        range<uint16_t>((uint16_t*)getLine(age), start, end, qmin, qmax);
+        min = decode(qmin, ref);
+        max = decode(qmax, ref);
+    }
+    else {
+        range<float>((float*)getLine(age), start, end, min, max);
+    }
+    return true;
+}
+
+template <class Q>
+void SpectrumPyramid::pushQuantized(const float* line) {
+    Q* dst = (Q*)getLine(0);
+    if constexpr (std::is_same_v<Q, float>) {
+        memcpy(dst, line, binCount * sizeof(float));
+        refs[newest] = 0.0f;
+    }
+    else {
+        // Quantize relative to the peak of the line, ignoring bins that are -INFINITY or NAN
+        float ref = -INFINITY;
+        for (int i = 0; i < binCount; i++) {
+            if (line[i] > ref) { ref = line[i]; }
+        }
+        if (!std::isfinite(ref)) { ref = 0.0f; }
+        refs[newest] = ref;
+
+        float top = std::numeric_limits<Q>::max();
+        float scale = 1.0f / quantStep<Q>();
+        for (int i = 0; i < binCount; i++) {
+            float q = ((line[i] - ref) * scale) + top + 0.5f;
+            dst[i] = (Q)std::clamp<float>(q, 0.0f, top);
+        }
+    }
+    buildLevels<Q>(dst);
+}
+
+template <class Q>
+void SpectrumPyramid::buildLevels(Q* line) {
+    int first = SPECTRUM_PYRAMID_FIRST_LEVEL;
+    if (first >= levelSize.size()) { return; }
+
+    // The first stored level is built from the line for both its max and min
+    Q* prevMax = &line[levelOffset[first]];
+    Q* prevMin = &prevMax[levelSize[first]];
+    int block = 1 << first;
+    for (int i = 0; i < levelSize[first]; i++) {
+        int start = i * block;
+        int end = std::min<int>(start + block, binCount);
+        Q max = line[start];
+        Q min = line[start];
+        for (int j = start + 1; j < end; j++) {
+            max = std::max<Q>(max, line[j]);
+            min = std::min<Q>(min, line[j]);
+        }
+        prevMax[i] = max;
+        prevMin[i] = min;
+    }
+
+    for (int l = first + 1; l < levelSize.size(); l++) {
+        int prevSize = levelSize[l - 1];
+        Q* max = &line[levelOffset[l]];
+        Q* min = &max[levelSize[l]];
+        int pairs = prevSize / 2;
+        for (int i = 0; i < pairs; i++) {
+            max[i] = std::max<Q>(prevMax[2 * i], prevMax[(2 * i) + 1]);
+            min[i] = std::min<Q>(prevMin[2 * i], prevMin[(2 * i) + 1]);
+        }
+        if (prevSize & 1) {
+            max[pairs] = prevMax[prevSize - 1];
+            min[pairs] = prevMin[prevSize - 1];
+        }
+        prevMax = max;
+        prevMin = min;
+    }
+}
+
+template <class Q>
+void SpectrumPyramid::range(const Q* line, int start, int end, Q& min, Q& max) {
+    if constexpr (std::is_same_v<Q, float>) {
+        min = INFINITY;
+        max = -INFINITY;
+    }
+    else {
+        min = std::numeric_limits<Q>::max();
+        max = std::numeric_limits<Q>::lowest();
+    }
+
+    // Bins outside of whole blocks of the first stored level are read from the line
+    int first = SPECTRUM_PYRAMID_FIRST_LEVEL;
+    int block = 1 << first;
+    int blockStart = (start + block - 1) >> first;
+    int blockEnd = end >> first;
+    if (first >= levelSize.size() || blockStart >= blockEnd) {
+        blockStart = blockEnd = end;
+    }
+    for (int i = start; i < std::min<int>(blockStart << first, end); i++) {
+        max = std::max<Q>(max, line[i]);
+        min = std::min<Q>(min, line[i]);
+    }
+    for (int i = std::max<int>(blockEnd << first, start); i < end; i++) {
+        max = std::max<Q>(max, line[i]);
+        min = std::min<Q>(min, line[i]);
+    }
+    if (blockStart >= blockEnd) { return; }
+
+    // Walk up the levels, taking the blocks at the ends that don't pair up
+    for (int l = first; blockStart < blockEnd; l++) {
+        const Q* lmax = &line[levelOffset[l]];
+        const Q* lmin = &lmax[levelSize[l]];
+        if (blockStart & 1) {
+            max = std::max<Q>(max, lmax[blockStart]);
+            min = std::min<Q>(min, lmin[blockStart]);
+            blockStart++;
+        }
+        if (blockEnd & 1) {
+            blockEnd--;
+            max = std::max<Q>(max, lmax[blockEnd]);
+            min = std::min<Q>(min, lmin[blockEnd]);
+        }
+        blockStart >>= 1;
+        blockEnd >>= 1;
+    }
+}
+
+template <class Q>
+void SpectrumPyramid::zoomQuantized(int age, double start, double width, int count, float* out, bool min) {
+    const Q* line = (const Q*)getLine(age);
+    float ref = getRef(age);
+    // Like doZoom, start is clamped to the first bin. It is positive from here on so casts round down.
+    start = std::max<double>(start, 0.0);
+    double factor = width / (double)count;
+    int span = std::max<int>(ceil(factor), 1);
+
+    // Use the coarsest level with at least two blocks per pixel. Pixels are widened to whole blocks so that
+    // a peak can show up one block early or late, but never goes missing.
+    int level = 0;
+    for (int l = SPECTRUM_PYRAMID_FIRST_LEVEL; l < levelSize.size() && (2 << l) <= factor; l++) { level = l; }
+
+    if (level) {
+        const Q* lmax = &line[levelOffset[level]];
+        const Q* lmin = &lmax[levelSize[level]];
+        int block = 1 << level;
+        double id = start;
+        for (int i = 0; i < count; i++) {
+            int s = (int)id;
+            int e = std::min<int>(s + span, binCount);
+            id += factor;
+            if (s >= e) {
+                out[i] = -INFINITY;
+                continue;
+            }
+            int bs = s >> level;
+            int be = (e + block - 1) >> level;
+            Q val;
+            if (min) {
+                val = lmin[bs];
+                for (int j = bs + 1; j < be; j++) { val = std::min<Q>(val, lmin[j]); }
+            }
+            else {
+                val = lmax[bs];
+                for (int j = bs + 1; j < be; j++) { val = std::max<Q>(val, lmax[j]); }
+            }
+            out[i] = decode(val, ref);
+        }
+        return;
+    }
+
+    // Same pixel coverage as doZoom
+    double id = start;
+    for (int i = 0; i < count; i++) {
+        int s = (int)id;
+        int e = std::min<int>(s + span, binCount);
+        id += factor;
+        if (s >= e) {
+            out[i] = -INFINITY;
+            continue;
+        }
+        Q qmin, qmax;
+        range<Q>(line, s, e, qmin, qmax);
+        out[i] = decode(min ? qmin : qmax, ref);
+    }
+}
+
+template <class Q>
+float SpectrumPyramid::decode(Q value, float ref) {
+    if constexpr (std::is_same_v<Q, float>) {
+        return value;
+    }
+    else {
+        return ref + (((float)value - (float)std::numeric_limits<Q>::max()) * quantStep<Q>());
+    }
+}
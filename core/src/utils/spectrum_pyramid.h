@@ -0,0 +1,83 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum SpectrumQuantization {
+    SPECTRUM_QUANT_FLOAT,
+    SPECTRUM_QUANT_16BIT,
+    SPECTRUM_QUANT_8BIT
+};
+
+// History of spectrum lines (in dB) along with a min/max mipmap of each line, so that any range of bins
+// of any line can be reduced in a number of steps that doesn't depend on its width. The mipmap starts at
+// blocks of 16 bins, a line takes 1.25 times its size.
+// Quantized lines are stored relative to their peak: 8bit lines keep 127.5dB below it in 0.5dB steps
+// and 16bit lines keep 327.675dB in 0.005dB steps. Anything lower reads back as the bottom of the range.
+class SpectrumPyramid {
+public:
+    SpectrumPyramid() {}
+    ~SpectrumPyramid();
+
+    // Clears the history
+    void init(int bins, int lines, SpectrumQuantization quantization);
+
+    // Keeps the newest lines
+    void setLineCount(int lines);
+
+    void clear();
+
+    void push(const float* line);
+
+    // Reduce bins [start, start + width) of a line to count values, each being the max (or min) of the bins it covers.
+    // Pixels covering more than 32 bins are read from the mipmap and rounded out to its blocks.
+    // Age 0 is the newest line. Values with no bins in range are -INFINITY.
+    void zoom(int age, double start, double width, int count, float* out, bool min = false);
+
+    // Min and max of bins [start, end) of a line, returns false if the range is empty
+    bool getRange(int age, int start, int end, float& min, float& max);
+
+    inline int getBinCount() { return binCount; }
+    inline int getLineCount() { return lineCount; }
+    inline int getStoredLines() { return storedLines; }
+    inline SpectrumQuantization getQuantization() { return quant; }
+
+private:
+    template <class Q>
+    void pushQuantized(const float* line);
+
+    template <class Q>
+    void buildLevels(Q* line);
+
+    template <class Q>
+    void range(const Q* line, int start, int end, Q& min, Q& max);
+
+    template <class Q>
+    void zoomQuantized(int age, double start, double width, int count, float* out, bool min);
+
+    template <class Q>
+    float decode(Q value, float ref);
+
+    inline uint8_t* getLine(int age) {
+        return &data[(size_t)((newest - age + lineCount) % lineCount) * lineSize * valueSize];
+    }
+
+    inline float getRef(int age) {
+        return refs[(newest - age + lineCount) % lineCount];
+    }
+
+    int binCount = 0;
+    int lineCount = 0;
+    int storedLines = 0;
+    int newest = 0;
+    SpectrumQuantization quant = SPECTRUM_QUANT_FLOAT;
+    int valueSize = sizeof(float);
+
+    // Level 0 is the line itself. Stored levels have their max values at levelOffset followed by their min values.
+    std::vector<int> levelSize;
+    std::vector<int> levelOffset;
+    int lineSize = 0;
+
+    uint8_t* data = NULL;
+    float* refs = NULL;
+};
@@ -4,6 +4,8 @@
 #include <dsp/buffer/buffer.h>
 #include <dsp/stream.h>
 #include <map>
+#include <algorithm>
+#include <string.h>
 
 namespace wav {
     const char* WAVE_FILE_TYPE          = "WAVE";
@@ -12,6 +14,10 @@ namespace wav {
     const uint32_t FORMAT_HEADER_LEN    = 16;
     const uint16_t SAMPLE_TYPE_PCM      = 1;
 
+    // The async ring is split in this many blocks, each at least ASYNC_MIN_BLOCK_SIZE samples long
+    const int ASYNC_BLOCK_COUNT         = 16;
+    const int ASYNC_MIN_BLOCK_SIZE      = 16384;
+
     std::map<SampleType, int> SAMP_BITS = {
         { SAMP_TYPE_UINT8, 8 },
         { SAMP_TYPE_INT16, 16 },
@@ -50,16 +56,23 @@ namespace wav {
         hdr.bytesPerSample = bytesPerSamp;
         hdr.bytesPerSecond = bytesPerSamp * _samplerate;
 
+        // Size the async blocks to hold the requested time, whole frames only
+        if (_async) {
+            blockSize = std::max<int>(ASYNC_MIN_BLOCK_SIZE, (_bufferTime * (double)_samplerate * (double)_channels) / (double)ASYNC_BLOCK_COUNT);
+            blockSize = ((blockSize + _channels - 1) / _channels) * _channels;
+        }
+
         // Precompute sizes and allocate buffers
+        convSize = _async ? blockSize : (STREAM_BUFFER_SIZE * _channels);
         switch (_type) {
         case SAMP_TYPE_UINT8:
-            bufU8 = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE * _channels);
+            bufU8 = dsp::buffer::alloc<uint8_t>(convSize);
             break;
         case SAMP_TYPE_INT16:
-            bufI16 = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * _channels);
+            bufI16 = dsp::buffer::alloc<int16_t>(convSize);
             break;
         case SAMP_TYPE_INT32:
-            bufI32 = dsp::buffer::alloc<int32_t>(STREAM_BUFFER_SIZE * _channels);
+            bufI32 = dsp::buffer::alloc<int32_t>(convSize);
             break;
         case SAMP_TYPE_FLOAT32:
             break;
@@ -69,7 +82,10 @@ namespace wav {
         }
 
         // Open file
-        if (!rw.open(path, WAVE_FILE_TYPE)) { return false; }
+        riff::Format riffFormat = riff::FORMAT_RIFF;
+        if (_format == FORMAT_RF64) { riffFormat = riff::FORMAT_RF64; }
+        else if (_format == FORMAT_W64) { riffFormat = riff::FORMAT_W64; }
+        if (!rw.open(path, WAVE_FILE_TYPE, riffFormat)) { return false; }
 
         // Write format chunk
         rw.beginChunk(FORMAT_MARKER);
@@ -78,6 +94,26 @@ namespace wav {
 
         // Begin data chunk
         rw.beginChunk(DATA_MARKER);
+
+        // Allocate the whole ring now so that nothing is allocated while recording
+        if (_async) {
+            blockCount = ASYNC_BLOCK_COUNT;
+            blocks = new float*[blockCount];
+            blockFill = new int[blockCount];
+            for (int i = 0; i < blockCount; i++) {
+                blocks[i] = dsp::buffer::alloc<float>(blockSize);
+                blockFill[i] = 0;
+            }
+            head = 0;
+            tail = 0;
+            queued = 0;
+            maxQueued = 0;
+            overrunning = false;
+            samplesDropped = 0;
+            overruns = 0;
+            ioRunning = true;
+            ioThread = std::thread(&Writer::ioWorker, this);
+        }
         
         return true;
     }
@@ -92,7 +128,31 @@ namespace wav {
         // Do nothing if the file is not open
         if (!rw.isOpen()) { return; }
 
+        // Hand the partial block to the IO thread and wait for it to write everything
+        if (blocks) {
+            {
+                std::lock_guard<std::mutex> lck(ioMtx);
+                if (blockFill[head] && queued < blockCount) {
+                    queued++;
+                    head = (head + 1) % blockCount;
+                }
+                ioRunning = false;
+            }
+            ioCnd.notify_all();
+            if (ioThread.joinable()) { ioThread.join(); }
+
+            for (int i = 0; i < blockCount; i++) {
+                dsp::buffer::free(blocks[i]);
+            }
+            delete[] blocks;
+            delete[] blockFill;
+            blocks = NULL;
+            blockFill = NULL;
+            blockCount = 0;
+        }
+
         // Finish data chunk
+        rw.setSampleCount(samplesWritten);
         rw.endChunk();
 
         // Close the file
@@ -147,37 +207,109 @@ namespace wav {
         _type = type;
     }
 
+    void Writer::setAsync(bool async, double bufferTime) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _async = async;
+        _bufferTime = bufferTime;
+    }
+
     void Writer::write(float* samples, int count) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         if (!rw.isOpen()) { return; }
-        
-        // Select different writer function depending on the chose depth
-        int tcount = count * _channels;
-        int tbytes = count * bytesPerSamp;
-        switch (_type) {
-        case SAMP_TYPE_UINT8:
-            // Volk doesn't support unsigned ints yet :/
-            for (int i = 0; i < tcount; i++) {
-                bufU8[i] = (samples[i] * 127.0f) + 128.0f;
+
+        if (!_async) {
+            convertAndWrite(samples, count * _channels);
+            samplesWritten += count;
+            return;
+        }
+
+        // Copy into the ring, the block at head is free as long as not all blocks are queued
+        int total = count * _channels;
+        while (total) {
+            if (queued >= blockCount) {
+                // The disk isn't keeping up, drop the rest instead of blocking the DSP
+                if (!overrunning) { overruns++; }
+                overrunning = true;
+                samplesDropped += total / _channels;
+                count -= total / _channels;
+                break;
+            }
+            overrunning = false;
+
+            int toCopy = std::min<int>(total, blockSize - blockFill[head]);
+            memcpy(&blocks[head][blockFill[head]], samples, toCopy * sizeof(float));
+            blockFill[head] += toCopy;
+            samples += toCopy;
+            total -= toCopy;
+
+            if (blockFill[head] == blockSize) {
+                {
+                    std::lock_guard<std::mutex> lck(ioMtx);
+                    queued++;
+                    if (queued > maxQueued) { maxQueued = (int)queued; }
+                    head = (head + 1) % blockCount;
+                }
+                ioCnd.notify_one();
             }
-            rw.write(bufU8, tbytes);
-            break;
-        case SAMP_TYPE_INT16:
-            volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
-            rw.write((uint8_t*)bufI16, tbytes);
-            break;
-        case SAMP_TYPE_INT32:
-            volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, tcount);
-            rw.write((uint8_t*)bufI32, tbytes);
-            break;
-        case SAMP_TYPE_FLOAT32:
-            rw.write((uint8_t*)samples, tbytes);
-            break;
-        default:
-            break;
         }
 
-        // Increment sample counter
         samplesWritten += count;
     }
+
+    void Writer::convertAndWrite(float* samples, int count) {
+        while (count) {
+            int n = std::min<int>(count, convSize);
+            int bytes = n * (SAMP_BITS[_type] / 8);
+
+            // Select different writer function depending on the chose depth
+            switch (_type) {
+            case SAMP_TYPE_UINT8:
+                // Volk doesn't support unsigned ints, convert to signed and flip the sign bit to offset it by 128
+                volk_32f_s32f_convert_8i((int8_t*)bufU8, samples, 127.0f, n);
+                for (int i = 0; i < n; i++) { bufU8[i] ^= 0x80; }
+                rw.write(bufU8, bytes);
+                break;
+            case SAMP_TYPE_INT16:
+                volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, n);
+                rw.write((uint8_t*)bufI16, bytes);
+                break;
+            case SAMP_TYPE_INT32:
+                volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, n);
+                rw.write((uint8_t*)bufI32, bytes);
+                break;
+            case SAMP_TYPE_FLOAT32:
+                rw.write((uint8_t*)samples, bytes);
+                break;
+            default:
+                break;
+            }
+
+            samples += n;
+            count -= n;
+        }
+    }
+
+    void Writer::ioWorker() {
+        while (true) {
+            int block;
+            {
+                std::unique_lock<std::mutex> lck(ioMtx);
+                ioCnd.wait(lck, [this]() { return queued > 0 || !ioRunning; });
+                if (!queued) { break; }
+                block = tail;
+            }
+
+            convertAndWrite(blocks[block], blockFill[block]);
+
+            // Give the block back
+            {
+                std::lock_guard<std::mutex> lck(ioMtx);
+                blockFill[block] = 0;
+                tail = (tail + 1) % blockCount;
+                queued--;
+            }
+        }
+    }
 }
@@ -3,6 +3,9 @@
 #include <fstream>
 #include <stdint.h>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
 #include "riff.h"
 
 namespace wav {    
@@ -19,7 +22,8 @@ namespace wav {
 
     enum Format {
         FORMAT_WAV,
-        FORMAT_RF64
+        FORMAT_RF64,
+        FORMAT_W64
     };
 
     enum SampleType {
@@ -48,11 +52,24 @@ namespace wav {
         void setFormat(Format format);
         void setSampleType(SampleType type);
 
+        // In async mode, write() only copies the samples into a ring of buffers holding about bufferTime seconds.
+        // Conversion and disk IO are done by a dedicated thread and samples are dropped if the ring overflows.
+        void setAsync(bool async, double bufferTime = 1.0);
+
         size_t getSamplesWritten() { return samplesWritten; }
 
+        // Overrun statistics of the async mode
+        size_t getSamplesDropped() { return samplesDropped; }
+        int getOverruns() { return overruns; }
+        float getBufferFill() { return blockCount ? (float)queued / (float)blockCount : 0.0f; }
+        float getMaxBufferFill() { return blockCount ? (float)maxQueued / (float)blockCount : 0.0f; }
+
         void write(float* samples, int count);
 
     private:
+        void convertAndWrite(float* samples, int count);
+        void ioWorker();
+
         std::recursive_mutex mtx;
         FormatHeader hdr;
         riff::Writer rw;
@@ -66,6 +83,26 @@ namespace wav {
         uint8_t* bufU8 = NULL;
         int16_t* bufI16 = NULL;
         int32_t* bufI32 = NULL;
+        int convSize;
         size_t samplesWritten = 0;
+
+        // Ring of sample blocks between write() and the IO thread. The block being filled is not counted in queued.
+        bool _async = false;
+        double _bufferTime = 1.0;
+        float** blocks = NULL;
+        int* blockFill = NULL;
+        int blockCount = 0;
+        int blockSize;
+        int head;
+        int tail;
+        std::atomic<int> queued = 0;
+        std::atomic<int> maxQueued = 0;
+        bool overrunning;
+        std::atomic<size_t> samplesDropped = 0;
+        std::atomic<int> overruns = 0;
+        std::mutex ioMtx;
+        std::condition_variable ioCnd;
+        std::thread ioThread;
+        bool ioRunning = false;
     };
 }
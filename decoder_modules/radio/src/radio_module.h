@@ -69,6 +69,8 @@ public:
         ifChainOutputChanged.ctx = this;
         ifChainOutputChanged.handler = ifChainOutputChangeHandler;
         ifChain.init(vfo->output);
+        ifChain.setFused(true, [](dsp::stream<dsp::complex_t>* out){});
+        ifChain.setProfileName(name + " IF");
 
         nb.init(NULL, 500.0 / 24000.0, 10.0);
         fmnr.init(NULL, 32);
@@ -80,6 +82,8 @@ public:
 
         // Initialize audio DSP chain
         afChain.init(&dummyAudioStream);
+        afChain.setFused(true, [](dsp::stream<dsp::stereo_t>* out){});
+        afChain.setProfileName(name + " AF");
 
         resamp.init(NULL, 250000.0, 48000.0);
         deemp.init(NULL, 50e-6, 48000.0);
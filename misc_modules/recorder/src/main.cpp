@@ -9,6 +9,10 @@
 #include <dsp/convert/stereo_to_mono.h>
 #include <thread>
 #include <ctime>
+#include <fstream>
+#include <condition_variable>
+#include <tuple>
+#include <set>
 #include <gui/gui.h>
 #include <filesystem>
 #include <signal_path/signal_path.h>
@@ -27,6 +31,15 @@
 
 #define SILENCE_LVL 10e-6
 
+// Channels are recorded at their bandwidth times this, enough to keep the edges out of the filter transition
+#define CHANNEL_OVERSAMPLING    1.25
+
+// Interval at which the samples of all channels are written to disk by the IO thread
+#define CHANNEL_FLUSH_INTERVAL  100
+
+// Seconds of samples a channel can have waiting for the IO thread, the rest is dropped if it falls further behind
+#define CHANNEL_MAX_PENDING     2.0
+
 SDRPP_MOD_INFO{
     /* Name:            */ "recorder",
     /* Description:     */ "Recorder module for SDR++",
@@ -37,6 +50,10 @@ SDRPP_MOD_INFO{
 
 ConfigManager config;
 
+// VFOs created by the recorders in channels mode, so that no recorder takes those of another one as channels
+std::mutex channelVFOsMtx;
+std::set<std::string> channelVFOs;
+
 class RecorderModule : public ModuleManager::Instance {
 public:
     RecorderModule(std::string name) : folderSelect("%ROOT%/recordings") {
@@ -46,7 +63,8 @@ public:
 
         // Define option lists
         containers.define("WAV", wav::FORMAT_WAV);
-        // containers.define("RF64", wav::FORMAT_RF64); // Disabled for now
+        containers.define("RF64", wav::FORMAT_RF64);
+        containers.define("W64", wav::FORMAT_W64);
         sampleTypes.define(wav::SAMP_TYPE_UINT8, "Uint8", wav::SAMP_TYPE_UINT8);
         sampleTypes.define(wav::SAMP_TYPE_INT16, "Int16", wav::SAMP_TYPE_INT16);
         sampleTypes.define(wav::SAMP_TYPE_INT32, "Int32", wav::SAMP_TYPE_INT32);
@@ -56,6 +74,10 @@ public:
         containerId = containers.valueId(wav::FORMAT_WAV);
         sampleTypeId = sampleTypes.valueId(wav::SAMP_TYPE_INT16);
 
+        channelSources.define("vfos", "VFOs", CHANNEL_SOURCE_VFOS);
+        channelSources.define("bookmarks", "Bookmarks", CHANNEL_SOURCE_BOOKMARKS);
+        channelSourceId = channelSources.valueId(CHANNEL_SOURCE_VFOS);
+
         // Load config
         config.acquire();
         if (config.conf[name].contains("mode")) {
@@ -82,6 +104,12 @@ public:
         if (config.conf[name].contains("ignoreSilence")) {
             ignoreSilence = config.conf[name]["ignoreSilence"];
         }
+        if (config.conf[name].contains("channelSource") && channelSources.keyExists(config.conf[name]["channelSource"])) {
+            channelSourceId = channelSources.keyId(config.conf[name]["channelSource"]);
+        }
+        if (config.conf[name].contains("bookmarkList")) {
+            selectedBookmarkList = config.conf[name]["bookmarkList"];
+        }
         if (config.conf[name].contains("nameTemplate")) {
             std::string _nameTemplate = config.conf[name]["nameTemplate"];
             if (_nameTemplate.length() > sizeof(nameTemplate)-1) {
@@ -103,6 +131,9 @@ public:
         stereoSink.init(&stereoStream, stereoHandler, this);
         monoSink.init(&s2m.out, monoHandler, this);
 
+        // Keep disk stalls from blocking the DSP, the writer drops samples instead and counts them
+        writer.setAsync(true);
+
         gui::menu.registerEntry(name, menuHandler, this);
         core::modComManager.registerInterface("recorder", name, moduleInterfaceHandler, this);
     }
@@ -115,6 +146,7 @@ public:
         deselectStream();
         sigpath::sinkManager.onStreamRegistered.unbindHandler(&onStreamRegisteredHandler);
         sigpath::sinkManager.onStreamUnregister.unbindHandler(&onStreamUnregisterHandler);
+        sigpath::sourceManager.onRetune.unbindHandler(&retuneHandler);
         meter.stop();
     }
 
@@ -136,6 +168,12 @@ public:
 
         // Select the stream
         selectStream(selectedStreamName);
+
+        refreshBookmarkLists();
+
+        retuneHandler.ctx = this;
+        retuneHandler.handler = retuneChannels;
+        sigpath::sourceManager.onRetune.bindHandler(&retuneHandler);
     }
 
     void enable() {
@@ -154,6 +192,11 @@ public:
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (recording) { return; }
 
+        if (recMode == RECORDER_MODE_CHANNELS) {
+            startChannels();
+            return;
+        }
+
         // Configure the wav writer
         if (recMode == RECORDER_MODE_AUDIO) {
             if (selectedStreamName.empty()) { return; }
@@ -170,7 +213,7 @@ public:
         // Open file
         std::string type = (recMode == RECORDER_MODE_AUDIO) ? "audio" : "baseband";
         std::string vfoName = (recMode == RECORDER_MODE_AUDIO) ? selectedStreamName : "";
-        std::string extension = ".wav";
+        std::string extension = getExtension();
         std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, vfoName) + extension);
         if (!writer.open(expandedPath)) {
             flog::error("Failed to open file for recording: {0}", expandedPath);
@@ -205,7 +248,12 @@ public:
         if (!recording) { return; }
 
         // Close audio stream or baseband
-        if (recMode == RECORDER_MODE_AUDIO) {
+        if (recMode == RECORDER_MODE_CHANNELS) {
+            stopChannels();
+            recording = false;
+            return;
+        }
+        else if (recMode == RECORDER_MODE_AUDIO) {
             splitter.unbindStream(&stereoStream);
             monoSink.stop();
             stereoSink.stop();
@@ -233,7 +281,7 @@ private:
         // Recording mode
         if (_this->recording) { style::beginDisabled(); }
         ImGui::BeginGroup();
-        ImGui::Columns(2, CONCAT("RecorderModeColumns##_", _this->name), false);
+        ImGui::Columns(3, CONCAT("RecorderModeColumns##_", _this->name), false);
         if (ImGui::RadioButton(CONCAT("Baseband##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_BASEBAND)) {
             _this->recMode = RECORDER_MODE_BASEBAND;
             config.acquire();
@@ -247,6 +295,14 @@ private:
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
         }
+        ImGui::NextColumn();
+        if (ImGui::RadioButton(CONCAT("Channels##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_CHANNELS)) {
+            _this->recMode = RECORDER_MODE_CHANNELS;
+            _this->refreshBookmarkLists();
+            config.acquire();
+            config.conf[_this->name]["mode"] = _this->recMode;
+            config.release(true);
+        }
         ImGui::Columns(1, CONCAT("EndRecorderModeColumns##_", _this->name), false);
         ImGui::EndGroup();
         if (_this->recording) { style::endDisabled(); }
@@ -324,6 +380,31 @@ private:
             }
         }
 
+        // Show channel options
+        if (_this->recMode == RECORDER_MODE_CHANNELS) {
+            if (_this->recording) { style::beginDisabled(); }
+            ImGui::LeftLabel("Channels");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_ch_src_", _this->name), &_this->channelSourceId, _this->channelSources.txt)) {
+                _this->refreshBookmarkLists();
+                config.acquire();
+                config.conf[_this->name]["channelSource"] = _this->channelSources.key(_this->channelSourceId);
+                config.release(true);
+            }
+
+            if (_this->channelSources[_this->channelSourceId] == CHANNEL_SOURCE_BOOKMARKS) {
+                ImGui::LeftLabel("List");
+                ImGui::FillWidth();
+                if (ImGui::Combo(CONCAT("##_recorder_ch_list_", _this->name), &_this->bookmarkListId, _this->bookmarkLists.txt)) {
+                    _this->selectedBookmarkList = _this->bookmarkLists.key(_this->bookmarkListId);
+                    config.acquire();
+                    config.conf[_this->name]["bookmarkList"] = _this->selectedBookmarkList;
+                    config.release(true);
+                }
+            }
+            if (_this->recording) { style::endDisabled(); }
+        }
+
         // Record button
         bool canRecord = _this->folderSelect.pathIsValid();
         if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty(); }
@@ -338,15 +419,42 @@ private:
                 _this->stop();
             }
             uint64_t seconds = _this->writer.getSamplesWritten() / _this->samplerate;
+            if (_this->recMode == RECORDER_MODE_CHANNELS) {
+                seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - _this->channelsStartTime).count();
+            }
             time_t diff = seconds;
             tm* dtm = gmtime(&diff);
 
-            if (_this->ignoreSilence && _this->ignoringSilence) {
+            if (_this->recMode == RECORDER_MODE_CHANNELS) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %d channels %02d:%02d:%02d", (int)_this->channels.size(), dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
+            }
+            else if (_this->ignoreSilence && _this->ignoringSilence) {
                 ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Paused %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
             else {
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
+
+            // Disk buffer, turns yellow once the disk couldn't keep up at least once
+            if (_this->recMode == RECORDER_MODE_CHANNELS) {
+                size_t dropped = 0;
+                int overruns = 0;
+                for (auto& ch : _this->channels) {
+                    dropped += ch->samplesDropped;
+                    overruns += ch->overruns;
+                }
+                if (overruns) {
+                    ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Dropped %zu samples in %d overruns", dropped, overruns);
+                }
+            }
+            else {
+                int overruns = _this->writer.getOverruns();
+                ImVec4 col = overruns ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f) : ImGui::GetStyleColorVec4(ImGuiCol_Text);
+                ImGui::TextColored(col, "Buffer %d%% (max %d%%)", (int)(_this->writer.getBufferFill() * 100.0f), (int)(_this->writer.getMaxBufferFill() * 100.0f));
+                if (overruns) {
+                    ImGui::TextColored(col, "Dropped %zu samples in %d overruns", _this->writer.getSamplesDropped(), overruns);
+                }
+            }
         }
     }
 
@@ -450,14 +558,17 @@ private:
     };
 
     std::string genFileName(std::string templ, std::string type, std::string name) {
-        // Get data
-        time_t now = time(0);
-        tm* ltm = localtime(&now);
-        char buf[1024];
         double freq = gui::waterfall.getCenterFrequency();
         if (gui::waterfall.vfos.find(name) != gui::waterfall.vfos.end()) {
             freq += gui::waterfall.vfos[name]->generalOffset;
         }
+        return genFileName(templ, type, name, freq);
+    }
+
+    std::string genFileName(std::string templ, std::string type, std::string name, double freq) {
+        // Get data
+        time_t now = time(0);
+        tm* ltm = localtime(&now);
 
         // Format to string
         char freqStr[128];
@@ -494,6 +605,10 @@ private:
         return templ;
     }
 
+    std::string getExtension() {
+        return (containers[containerId] == wav::FORMAT_W64) ? ".w64" : ".wav";
+    }
+
     std::string expandString(std::string input) {
         input = std::regex_replace(input, std::regex("%ROOT%"), root);
         return std::regex_replace(input, std::regex("//"), "/");
@@ -534,6 +649,247 @@ private:
         _this->writer.write(data, count);
     }
 
+    struct Channel {
+        std::string name;
+        double frequency;
+        double bandwidth;
+        VFOManager::VFO* vfo;
+        dsp::sink::Handler<dsp::complex_t> sink;
+        wav::Writer writer;
+        std::atomic<bool> inBand = true;
+        std::chrono::steady_clock::time_point outOfBandSince;
+
+        // Samples waiting for the IO thread, swapped with writeBuf to write them outside of the lock.
+        // At most maxPending samples are kept, the rest is dropped and counted.
+        std::mutex bufMtx;
+        std::vector<dsp::complex_t> pending;
+        std::vector<dsp::complex_t> writeBuf;
+        size_t maxPending;
+        bool overrunning = false;
+        std::atomic<size_t> samplesDropped = 0;
+        std::atomic<int> overruns = 0;
+    };
+
+    void refreshBookmarkLists() {
+        // The lists are read from the frequency manager's config, it has no interface to get them
+        bookmarkLists.clear();
+        json fmConf = loadBookmarkConfig();
+        if (fmConf.contains("lists") && fmConf["lists"].is_object()) {
+            for (auto& [listName, list] : fmConf["lists"].items()) {
+                bookmarkLists.define(listName, listName, listName);
+            }
+        }
+
+        if (bookmarkLists.empty()) { return; }
+        if (!bookmarkLists.keyExists(selectedBookmarkList)) {
+            selectedBookmarkList = bookmarkLists.key(0);
+        }
+        bookmarkListId = bookmarkLists.keyId(selectedBookmarkList);
+    }
+
+    json loadBookmarkConfig() {
+        json fmConf = json::object();
+        std::string path = root + "/frequency_manager_config.json";
+        if (!std::filesystem::is_regular_file(path)) { return fmConf; }
+        try {
+            std::ifstream file(path);
+            file >> fmConf;
+            file.close();
+        }
+        catch (const std::exception& e) {
+            flog::error("Could not read bookmarks from {0}: {1}", path, e.what());
+        }
+        return fmConf;
+    }
+
+    // Frequency, bandwidth and name of the channels to record
+    std::vector<std::tuple<std::string, double, double>> listChannels() {
+        std::vector<std::tuple<std::string, double, double>> list;
+        if (channelSources[channelSourceId] == CHANNEL_SOURCE_VFOS) {
+            // Every VFO of the other modules
+            double center = gui::waterfall.getCenterFrequency();
+            std::lock_guard<std::mutex> lck(channelVFOsMtx);
+            for (auto& [vfoName, vfo] : gui::waterfall.vfos) {
+                if (channelVFOs.find(vfoName) != channelVFOs.end()) { continue; }
+                list.push_back({ vfoName, center + vfo->generalOffset, sigpath::vfoManager.getBandwidth(vfoName) });
+            }
+        }
+        else {
+            json fmConf = loadBookmarkConfig();
+            if (!fmConf.contains("lists") || !fmConf["lists"].contains(selectedBookmarkList)) {
+                flog::error("Bookmark list '{0}' does not exist", selectedBookmarkList);
+                return list;
+            }
+            for (auto& [bmName, bm] : fmConf["lists"][selectedBookmarkList]["bookmarks"].items()) {
+                list.push_back({ bmName, (double)bm["frequency"], (double)bm["bandwidth"] });
+            }
+        }
+        return list;
+    }
+
+    void startChannels() {
+        // Only the channels within the band can be tuned by a VFO
+        double center = gui::waterfall.getCenterFrequency();
+        double halfBw = sigpath::iqFrontEnd.getEffectiveSamplerate() / 2.0;
+        auto list = listChannels();
+        for (auto& [chName, freq, bw] : list) {
+            double offset = freq - center;
+            if (bw <= 0.0 || fabs(offset) + (bw / 2.0) > halfBw) {
+                flog::warn("Recorder '{0}' skipping channel '{1}' at {2}Hz, it is outside of the band", name, chName, freq);
+                continue;
+            }
+
+            Channel* ch = new Channel;
+            ch->name = chName;
+            ch->frequency = freq;
+            ch->bandwidth = bw;
+            double sr = std::round(bw * CHANNEL_OVERSAMPLING);
+            ch->maxPending = sr * CHANNEL_MAX_PENDING;
+
+            ch->writer.setFormat(containers[containerId]);
+            ch->writer.setChannels(2);
+            ch->writer.setSampleType(sampleTypes[sampleTypeId]);
+            ch->writer.setSamplerate(sr);
+
+            // The channel name is appended so that channels on the same frequency never share a file
+            std::string safeName = std::regex_replace(chName, std::regex("[\\\\/:*?\"<>|]"), "_");
+            std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, "channel", chName, freq) + "_" + safeName + getExtension());
+            if (!ch->writer.open(expandedPath)) {
+                flog::error("Failed to open file for recording: {0}", expandedPath);
+                delete ch;
+                continue;
+            }
+
+            std::string vfoName = name + " CH" + std::to_string(channels.size() + 1);
+            ch->vfo = sigpath::vfoManager.createVFO(vfoName, ImGui::WaterfallVFO::REF_CENTER, offset, bw, sr, bw, bw, true);
+            if (!ch->vfo) {
+                flog::error("Could not create VFO '{0}'", vfoName);
+                ch->writer.close();
+                delete ch;
+                continue;
+            }
+            sigpath::vfoManager.setCenterOffset(vfoName, offset);
+            {
+                std::lock_guard<std::mutex> lck(channelVFOsMtx);
+                channelVFOs.insert(vfoName);
+            }
+            ch->sink.init(ch->vfo->output, channelHandler, ch);
+            channels.push_back(ch);
+        }
+
+        if (channels.empty()) {
+            flog::error("Recorder '{0}' has no channel to record", name);
+            return;
+        }
+
+        // Start the IO thread first so that nothing piles up
+        ioRunning = true;
+        ioThread = std::thread(&RecorderModule::ioWorker, this);
+        for (auto& ch : channels) { ch->sink.start(); }
+
+        flog::info("Recorder '{0}' recording {1} channels", name, channels.size());
+        channelsStartTime = std::chrono::steady_clock::now();
+        recording = true;
+    }
+
+    void stopChannels() {
+        for (auto& ch : channels) {
+            ch->sink.stop();
+            {
+                std::lock_guard<std::mutex> lck(channelVFOsMtx);
+                channelVFOs.erase(ch->vfo->getName());
+            }
+            sigpath::vfoManager.deleteVFO(ch->vfo);
+        }
+
+        // Stop the IO thread, it flushes whatever is left before exiting
+        {
+            std::lock_guard<std::mutex> lck(ioMtx);
+            ioRunning = false;
+        }
+        ioCnd.notify_all();
+        if (ioThread.joinable()) { ioThread.join(); }
+
+        for (auto& ch : channels) {
+            ch->writer.close();
+            delete ch;
+        }
+        channels.clear();
+    }
+
+    static void retuneChannels(double freq, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        std::lock_guard<std::recursive_mutex> lck(_this->recMtx);
+        if (!_this->recording || _this->recMode != RECORDER_MODE_CHANNELS) { return; }
+
+        // Keep the VFOs on their channel, those that fall out of the band stop being written. Their files then
+        // have a gap, logged with its position in the recording.
+        double halfBw = sigpath::iqFrontEnd.getEffectiveSamplerate() / 2.0;
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - _this->channelsStartTime).count();
+        for (auto& ch : _this->channels) {
+            double offset = ch->frequency - freq;
+            bool inBand = (fabs(offset) + (ch->bandwidth / 2.0) <= halfBw);
+            if (inBand) { sigpath::vfoManager.setCenterOffset(ch->vfo->getName(), offset); }
+            if (inBand == ch->inBand) { continue; }
+            ch->inBand = inBand;
+
+            if (!inBand) {
+                ch->outOfBandSince = now;
+                flog::warn("Recorder '{0}' channel '{1}' is out of band, its recording is paused at {2}s", _this->name, ch->name, (int)elapsed);
+            }
+            else {
+                double gap = std::chrono::duration<double>(now - ch->outOfBandSince).count();
+                flog::warn("Recorder '{0}' channel '{1}' is back in band at {2}s, its file is missing the last {3}s", _this->name, ch->name, (int)elapsed, (int)std::round(gap));
+            }
+        }
+    }
+
+    static void channelHandler(dsp::complex_t* data, int count, void* ctx) {
+        Channel* ch = (Channel*)ctx;
+        if (!ch->inBand) { return; }
+        std::lock_guard<std::mutex> lck(ch->bufMtx);
+
+        // Drop what doesn't fit instead of growing without limit when the IO thread falls behind
+        int room = (ch->pending.size() < ch->maxPending) ? ch->maxPending - ch->pending.size() : 0;
+        int written = std::min<int>(count, room);
+        ch->pending.insert(ch->pending.end(), data, data + written);
+        if (written == count) {
+            ch->overrunning = false;
+            return;
+        }
+        ch->samplesDropped += count - written;
+        if (!ch->overrunning) {
+            ch->overruns++;
+            flog::warn("Recorder channel '{0}' can't be written fast enough, dropping samples", ch->name);
+        }
+        ch->overrunning = true;
+    }
+
+    void ioWorker() {
+        while (true) {
+            bool run;
+            {
+                std::unique_lock<std::mutex> lck(ioMtx);
+                ioCnd.wait_for(lck, std::chrono::milliseconds(CHANNEL_FLUSH_INTERVAL), [this]() { return !ioRunning; });
+                run = ioRunning;
+            }
+
+            // Write every channel in one go instead of having each VFO thread hit the disk
+            for (auto& ch : channels) {
+                {
+                    std::lock_guard<std::mutex> lck(ch->bufMtx);
+                    std::swap(ch->pending, ch->writeBuf);
+                }
+                if (ch->writeBuf.empty()) { continue; }
+                ch->writer.write((float*)ch->writeBuf.data(), ch->writeBuf.size());
+                ch->writeBuf.clear();
+            }
+
+            if (!run) { break; }
+        }
+    }
+
     static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
         std::lock_guard lck(_this->recMtx);
@@ -544,7 +900,7 @@ private:
         else if (code == RECORDER_IFACE_CMD_SET_MODE) {
             if (_this->recording) { return; }
             int* _in = (int*)in;
-            _this->recMode = std::clamp<int>(*_in, 0, 1);
+            _this->recMode = std::clamp<int>(*_in, 0, 2);
         }
         else if (code == RECORDER_IFACE_CMD_START) {
             if (!_this->recording) { _this->start(); }
@@ -593,8 +949,27 @@ private:
 
     uint64_t samplerate = 48000;
 
+    enum ChannelSource {
+        CHANNEL_SOURCE_VFOS,
+        CHANNEL_SOURCE_BOOKMARKS
+    };
+
+    OptionList<std::string, ChannelSource> channelSources;
+    int channelSourceId;
+    OptionList<std::string, std::string> bookmarkLists;
+    int bookmarkListId = 0;
+    std::string selectedBookmarkList = "";
+
+    std::vector<Channel*> channels;
+    std::chrono::steady_clock::time_point channelsStartTime;
+    std::thread ioThread;
+    std::mutex ioMtx;
+    std::condition_variable ioCnd;
+    bool ioRunning = false;
+
     EventHandler<std::string> onStreamRegisteredHandler;
     EventHandler<std::string> onStreamUnregisterHandler;
+    EventHandler<double> retuneHandler;
 
 };
 
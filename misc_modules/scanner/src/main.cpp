@@ -257,9 +257,14 @@ private:
     float getMaxLevel(float* data, double freq, double width, int dataWidth, double wfStart, double wfWidth) {
         double low = freq - (width/2.0);
         double high = freq + (width/2.0);
+
+        // Use the full resolution spectrum if available
+        float min, max;
+        if (gui::waterfall.getSpectrumRange(low, high, min, max)) { return max; }
+
         int lowId = std::clamp<int>((low - wfStart) * (double)dataWidth / wfWidth, 0, dataWidth - 1);
         int highId = std::clamp<int>((high - wfStart) * (double)dataWidth / wfWidth, 0, dataWidth - 1);
-        float max = -INFINITY;
+        max = -INFINITY;
         for (int i = lowId; i <= highId; i++) {
             if (data[i] > max) { max = data[i]; }
         }
@@ -7,6 +7,7 @@
 #include <gui/style.h>
 #include <config.h>
 #include <gui/smgui.h>
+#include <dsp/ring_stream.h>
 #include <airspy.h>
 
 #ifdef __ANDROID__
@@ -596,7 +597,7 @@ private:
     std::string name;
     airspy_device* openDev;
     bool enabled = true;
-    dsp::stream<dsp::complex_t> stream;
+    dsp::ring_stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
     bool running = false;
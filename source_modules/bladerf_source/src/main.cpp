@@ -9,6 +9,7 @@
 #include <gui/widgets/stepped_slider.h>
 #include <libbladeRF.h>
 #include <gui/smgui.h>
+#include <dsp/convert/raw_iq.h>
 #include <algorithm>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
@@ -547,7 +548,7 @@ private:
             if (ret != 0) { break; }
 
             // Convert to complex float and swap buffers
-            volk_16i_s32f_convert_32f((float*)stream.writeBuf, buffer, 32768.0f, bufferSize * 2);
+            dsp::convert::s16ToComplex(buffer, stream.writeBuf, bufferSize, 0.0f, 1.0f / 32768.0f);
             if (!stream.swap(bufferSize)) { break; }
         }
 
@@ -0,0 +1,10 @@
+#pragma once
+
+enum {
+    FILE_SOURCE_IFACE_CMD_GET_POSITION,
+    FILE_SOURCE_IFACE_CMD_GET_LENGTH,
+    FILE_SOURCE_IFACE_CMD_SEEK,
+    FILE_SOURCE_IFACE_CMD_SET_MAX_SPEED,
+    FILE_SOURCE_IFACE_CMD_SET_LOOP,
+    FILE_SOURCE_IFACE_CMD_IS_AT_END
+};
@@ -5,13 +5,20 @@
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
 #include <wavreader.h>
+#include <file_source_interface.h>
 #include <core.h>
 #include <gui/widgets/file_select.h>
 #include <filesystem>
 #include <regex>
 #include <gui/tuner.h>
+#include <gui/style.h>
+#include <dsp/convert/raw_iq.h>
 #include <algorithm>
 #include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
@@ -27,15 +34,20 @@ ConfigManager config;
 
 class FileSourceModule : public ModuleManager::Instance {
 public:
-    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav)", "*.wav", "All Files", "*" }) {
+    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav *.w64)", "*.wav *.w64", "All Files", "*" }) {
         this->name = name;
 
         if (core::args["server"].b()) { return; }
 
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
+        if (config.conf.contains("maxSpeed")) { maxSpeed = (bool)config.conf["maxSpeed"]; }
+        if (config.conf.contains("loop")) { loop = (bool)config.conf["loop"]; }
         config.release();
 
+        // Open the last file right away so that it can be played without the menu being drawn (headless mode)
+        if (fileSelect.pathIsValid()) { openFile(fileSelect.path); }
+
         handler.ctx = this;
         handler.selectHandler = menuSelected;
         handler.deselectHandler = menuDeselected;
@@ -45,11 +57,14 @@ public:
         handler.tuneHandler = tune;
         handler.stream = &stream;
         sigpath::sourceManager.registerSource("File", &handler);
+        core::modComManager.registerInterface("file_source", name, moduleInterfaceHandler, this);
     }
 
     ~FileSourceModule() {
         stop(this);
+        core::modComManager.unregisterInterface(name);
         sigpath::sourceManager.unregisterSource("File");
+        if (reader) { delete reader; }
     }
 
     void postInit() {}
@@ -91,8 +106,10 @@ private:
         FileSourceModule* _this = (FileSourceModule*)ctx;
         if (_this->running) { return; }
         if (_this->reader == NULL) { return; }
+        _this->workerStop = false;
+        _this->workerWake = false;
         _this->running = true;
-        _this->workerThread = _this->float32Mode ? std::thread(floatWorker, _this) : std::thread(worker, _this);
+        _this->workerThread = std::thread(worker, _this);
         flog::info("FileSourceModule '{0}': Start!", _this->name);
     }
 
@@ -100,11 +117,15 @@ private:
         FileSourceModule* _this = (FileSourceModule*)ctx;
         if (!_this->running) { return; }
         if (_this->reader == NULL) { return; }
+        {
+            std::lock_guard<std::mutex> lck(_this->readerMtx);
+            _this->workerStop = true;
+        }
+        _this->workerCnd.notify_all();
         _this->stream.stopWriter();
         _this->workerThread.join();
         _this->stream.clearWriteStop();
         _this->running = false;
-        _this->reader->rewind();
         flog::info("FileSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -118,68 +139,264 @@ private:
 
         if (_this->fileSelect.render("##file_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
-                if (_this->reader != NULL) {
-                    _this->reader->close();
-                    delete _this->reader;
-                }
-                try {
-                    _this->reader = new WavReader(_this->fileSelect.path);
-                    if (_this->reader->getSampleRate() == 0) {
-                        _this->reader->close();
-                        delete _this->reader;
-                        _this->reader = NULL;
-                        throw std::runtime_error("Sample rate may not be zero");
-                    }
-                    _this->sampleRate = _this->reader->getSampleRate();
+                if (_this->openFile(_this->fileSelect.path)) {
                     core::setInputSampleRate(_this->sampleRate);
-                    std::string filename = std::filesystem::path(_this->fileSelect.path).filename().string();
-                    _this->centerFreq = _this->getFrequency(filename);
                     tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", _this->centerFreq);
                     //gui::freqSelect.minFreq = _this->centerFreq - (_this->sampleRate/2);
                     //gui::freqSelect.maxFreq = _this->centerFreq + (_this->sampleRate/2);
                     //gui::freqSelect.limitFreq = true;
                 }
-                catch (const std::exception& e) {
-                    flog::error("Error: {}", e.what());
-                }
                 config.acquire();
                 config.conf["path"] = _this->fileSelect.path;
                 config.release(true);
             }
         }
 
-        ImGui::Checkbox("Float32 Mode##_file_source", &_this->float32Mode);
+        if (_this->reader == NULL) { return; }
+
+        // The sample format comes from the WAV header
+        ImGui::Text("Format: %s%d", _this->float32Mode ? "Float" : "Int", _this->reader->getBitDepth());
+
+        // Scrub bar
+        double length = _this->getLength();
+        float pos;
+        {
+            std::lock_guard<std::mutex> lck(_this->readerMtx);
+            pos = (double)_this->reader->tell() / _this->sampleRate;
+        }
+        ImGui::Text("%s / %s", formatTime(pos).c_str(), formatTime(length).c_str());
+        if (_this->atEnd) {
+            ImGui::SameLine();
+            ImGui::TextUnformatted("(end)");
+        }
+        ImGui::FillWidth();
+        if (ImGui::SliderFloat(CONCAT("##_file_source_pos_", _this->name), &pos, 0.0f, length, "")) {
+            _this->seek(pos);
+        }
+
+        // Loop range, set from the current position
+        bool loop = _this->loop;
+        if (ImGui::Checkbox(CONCAT("Loop##_file_source_loop_", _this->name), &loop)) {
+            _this->loop = loop;
+            _this->updateRange();
+            config.acquire();
+            config.conf["loop"] = loop;
+            config.release(true);
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox(CONCAT("Loop range##_file_source_loop_range_", _this->name), &_this->loopRange)) {
+            _this->updateRange();
+        }
+        if (ImGui::Button(CONCAT("Set start##_file_source_loop_start_", _this->name))) {
+            _this->loopStart = std::min<uint64_t>(pos * _this->sampleRate, _this->loopEnd);
+            _this->updateRange();
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s", formatTime((double)_this->loopStart / _this->sampleRate).c_str());
+        if (ImGui::Button(CONCAT("Set end##_file_source_loop_end_", _this->name))) {
+            _this->loopEnd = std::max<uint64_t>(pos * _this->sampleRate, _this->loopStart);
+            _this->updateRange();
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s", formatTime((double)_this->loopEnd / _this->sampleRate).c_str());
+
+        bool maxSpeed = _this->maxSpeed;
+        if (ImGui::Checkbox(CONCAT("Max speed##_file_source_max_speed_", _this->name), &maxSpeed)) {
+            _this->maxSpeed = maxSpeed;
+            config.acquire();
+            config.conf["maxSpeed"] = maxSpeed;
+            config.release(true);
+        }
     }
 
-    static void worker(void* ctx) {
-        FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
-        int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        int16_t* inBuf = new int16_t[blockSize * 2];
+    bool openFile(std::string path) {
+        // The worker can't keep running on a reader that is being replaced
+        bool wasRunning = running;
+        if (wasRunning) { stop(this); }
+
+        WavReader* newReader = new WavReader(path);
+        if (!newReader->isValid() || newReader->getSampleRate() == 0) {
+            flog::error("FileSourceModule '{0}': Could not open {1}, the file is invalid or its sample rate is zero", name, path);
+            delete newReader;
+            if (wasRunning) { start(this); }
+            return false;
+        }
 
-        while (true) {
-            _this->reader->readSamples(inBuf, blockSize * 2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, inBuf, 32768.0f, blockSize * 2);
-            if (!_this->stream.swap(blockSize)) { break; };
+        // Only stereo IQ in the sample formats the worker can convert
+        int bitDepth = newReader->getBitDepth();
+        bool isFloat = (newReader->getCodec() == WAV_SAMPLE_TYPE_FLOAT);
+        bool supported = isFloat ? (bitDepth == 32) : (newReader->getCodec() == WAV_SAMPLE_TYPE_PCM && (bitDepth == 8 || bitDepth == 16 || bitDepth == 24 || bitDepth == 32));
+        if (newReader->getChannelCount() != 2 || !supported || newReader->getFrameSize() != bitDepth / 4) {
+            flog::error("FileSourceModule '{0}': Could not open {1}, only stereo 8, 16, 24 or 32bit integer and 32bit float files are supported", name, path);
+            delete newReader;
+            if (wasRunning) { start(this); }
+            return false;
+        }
+        if (newReader->wasRecovered()) {
+            flog::warn("FileSourceModule '{0}': The header of the file was not finalized, using the length of the file instead", name);
+        }
+        if (!newReader->isMapped()) {
+            flog::warn("FileSourceModule '{0}': Could not map the file to memory, falling back to regular reads", name);
         }
 
-        delete[] inBuf;
+        {
+            std::lock_guard<std::mutex> lck(readerMtx);
+            if (reader) { delete reader; }
+            reader = newReader;
+            float32Mode = (reader->getCodec() == WAV_SAMPLE_TYPE_FLOAT);
+            sampleRate = reader->getSampleRate();
+            loopRange = false;
+            loopStart = 0;
+            loopEnd = reader->getSampleCount();
+        }
+        updateRange();
+
+        std::string filename = std::filesystem::path(path).filename().string();
+        centerFreq = getFrequency(filename);
+
+        if (wasRunning) { start(this); }
+        return true;
+    }
+
+    // Length of the file in seconds
+    double getLength() {
+        std::lock_guard<std::mutex> lck(readerMtx);
+        if (!reader) { return 0.0; }
+        return (double)reader->getSampleCount() / sampleRate;
     }
 
-    static void floatWorker(void* ctx) {
+    void seek(double time) {
+        {
+            std::lock_guard<std::mutex> lck(readerMtx);
+            if (!reader) { return; }
+            reader->seek(std::max<double>(time, 0.0) * sampleRate);
+            workerWake = true;
+        }
+        workerCnd.notify_all();
+    }
+
+    void updateRange() {
+        {
+            std::lock_guard<std::mutex> lck(readerMtx);
+            if (!reader) { return; }
+            if (loopRange) {
+                reader->setRange(loopStart, loopEnd);
+                reader->setLooping(true);
+            }
+            else {
+                reader->setRange(0, reader->getSampleCount());
+                reader->setLooping(loop);
+            }
+            workerWake = true;
+        }
+        workerCnd.notify_all();
+    }
+
+    static std::string formatTime(double seconds) {
+        char buf[64];
+        uint64_t ms = std::max<double>(seconds, 0.0) * 1000.0;
+        sprintf(buf, "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)((ms / 60000) % 60), (int)((ms / 1000) % 60), (int)(ms % 1000));
+        return buf;
+    }
+
+    static void worker(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
         double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
         int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        dsp::complex_t* inBuf = new dsp::complex_t[blockSize];
+        bool floatMode = _this->float32Mode;
+        int bitDepth = _this->reader->getBitDepth();
+        uint8_t* inBuf = new uint8_t[blockSize * _this->reader->getFrameSize()];
+
+        // Samples are sent at the sample rate of the file measured against a steady clock instead of the time the
+        // blocks take to send so that the rate doesn't drift. In max speed mode, the only limit is how fast the DSP
+        // takes the samples.
+        auto clockStart = std::chrono::steady_clock::now();
+        uint64_t sent = 0;
 
         while (true) {
-            _this->reader->readSamples(_this->stream.writeBuf, blockSize * sizeof(dsp::complex_t));
-            if (!_this->stream.swap(blockSize)) { break; };
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lck(_this->readerMtx);
+                count = _this->reader->read(floatMode ? (void*)_this->stream.writeBuf : (void*)inBuf, blockSize);
+                if (!count) {
+                    // End of the file and not looping, wait for a seek or a change of range
+                    _this->atEnd = true;
+                    _this->workerCnd.wait(lck, [_this]() { return _this->workerWake || _this->workerStop; });
+                    _this->atEnd = false;
+                    _this->workerWake = false;
+                    if (_this->workerStop) { break; }
+                    clockStart = std::chrono::steady_clock::now();
+                    sent = 0;
+                    continue;
+                }
+                _this->workerWake = false;
+            }
+
+            // 8bit WAV samples are unsigned, the others are signed
+            if (!floatMode) {
+                dsp::complex_t* out = _this->stream.writeBuf;
+                switch (bitDepth) {
+                case 8:
+                    dsp::convert::toComplex(dsp::convert::IQ_FORMAT_U8, inBuf, out, count, 128.0f, 1.0f / 128.0f);
+                    break;
+                case 16:
+                    dsp::convert::toComplex(dsp::convert::IQ_FORMAT_S16, inBuf, out, count, 0.0f, 1.0f / 32768.0f);
+                    break;
+                case 24:
+                    dsp::convert::toComplex(dsp::convert::IQ_FORMAT_S24, inBuf, out, count, 0.0f, 1.0f / 8388608.0f);
+                    break;
+                case 32:
+                    volk_32i_s32f_convert_32f((float*)out, (int32_t*)inBuf, 2147483648.0f, count * 2);
+                    break;
+                }
+            }
+            if (!_this->stream.swap(count)) { break; };
+
+            if (_this->maxSpeed) {
+                clockStart = std::chrono::steady_clock::now();
+                sent = 0;
+                continue;
+            }
+
+            // Don't try to catch up if the DSP fell behind by a lot, it would only make things worse
+            sent += count;
+            auto target = clockStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((double)sent / sampleRate));
+            auto now = std::chrono::steady_clock::now();
+            if (now - target > std::chrono::seconds(1)) {
+                clockStart = now;
+                sent = 0;
+                continue;
+            }
+            std::this_thread::sleep_until(target);
         }
 
         delete[] inBuf;
     }
 
+    static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
+        FileSourceModule* _this = (FileSourceModule*)ctx;
+        if (code == FILE_SOURCE_IFACE_CMD_GET_POSITION && out) {
+            std::lock_guard<std::mutex> lck(_this->readerMtx);
+            *(double*)out = _this->reader ? ((double)_this->reader->tell() / _this->sampleRate) : 0.0;
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_GET_LENGTH && out) {
+            *(double*)out = _this->getLength();
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_SEEK && in) {
+            _this->seek(*(double*)in);
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_SET_MAX_SPEED && in) {
+            _this->maxSpeed = *(bool*)in;
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_SET_LOOP && in) {
+            _this->loop = *(bool*)in;
+            _this->updateRange();
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_IS_AT_END && out) {
+            *(bool*)out = _this->atEnd;
+        }
+    }
+
     double getFrequency(std::string filename) {
         std::regex expr("[0-9]+Hz");
         std::smatch matches;
@@ -194,6 +411,11 @@ private:
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
     WavReader* reader = NULL;
+    std::mutex readerMtx;
+    std::condition_variable workerCnd;
+    bool workerStop = false;
+    bool workerWake = false;
+    std::atomic<bool> atEnd = false;
     bool running = false;
     bool enabled = true;
     float sampleRate = 1000000;
@@ -202,11 +424,18 @@ private:
     double centerFreq = 100000000;
 
     bool float32Mode = false;
+    std::atomic<bool> maxSpeed = false;
+    std::atomic<bool> loop = true;
+    bool loopRange = false;
+    uint64_t loopStart = 0;
+    uint64_t loopEnd = 0;
 };
 
 MOD_EXPORT void _INIT_() {
     json def = json({});
     def["path"] = "";
+    def["maxSpeed"] = false;
+    def["loop"] = true;
     config.setPath(core::args["root"].s() + "/file_source_config.json");
     config.load(def);
     config.enableAutoSave();
@@ -1,25 +1,63 @@
-#pragma once
-
 #pragma once
 #include <stdint.h>
 #include <string.h>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define WAV_SIGNATURE       "RIFF"
+#define RF64_SIGNATURE      "RF64"
 #define WAV_TYPE            "WAVE"
 #define WAV_FORMAT_MARK     "fmt "
 #define WAV_DATA_MARK       "data"
+#define WAV_DS64_MARK       "ds64"
 #define WAV_SAMPLE_TYPE_PCM 1
+#define WAV_SAMPLE_TYPE_FLOAT 3
+#define WAV_SAMPLE_TYPE_EXTENSIBLE 0xFFFE
 
+// Reads RIFF WAV, RF64 and Sony Wave64 files. Files whose sizes were never written, for example because
+// the recording crashed, are recovered by taking the data to go until the end of the file.
+// The samples are read through a memory mapping of the file when possible so that seeking is free and reading
+// costs a single copy, with a fallback to regular reads otherwise (eg. 32bit builds with very large files).
 class WavReader {
 public:
     WavReader(std::string path) {
         file = std::ifstream(path.c_str(), std::ios::binary);
-        file.read((char*)&hdr, sizeof(WavHeader_t));
         valid = false;
-        if (memcmp(hdr.signature, "RIFF", 4) != 0) { return; }
-        if (memcmp(hdr.fileType, "WAVE", 4) != 0) { return; }
-        valid = true;
+        if (!file.is_open()) { return; }
+        fileSize = std::filesystem::file_size(path);
+
+        char sig[W64_GUID_SIZE];
+        if (!readAt(0, sig, sizeof(sig))) { return; }
+        if ((!memcmp(sig, WAV_SIGNATURE, 4) || !memcmp(sig, RF64_SIGNATURE, 4)) && !memcmp(&sig[8], WAV_TYPE, 4)) {
+            valid = parseRIFF(!memcmp(sig, RF64_SIGNATURE, 4));
+        }
+        else if (!memcmp(sig, W64_RIFF_GUID, W64_GUID_SIZE)) {
+            valid = parseW64();
+        }
+        if (!valid) { return; }
+
+        // A size of zero or one going past the end of the file means the header was never finalized
+        if (!dataSize || dataOffset + dataSize > fileSize) {
+            dataSize = fileSize - dataOffset;
+            recovered = true;
+        }
+        if (hdr.bytesPerSample) { dataSize -= dataSize % hdr.bytesPerSample; }
+        rangeStart = 0;
+        rangeEnd = getSampleCount();
+        map(path);
+        rewind();
+    }
+
+    ~WavReader() {
+        close();
     }
 
     uint16_t getBitDepth() {
@@ -34,49 +72,242 @@ public:
         return hdr.sampleRate;
     }
 
+    uint16_t getCodec() {
+        return codec;
+    }
+
+    // Number of samples per channel
+    uint64_t getSampleCount() {
+        return hdr.bytesPerSample ? (dataSize / hdr.bytesPerSample) : 0;
+    }
+
     bool isValid() {
         return valid;
     }
 
-    void readSamples(void* data, size_t size) {
-        char* _data = (char*)data;
-        file.read(_data, size);
-        int read = file.gcount();
-        if (read < size) {
-            file.clear();
-            file.seekg(sizeof(WavHeader_t));
-            file.read(&_data[read], size - read);
+    // True if the data size was taken from the length of the file instead of the header
+    bool wasRecovered() {
+        return recovered;
+    }
+
+    // Size in bytes of one sample of all channels
+    uint16_t getFrameSize() {
+        return hdr.bytesPerSample;
+    }
+
+    // Reads up to count samples per channel from the current position. When the end of the range is reached, reading
+    // continues from the start of the range if looping, otherwise fewer samples than requested are returned.
+    size_t read(void* data, size_t count) {
+        uint8_t* _data = (uint8_t*)data;
+        size_t done = 0;
+        while (done < count) {
+            if (pos >= rangeEnd) {
+                if (!looping || rangeStart >= rangeEnd) { break; }
+                pos = rangeStart;
+            }
+            size_t toRead = std::min<uint64_t>(count - done, rangeEnd - pos);
+            if (!readAt(dataOffset + (pos * hdr.bytesPerSample), &_data[done * hdr.bytesPerSample], toRead * hdr.bytesPerSample)) {
+                break;
+            }
+            pos += toRead;
+            done += toRead;
         }
-        bytesRead += size;
+        return done;
+    }
+
+    // Position in samples per channel from the start of the data
+    uint64_t tell() {
+        return pos;
+    }
+
+    void seek(uint64_t sample) {
+        pos = std::min<uint64_t>(sample, getSampleCount());
+    }
+
+    // Restrict reading to the samples in [start, end)
+    void setRange(uint64_t start, uint64_t end) {
+        rangeEnd = std::min<uint64_t>(end, getSampleCount());
+        rangeStart = std::min<uint64_t>(start, rangeEnd);
+    }
+
+    void setLooping(bool enabled) {
+        looping = enabled;
     }
 
     void rewind() {
-        file.seekg(sizeof(WavHeader_t));
+        pos = rangeStart;
+    }
+
+    bool isMapped() {
+        return mapping != NULL;
     }
 
     void close() {
-        file.close();
+        unmap();
+        if (file.is_open()) { file.close(); }
     }
 
 private:
-    struct WavHeader_t {
-        char signature[4];           // "RIFF"
-        uint32_t fileSize;           // data bytes + sizeof(WavHeader_t) - 8
-        char fileType[4];            // "WAVE"
-        char formatMarker[4];        // "fmt "
-        uint32_t formatHeaderLength; // Always 16
-        uint16_t sampleType;         // PCM (1)
+#pragma pack(push, 1)
+    struct FormatHeader {
+        uint16_t sampleType;
         uint16_t channelCount;
         uint32_t sampleRate;
         uint32_t bytesPerSecond;
         uint16_t bytesPerSample;
         uint16_t bitDepth;
-        char dataMarker[4]; // "data"
-        uint32_t dataSize;
     };
 
+    struct DS64 {
+        uint64_t riffSize;
+        uint64_t dataSize;
+        uint64_t sampleCount;
+        uint32_t tableLength;
+    };
+#pragma pack(pop)
+
+    static const int W64_GUID_SIZE = 16;
+    static constexpr const char* W64_RIFF_GUID = "riff\x2E\x91\xCF\x11\xA5\xD6\x28\xDB\x04\xC1\x00\x00";
+    static constexpr const char* W64_WAVE_GUID = "wave\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+    static constexpr const char* W64_FMT_GUID = "fmt \xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+    static constexpr const char* W64_DATA_GUID = "data\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+
+    void map(std::string path) {
+        if (!fileSize || fileSize > SIZE_MAX) { return; }
+#ifdef _WIN32
+        mapFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (mapFile == INVALID_HANDLE_VALUE) { return; }
+        mapHandle = CreateFileMappingA(mapFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapHandle == NULL) {
+            unmap();
+            return;
+        }
+        mapping = (uint8_t*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+        if (mapping == NULL) { unmap(); }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return; }
+        void* ptr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) { return; }
+        mapping = (uint8_t*)ptr;
+
+        // Playback is mostly sequential, this makes the kernel read ahead further and drop pages that were played
+        madvise(mapping, fileSize, MADV_SEQUENTIAL);
+#endif
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (mapping) { UnmapViewOfFile(mapping); }
+        if (mapHandle) { CloseHandle(mapHandle); }
+        if (mapFile != INVALID_HANDLE_VALUE) { CloseHandle(mapFile); }
+        mapHandle = NULL;
+        mapFile = INVALID_HANDLE_VALUE;
+#else
+        if (mapping) { munmap(mapping, fileSize); }
+#endif
+        mapping = NULL;
+    }
+
+    bool readAt(uint64_t offset, void* data, size_t size) {
+        if (mapping) {
+            if (offset + size > fileSize) { return false; }
+            memcpy(data, &mapping[offset], size);
+            return true;
+        }
+        file.clear();
+        file.seekg(offset);
+        file.read((char*)data, size);
+        return file.gcount() == size;
+    }
+
+    bool readFormat(uint64_t offset, uint64_t size) {
+        if (size < sizeof(FormatHeader) || !readAt(offset, &hdr, sizeof(FormatHeader))) { return false; }
+        codec = hdr.sampleType;
+
+        // The actual codec of extensible formats is in the first two bytes of the sub-format GUID
+        if (codec == WAV_SAMPLE_TYPE_EXTENSIBLE && size >= 26) {
+            readAt(offset + 24, &codec, sizeof(codec));
+        }
+        return true;
+    }
+
+    bool parseRIFF(bool rf64) {
+        DS64 ds64 = { 0 };
+        bool hasFormat = false;
+        uint64_t offset = 12;
+        while (offset + 8 <= fileSize) {
+            char id[4];
+            uint32_t size;
+            if (!readAt(offset, id, sizeof(id)) || !readAt(offset + 4, &size, sizeof(size))) { return false; }
+
+            if (!memcmp(id, WAV_DS64_MARK, 4)) {
+                readAt(offset + 8, &ds64, std::min<size_t>(size, sizeof(DS64)));
+            }
+            else if (!memcmp(id, WAV_FORMAT_MARK, 4)) {
+                hasFormat = readFormat(offset + 8, size);
+            }
+            else if (!memcmp(id, WAV_DATA_MARK, 4)) {
+                // Everything needed is before the data, and nothing can be trusted after it in a crashed file
+                dataOffset = offset + 8;
+                dataSize = (rf64 && size == 0xFFFFFFFF) ? ds64.dataSize : size;
+
+                // Sizes over 4GB saturate in plain RIFF files written by some software
+                if (!rf64 && size == 0xFFFFFFFF) { dataSize = 0; }
+                return hasFormat;
+            }
+
+            // Chunks are padded to an even size
+            offset += 8 + size + (size & 1);
+        }
+        return false;
+    }
+
+    bool parseW64() {
+        char form[W64_GUID_SIZE];
+        if (!readAt(24, form, sizeof(form)) || memcmp(form, W64_WAVE_GUID, W64_GUID_SIZE)) { return false; }
+
+        bool hasFormat = false;
+        uint64_t offset = 40;
+        while (offset + 24 <= fileSize) {
+            char guid[W64_GUID_SIZE];
+            uint64_t size;
+            if (!readAt(offset, guid, sizeof(guid)) || !readAt(offset + 16, &size, sizeof(size))) { return false; }
+
+            // Sizes include the 24 byte header
+            if (!memcmp(guid, W64_FMT_GUID, W64_GUID_SIZE)) {
+                hasFormat = readFormat(offset + 24, (size >= 24) ? (size - 24) : 0);
+            }
+            else if (!memcmp(guid, W64_DATA_GUID, W64_GUID_SIZE)) {
+                dataOffset = offset + 24;
+                dataSize = (size >= 24) ? (size - 24) : 0;
+                return hasFormat;
+            }
+            if (size < 24) { return false; }
+
+            // Chunks are aligned to 8 bytes
+            offset += (size + 7) & ~7ull;
+        }
+        return false;
+    }
+
     bool valid = false;
+    bool recovered = false;
     std::ifstream file;
-    size_t bytesRead = 0;
-    WavHeader_t hdr;
-};
\ No newline at end of file
+    uint64_t fileSize = 0;
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    uint64_t pos = 0;
+    uint64_t rangeStart = 0;
+    uint64_t rangeEnd = 0;
+    bool looping = true;
+    uint16_t codec = WAV_SAMPLE_TYPE_PCM;
+    FormatHeader hdr = { 0 };
+
+    uint8_t* mapping = NULL;
+#ifdef _WIN32
+    HANDLE mapFile = INVALID_HANDLE_VALUE;
+    HANDLE mapHandle = NULL;
+#endif
+};
@@ -7,6 +7,8 @@
 #include <config.h>
 #include <gui/widgets/stepped_slider.h>
 #include <gui/smgui.h>
+#include <dsp/ring_stream.h>
+#include <dsp/convert/raw_iq.h>
 
 #ifndef __ANDROID__
 #include <libhackrf/hackrf.h>
@@ -382,7 +384,7 @@ private:
 
     static int callback(hackrf_transfer* transfer) {
         HackRFSourceModule* _this = (HackRFSourceModule*)transfer->rx_ctx;
-        volk_8i_s32f_convert_32f((float*)_this->stream.writeBuf, (int8_t*)transfer->buffer, 128.0f, transfer->valid_length);
+        dsp::convert::s8ToComplex((int8_t*)transfer->buffer, _this->stream.writeBuf, transfer->valid_length / 2, 0.0f, 1.0f / 128.0f);
         if (!_this->stream.swap(transfer->valid_length / 2)) { return -1; }
         return 0;
     }
@@ -390,7 +392,7 @@ private:
     std::string name;
     hackrf_device* openDev;
     bool enabled = true;
-    dsp::stream<dsp::complex_t> stream;
+    dsp::ring_stream<dsp::complex_t> stream;
     int sampleRate;
     SourceManager::SourceHandler handler;
     bool running = false;
@@ -9,6 +9,7 @@
 #include <gui/smgui.h>
 #include <gui/widgets/stepped_slider.h>
 #include <utils/optionlist.h>
+#include <dsp/convert/raw_iq.h>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
@@ -294,10 +295,10 @@ private:
             int count = bytes / sampleSize;
             switch (sampType) {
             case SAMPLE_TYPE_INT8:
-                volk_8i_s32f_convert_32f((float*)stream.writeBuf, (int8_t*)buffer, 128.0f, count*2);
+                dsp::convert::s8ToComplex((int8_t*)buffer, stream.writeBuf, count, 0.0f, 1.0f / 128.0f);
                 break;
             case SAMPLE_TYPE_INT16:
-                volk_16i_s32f_convert_32f((float*)stream.writeBuf, (int16_t*)buffer, 32768.0f, count*2);
+                dsp::convert::s16ToComplex((int16_t*)buffer, stream.writeBuf, count, 0.0f, 1.0f / 32768.0f);
                 break;
             case SAMPLE_TYPE_INT32:
                 volk_32i_s32f_convert_32f((float*)stream.writeBuf, (int32_t*)buffer, 2147483647.0f, count*2);
@@ -8,6 +8,7 @@
 #include <iio.h>
 #include <ad9361.h>
 #include <utils/optionlist.h>
+#include <dsp/convert/raw_iq.h>
 #include <algorithm>
 #include <regex>
 
@@ -463,7 +464,7 @@ private:
             if (!buf) { break; }
 
             // Convert samples to CF32
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, buf, 32768.0f, blockSize * 2);
+            dsp::convert::s16ToComplex(buf, _this->stream.writeBuf, blockSize, 0.0f, 1.0f / 32768.0f);
 
             // Send out the samples
             if (!_this->stream.swap(blockSize)) { break; };
@@ -6,6 +6,8 @@
 #include <gui/style.h>
 #include <config.h>
 #include <gui/smgui.h>
+#include <dsp/ring_stream.h>
+#include <dsp/convert/raw_iq.h>
 #include <rtl-sdr.h>
 
 #ifdef __ANDROID__
@@ -522,10 +524,7 @@ private:
     static void asyncHandler(unsigned char* buf, uint32_t len, void* ctx) {
         RTLSDRSourceModule* _this = (RTLSDRSourceModule*)ctx;
         int sampCount = len / 2;
-        for (int i = 0; i < sampCount; i++) {
-            _this->stream.writeBuf[i].re = ((float)buf[i * 2] - 127.4) / 128.0f;
-            _this->stream.writeBuf[i].im = ((float)buf[(i * 2) + 1] - 127.4) / 128.0f;
-        }
+        dsp::convert::u8ToComplex(buf, _this->stream.writeBuf, sampCount, 127.4f, 1.0f / 128.0f);
         if (!_this->stream.swap(sampCount)) { return; }
     }
 
@@ -536,7 +535,7 @@ private:
     std::string name;
     rtlsdr_dev_t* openDev;
     bool enabled = true;
-    dsp::stream<dsp::complex_t> stream;
+    dsp::ring_stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
     bool running = false;
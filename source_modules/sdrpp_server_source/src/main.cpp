@@ -36,6 +36,10 @@ public:
         sampleTypeList.define("Int16", dsp::compression::PCM_TYPE_I16);
         sampleTypeList.define("Float32", dsp::compression::PCM_TYPE_F32);
         sampleTypeId = sampleTypeList.valueId(dsp::compression::PCM_TYPE_I16);
+        preprocessingList.define("none", "None", dsp::compression::PREPROCESS_NONE);
+        preprocessingList.define("shuffle", "Byte planes", dsp::compression::PREPROCESS_SHUFFLE);
+        preprocessingList.define("delta", "Delta + byte planes", dsp::compression::PREPROCESS_ALL);
+        preprocessingId = preprocessingList.valueId(dsp::compression::PREPROCESS_NONE);
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -46,6 +50,11 @@ public:
         handler.tuneHandler = tune;
         handler.stream = &stream;
 
+        fftRedrawHandler.ctx = this;
+        fftRedrawHandler.handler = fftRedraw;
+        vfoDeleteHandler.ctx = this;
+        vfoDeleteHandler.handler = vfoDeleted;
+
         // Load config
         config.acquire();
         std::string hostStr = config.conf["hostname"];
@@ -54,11 +63,17 @@ public:
         config.release();
 
         sigpath::sourceManager.registerSource("SDR++ Server", &handler);
+        gui::waterfall.onFFTRedraw.bindHandler(&fftRedrawHandler);
+        sigpath::vfoManager.onVfoDelete.bindHandler(&vfoDeleteHandler);
     }
 
     ~SDRPPServerSourceModule() {
         stop(this);
         sigpath::sourceManager.unregisterSource("SDR++ Server");
+        if (core::args["server"].b()) { return; }
+        gui::waterfall.onFFTRedraw.unbindHandler(&fftRedrawHandler);
+        sigpath::vfoManager.onVfoDelete.unbindHandler(&vfoDeleteHandler);
+        restoreLocalVFOs();
     }
 
     void postInit() {}
@@ -96,12 +111,15 @@ private:
             core::setInputSampleRate(_this->client->getSampleRate());
         }
         gui::mainWindow.playButtonLocked = !(_this->client && _this->client->isOpen());
+        _this->selected = true;
         flog::info("SDRPPServerSourceModule '{0}': Menu Select!", _this->name);
     }
 
     static void menuDeselected(void* ctx) {
         SDRPPServerSourceModule* _this = (SDRPPServerSourceModule*)ctx;
         gui::mainWindow.playButtonLocked = false;
+        _this->selected = false;
+        _this->restoreLocalVFOs();
         flog::info("SDRPPServerSourceModule '{0}': Menu Deselect!", _this->name);
     }
 
@@ -173,6 +191,7 @@ private:
             _this->tryConnect();
         }
         else if (connected && ImGui::Button("Disconnect##sdrpp_srv_source", ImVec2(menuWidth, 0))) {
+            _this->restoreLocalVFOs();
             _this->client->close();
         }
         if (_this->running) { style::endDisabled(); }
@@ -191,18 +210,54 @@ private:
             }
             
             if (ImGui::Checkbox("Compression", &_this->compression)) {
-                _this->client->setCompression(_this->compression);
+                _this->updateCompression();
+            }
+            if (_this->compression) {
+                ImGui::LeftLabel("Preprocessing");
+                ImGui::FillWidth();
+                if (ImGui::Combo("##sdrpp_srv_source_preproc", &_this->preprocessingId, _this->preprocessingList.txt)) {
+                    _this->updateCompression();
+                }
+
+                // In automatic mode the server picks the level and lowers the sample type to fit the link
+                if (ImGui::Checkbox("Automatic##sdrpp_srv_source_auto_comp", &_this->autoCompression)) {
+                    _this->updateCompression();
+                }
+                if (_this->autoCompression) {
+                    ImGui::LeftLabel("Link (kbit/s)");
+                    ImGui::FillWidth();
+                    if (ImGui::InputInt("##sdrpp_srv_source_link_bitrate", &_this->linkBitrate, 1000, 10000)) {
+                        _this->linkBitrate = std::max<int>(_this->linkBitrate, 0);
+                        _this->updateCompression();
+                    }
+                    if (!_this->linkBitrate) {
+                        ImGui::TextDisabled("Following the link");
+                    }
+                }
+                else {
+                    ImGui::LeftLabel("Level");
+                    ImGui::FillWidth();
+                    if (ImGui::SliderInt("##sdrpp_srv_source_comp_level", &_this->compressionLevel, 1, SERVER_MAX_COMPRESSION_LEVEL)) {
+                        _this->updateCompression();
+                    }
+                }
+            }
+
+            // Without the full IQ, only the spectrum and the VFOs computed by the server are received
+            if (ImGui::Checkbox("Full IQ", &_this->fullIQ)) {
+                // The local VFOs must be running again before the baseband comes back
+                if (_this->fullIQ) { _this->restoreLocalVFOs(); }
+                _this->client->setBaseband(_this->fullIQ);
+                _this->client->setFFT(!_this->fullIQ);
 
                 // Save config
                 config.acquire();
-                config.conf["servers"][_this->devConfName]["compression"] = _this->compression;
+                config.conf["servers"][_this->devConfName]["fullIQ"] = _this->fullIQ;
                 config.release(true);
             }
-
-            bool dummy = true;
-            style::beginDisabled();
-            ImGui::Checkbox("Full IQ", &dummy);
-            style::endDisabled();
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("When off, only the spectrum and the output of the VFOs are received, both computed by the server");
+            }
 
             // Calculate datarate
             _this->frametimeCounter += ImGui::GetIO().DeltaTime;
@@ -227,12 +282,89 @@ private:
         }
     }
 
+    void updateCompression() {
+        client->setCompression(compression, compressionLevel, preprocessingList[preprocessingId], autoCompression, linkBitrate);
+
+        // Save config
+        config.acquire();
+        config.conf["servers"][devConfName]["compression"] = compression;
+        config.conf["servers"][devConfName]["compressionLevel"] = compressionLevel;
+        config.conf["servers"][devConfName]["preprocessing"] = preprocessingList.key(preprocessingId);
+        config.conf["servers"][devConfName]["autoCompression"] = autoCompression;
+        config.conf["servers"][devConfName]["linkBitrate"] = linkBitrate;
+        config.release(true);
+    }
+
     bool connected() {
         return client && client->isOpen();
     }
 
+    static void fftRedraw(ImGui::WaterFall::FFTRedrawArgs args, void* ctx) {
+        SDRPPServerSourceModule* _this = (SDRPPServerSourceModule*)ctx;
+        _this->syncVFOs();
+
+        // Follow the size and zoom of the waterfall, only sent when the visible part changed
+        if (_this->selected && _this->connected()) { _this->client->updateFFT(); }
+    }
+
+    static void vfoDeleted(VFOManager::VFO* vfo, void* ctx) {
+        SDRPPServerSourceModule* _this = (SDRPPServerSourceModule*)ctx;
+        auto it = _this->remoteVFOs.find(vfo);
+        if (it == _this->remoteVFOs.end()) { return; }
+
+        // The output stream goes away with the VFO, no samples must be written to it anymore
+        if (_this->client) { _this->client->removeVFO(it->second.id); }
+        _this->remoteVFOs.erase(it);
+    }
+
+    // Without the full IQ, the VFOs are computed by the server. Their local DSP is detached and the samples from
+    // the server are written to the stream the demodulators read. Runs every frame to follow the VFOs.
+    void syncVFOs() {
+        if (!selected || !connected() || fullIQ) {
+            restoreLocalVFOs();
+            return;
+        }
+
+        dsp::compression::PCMType type = sampleTypeList[sampleTypeId];
+        int level = compression ? compressionLevel : 0;
+        for (auto const& [name, wtfVFO] : gui::waterfall.vfos) {
+            VFOManager::VFO* vfo = sigpath::vfoManager.getVFO(name);
+            if (!vfo) { continue; }
+            RemoteVFO rvfo = { -1, wtfVFO->centerOffset, vfo->dspVFO->getOutSamplerate(), vfo->getBandwidth(), type, level };
+
+            auto it = remoteVFOs.find(vfo);
+            if (it == remoteVFOs.end()) {
+                // Detached rather than only stopped, or baseband buffers still in flight would fill its input and
+                // block the splitter, and with it the client's worker
+                sigpath::iqFrontEnd.detachVFO(name);
+                rvfo.id = client->addVFO(rvfo.offset, rvfo.sampleRate, rvfo.bandwidth, rvfo.type, rvfo.compression, vfo->output);
+                remoteVFOs[vfo] = rvfo;
+                continue;
+            }
+
+            // Only send what changed
+            rvfo.id = it->second.id;
+            RemoteVFO& cur = it->second;
+            if (rvfo.offset == cur.offset && rvfo.sampleRate == cur.sampleRate && rvfo.bandwidth == cur.bandwidth && rvfo.type == cur.type && rvfo.compression == cur.compression) {
+                continue;
+            }
+            client->updateVFO(rvfo.id, rvfo.offset, rvfo.sampleRate, rvfo.bandwidth, rvfo.type, rvfo.compression);
+            cur = rvfo;
+        }
+    }
+
+    // Give the VFOs back to the local DSP
+    void restoreLocalVFOs() {
+        for (auto& [vfo, rvfo] : remoteVFOs) {
+            if (client) { client->removeVFO(rvfo.id); }
+            sigpath::iqFrontEnd.attachVFO(vfo->getName());
+        }
+        remoteVFOs.clear();
+    }
+
     void tryConnect() {
         try {
+            restoreLocalVFOs();
             if (client) { client.reset(); }
             client = server::connect(hostname, port, &stream);
             deviceInit();
@@ -258,15 +390,48 @@ private:
         if (config.conf["servers"][devConfName].contains("compression")) {
             compression = config.conf["servers"][devConfName]["compression"];
         }
+        compressionLevel = SERVER_DEFAULT_COMPRESSION_LEVEL;
+        if (config.conf["servers"][devConfName].contains("compressionLevel")) {
+            compressionLevel = std::clamp<int>(config.conf["servers"][devConfName]["compressionLevel"], 1, SERVER_MAX_COMPRESSION_LEVEL);
+        }
+        preprocessingId = preprocessingList.valueId(dsp::compression::PREPROCESS_NONE);
+        if (config.conf["servers"][devConfName].contains("preprocessing")) {
+            std::string key = config.conf["servers"][devConfName]["preprocessing"];
+            if (preprocessingList.keyExists(key)) { preprocessingId = preprocessingList.keyId(key); }
+        }
+        autoCompression = false;
+        if (config.conf["servers"][devConfName].contains("autoCompression")) {
+            autoCompression = config.conf["servers"][devConfName]["autoCompression"];
+        }
+        linkBitrate = 0;
+        if (config.conf["servers"][devConfName].contains("linkBitrate")) {
+            linkBitrate = config.conf["servers"][devConfName]["linkBitrate"];
+        }
+        fullIQ = true;
+        if (config.conf["servers"][devConfName].contains("fullIQ")) {
+            fullIQ = config.conf["servers"][devConfName]["fullIQ"];
+        }
 
         // Set settings
         client->setSampleType(sampleTypeList[sampleTypeId]);
-        client->setCompression(compression);
+        client->setCompression(compression, compressionLevel, preprocessingList[preprocessingId], autoCompression, linkBitrate);
+        client->setBaseband(fullIQ);
+        client->setFFT(!fullIQ);
     }
 
+    struct RemoteVFO {
+        int id;
+        double offset;
+        double sampleRate;
+        double bandwidth;
+        dsp::compression::PCMType type;
+        int compression;
+    };
+
     std::string name;
     bool enabled = true;
     bool running = false;
+    bool selected = false;
     
     double freq;
     bool serverBusy = false;
@@ -284,6 +449,16 @@ private:
     OptionList<std::string, dsp::compression::PCMType> sampleTypeList;
     int sampleTypeId;
     bool compression = false;
+    int compressionLevel = SERVER_DEFAULT_COMPRESSION_LEVEL;
+    OptionList<std::string, int> preprocessingList;
+    int preprocessingId;
+    bool autoCompression = false;
+    int linkBitrate = 0;
+    bool fullIQ = true;
+
+    EventHandler<ImGui::WaterFall::FFTRedrawArgs> fftRedrawHandler;
+    EventHandler<VFOManager::VFO*> vfoDeleteHandler;
+    std::map<VFOManager::VFO*, RemoteVFO> remoteVFOs;
 
     std::shared_ptr<server::Client> client;
 };
@@ -3,6 +3,7 @@
 #include <cstring>
 #include <utils/flog.h>
 #include <core.h>
+#include <gui/gui.h>
 
 using namespace std::chrono_literals;
 
@@ -14,6 +15,7 @@ namespace server {
         // Allocate buffers
         rbuffer = new uint8_t[SERVER_MAX_PACKET_SIZE];
         sbuffer = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        vfoBuffer = new uint8_t[SERVER_MAX_PACKET_SIZE];
 
         // Initialize headers
         r_pkt_hdr = (PacketHeader*)rbuffer;
@@ -63,6 +65,7 @@ namespace server {
         ZSTD_freeDCtx(dctx);
         delete[] rbuffer;
         delete[] sbuffer;
+        delete[] vfoBuffer;
     }
 
     void Client::showMenu() {
@@ -127,10 +130,137 @@ namespace server {
         sendCommand(COMMAND_SET_SAMPLE_TYPE, 1);
     }
 
-    void Client::setCompression(bool enabled) {
+    void Client::setCompression(bool enabled, int level, int preprocessing, bool automatic, uint32_t targetBitrate) {
         if (!isOpen()) { return; }
-         s_cmd_data[0] = enabled;
-        sendCommand(COMMAND_SET_COMPRESSION, 1);
+
+        // The single byte form is enough for the default settings and understood by older servers
+        if (!enabled || (level == SERVER_DEFAULT_COMPRESSION_LEVEL && !preprocessing && !automatic)) {
+            s_cmd_data[0] = enabled;
+            sendCommand(COMMAND_SET_COMPRESSION, 1);
+            return;
+        }
+
+        CompressionParams* params = (CompressionParams*)s_cmd_data;
+        params->level = level;
+        params->preprocessing = preprocessing;
+        params->automatic = automatic;
+        params->targetBitrate = targetBitrate;
+        sendCommand(COMMAND_SET_COMPRESSION, sizeof(CompressionParams));
+    }
+
+    void Client::setBaseband(bool enabled) {
+        if (!isOpen()) { return; }
+        s_cmd_data[0] = enabled;
+        sendCommand(COMMAND_SET_BASEBAND, 1);
+    }
+
+    int Client::addVFO(double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression, dsp::stream<dsp::complex_t>* out) {
+        if (!isOpen()) { return -1; }
+
+        // Register the output first since samples can arrive right after the command
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lck(vfoMtx);
+            id = nextVFOId++;
+            vfoOutputs[id] = out;
+        }
+
+        sendVFOParams(COMMAND_ADD_VFO, id, offset, sampleRate, bandwidth, type, compression);
+        return id;
+    }
+
+    void Client::updateVFO(int id, double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression) {
+        sendVFOParams(COMMAND_UPDATE_VFO, id, offset, sampleRate, bandwidth, type, compression);
+    }
+
+    void Client::removeVFO(int id) {
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(uint32_t)];
+        PacketHeader* hdr = (PacketHeader*)buf;
+        CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        hdr->type = PACKET_TYPE_COMMAND;
+        hdr->size = sizeof(buf);
+        chdr->cmd = COMMAND_REMOVE_VFO;
+        *(uint32_t*)&buf[sizeof(PacketHeader) + sizeof(CommandHeader)] = id;
+        {
+            std::lock_guard<std::mutex> lck(sendMtx);
+            if (isOpen()) { sock->send(buf, sizeof(buf)); }
+        }
+
+        std::unique_lock<std::mutex> lck(vfoMtx);
+        vfoOutputs.erase(id);
+        vfoCnd.wait(lck, [=](){ return vfoWriting != id; });
+    }
+
+    void Client::setFFT(bool enabled) {
+        fftEnabled = enabled;
+        fftParams = {};
+        if (enabled) {
+            updateFFT();
+            return;
+        }
+
+        // Tell the server to stop
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(FFTParams)] = { 0 };
+        PacketHeader* hdr = (PacketHeader*)buf;
+        CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        hdr->type = PACKET_TYPE_COMMAND;
+        hdr->size = sizeof(buf);
+        chdr->cmd = COMMAND_SET_FFT;
+        std::lock_guard<std::mutex> lck(sendMtx);
+        if (isOpen()) { sock->send(buf, sizeof(buf)); }
+    }
+
+    void Client::updateFFT() {
+        if (!fftEnabled || !isOpen()) { return; }
+
+        // Visible part of the waterfall, the same way it cuts it out of its raw FFT
+        FFTParams params = {};
+        params.enabled = true;
+        params.bins = gui::waterfall.getRawFFTSize();
+        double wholeBw = gui::waterfall.getBandwidth();
+        if (!params.bins || wholeBw <= 0.0) { return; }
+        double offsetRatio = gui::waterfall.getViewOffset() / (wholeBw / 2.0);
+        params.width = std::clamp<int>((gui::waterfall.getViewBandwidth() / wholeBw) * params.bins, 1, params.bins);
+        params.start = std::clamp<int>((((double)params.bins / 2.0) * (offsetRatio + 1)) - (params.width / 2), 0, params.bins - params.width);
+
+        // No more values than there are pixels
+        int pixels = 0;
+        if (gui::waterfall.acquireLatestFFT(pixels)) { gui::waterfall.releaseLatestFFT(); }
+        params.count = std::clamp<int>(pixels, 1, params.width);
+
+        core::configManager.acquire();
+        params.rate = core::configManager.conf["fftRate"];
+        core::configManager.release();
+
+        // Only send if something changed
+        if (!memcmp(&params, &fftParams, sizeof(FFTParams))) { return; }
+        fftParams = params;
+
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(FFTParams)];
+        PacketHeader* hdr = (PacketHeader*)buf;
+        CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        hdr->type = PACKET_TYPE_COMMAND;
+        hdr->size = sizeof(buf);
+        chdr->cmd = COMMAND_SET_FFT;
+        memcpy(&buf[sizeof(PacketHeader) + sizeof(CommandHeader)], &params, sizeof(FFTParams));
+        std::lock_guard<std::mutex> lck(sendMtx);
+        sock->send(buf, sizeof(buf));
+    }
+
+    void Client::pushFFT(const FFTHeader* fhdr, const uint8_t* data) {
+        float* fftBuf = gui::waterfall.getFFTBuffer();
+        if (!fftBuf) { return; }
+
+        // Frames made for another FFT size are dropped, the window is cut out the same way as on the server
+        if (fhdr->bins == gui::waterfall.getRawFFTSize() && (uint64_t)fhdr->start + fhdr->width <= fhdr->bins) {
+            for (int i = 0; i < fhdr->bins; i++) { fftBuf[i] = -1000.0f; }
+            for (int i = 0; i < fhdr->width; i++) {
+                uint8_t val = data[((uint64_t)i * fhdr->count) / fhdr->width];
+                if (val) { fftBuf[fhdr->start + i] = fhdr->min + ((float)(val - 1) * fhdr->step); }
+            }
+        }
+
+        gui::waterfall.pushFFT();
     }
 
     void Client::start() {
@@ -202,6 +332,11 @@ namespace server {
                 }
             }
             else if (r_pkt_hdr->type == PACKET_TYPE_COMMAND_ACK) {
+                // VFO commands aren't waited for, only report when the server refused one
+                if ((r_cmd_hdr->cmd == COMMAND_ADD_VFO || r_cmd_hdr->cmd == COMMAND_UPDATE_VFO || r_cmd_hdr->cmd == COMMAND_REMOVE_VFO) && r_cmd_data[0] != ERROR_NONE) {
+                    flog::error("The server refused a VFO command: {0}", r_cmd_data[0]);
+                }
+
                 // Notify waiters
                 std::vector<PacketWaiter*> toBeRemoved;
                 for (auto& [waiter, cmd] : commandAckWaiters) {
@@ -222,10 +357,48 @@ namespace server {
             }
             else if (r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
                 size_t outCount = ZSTD_decompressDCtx(dctx, decompIn.writeBuf, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, r_pkt_data, r_pkt_hdr->size - sizeof(PacketHeader));
-                if (outCount) {
+                if (outCount && !ZSTD_isError(outCount)) {
                     if (!decompIn.swap(outCount)) { break; }
                 };
             }
+            else if (r_pkt_hdr->type == PACKET_TYPE_VFO && r_pkt_hdr->size > sizeof(PacketHeader) + sizeof(VFOHeader)) {
+                VFOHeader* vhdr = (VFOHeader*)r_pkt_data;
+                uint8_t* data = &r_pkt_data[sizeof(VFOHeader)];
+                size_t size = r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(VFOHeader);
+                if (vhdr->compressed) {
+                    size = ZSTD_decompressDCtx(dctx, vfoBuffer, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, data, size);
+                    if (ZSTD_isError(size)) { continue; }
+                    data = vfoBuffer;
+                }
+
+                // Samples of VFOs that were already removed are dropped. The stream is only looked up under the lock,
+                // removeVFO() waits for vfoWriting to change before the stream can go away
+                dsp::stream<dsp::complex_t>* out;
+                {
+                    std::lock_guard<std::mutex> lck(vfoMtx);
+                    auto it = vfoOutputs.find(vhdr->id);
+                    if (it == vfoOutputs.end() || size < 8) { continue; }
+                    out = it->second;
+                    vfoWriting = vhdr->id;
+                }
+
+                // Don't block the worker, and with it the command acks, on a reader that is behind
+                if (!out->getOccupancy()) {
+                    int count = vfoDecomp.process(size, data, out->writeBuf);
+                    if (count) { out->swap(count); }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lck(vfoMtx);
+                    vfoWriting = -1;
+                }
+                vfoCnd.notify_all();
+            }
+            else if (r_pkt_hdr->type == PACKET_TYPE_FFT && r_pkt_hdr->size >= sizeof(PacketHeader) + sizeof(FFTHeader)) {
+                FFTHeader* fhdr = (FFTHeader*)r_pkt_data;
+                if (r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(FFTHeader) < fhdr->count || !fhdr->count) { continue; }
+                if (fftEnabled) { pushFFT(fhdr, &r_pkt_data[sizeof(FFTHeader)]); }
+            }
             else if (r_pkt_hdr->type == PACKET_TYPE_ERROR) {
                 flog::error("SDR++ Server Error: {0}", rbuffer[sizeof(PacketHeader)]);
             }
@@ -235,6 +408,24 @@ namespace server {
         }
     }
 
+    void Client::sendVFOParams(Command cmd, uint32_t id, double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression) {
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(VFOParams)];
+        PacketHeader* hdr = (PacketHeader*)buf;
+        CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        VFOParams* params = (VFOParams*)&buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+        hdr->type = PACKET_TYPE_COMMAND;
+        hdr->size = sizeof(buf);
+        chdr->cmd = cmd;
+        params->id = id;
+        params->sampleType = type;
+        params->compression = std::clamp<int>(compression, 0, SERVER_MAX_COMPRESSION_LEVEL);
+        params->offset = offset;
+        params->sampleRate = sampleRate;
+        params->bandwidth = bandwidth;
+        std::lock_guard<std::mutex> lck(sendMtx);
+        if (isOpen()) { sock->send(buf, sizeof(buf)); }
+    }
+
     int Client::getUI() {
         if (!isOpen()) { return -1; }
         auto waiter = awaitCommandAck(COMMAND_GET_UI);
@@ -255,6 +446,7 @@ namespace server {
     void Client::sendPacket(PacketType type, int len) {
         s_pkt_hdr->type = type;
         s_pkt_hdr->size = sizeof(PacketHeader) + len;
+        std::lock_guard<std::mutex> lck(sendMtx);
         sock->send(sbuffer, s_pkt_hdr->size);
     }
 
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <queue>
 #include <server_protocol.h>
+#include <server_compression.h>
 #include <atomic>
 #include <map>
 #include <vector>
@@ -87,7 +88,24 @@ namespace server {
         double getSampleRate();
         
         void setSampleType(dsp::compression::PCMType type);
-        void setCompression(bool enabled);
+        // In automatic mode, the server picks the sample type and level to fit the target bitrate (kbit/s) or the link
+        void setCompression(bool enabled, int level = SERVER_DEFAULT_COMPRESSION_LEVEL, int preprocessing = dsp::compression::PREPROCESS_NONE, bool automatic = false, uint32_t targetBitrate = 0);
+        void setBaseband(bool enabled);
+
+        // VFOs computed by the server, only their output is sent over the network. The commands don't wait for the
+        // server, so they can be sent from the GUI thread at any time. addVFO returns the ID of the VFO or -1 if not
+        // connected. compression is the zstd level, 0 for none. Samples are dropped while the output stream isn't read
+        // and none are written to it once removeVFO returns.
+        int addVFO(double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression, dsp::stream<dsp::complex_t>* out);
+        void updateVFO(int id, double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression);
+        void removeVFO(int id);
+
+        // Have the server compute the spectrum of the visible part of the waterfall and feed it to the waterfall
+        void setFFT(bool enabled);
+
+        // Send the visible part of the waterfall if it changed. Must be called from the GUI thread whenever the
+        // waterfall may have been resized or zoomed, nothing is sent until it has an FFT size.
+        void updateFFT();
 
         void start();
         void stop();
@@ -102,6 +120,8 @@ namespace server {
         void worker();
 
         int getUI();
+        void sendVFOParams(Command cmd, uint32_t id, double offset, double sampleRate, double bandwidth, dsp::compression::PCMType type, int compression);
+        void pushFFT(const FFTHeader* fhdr, const uint8_t* data);
 
         void sendPacket(PacketType type, int len);
         void sendCommand(Command cmd, int len);
@@ -117,6 +137,7 @@ namespace server {
 
         dsp::stream<uint8_t> decompIn;
         dsp::compression::SampleStreamDecompressor decomp;
+        dsp::compression::SampleStreamDecompressor vfoDecomp;
         dsp::routing::StreamLink<dsp::complex_t> link;
         dsp::stream<dsp::complex_t>* output;
 
@@ -138,6 +159,17 @@ namespace server {
 
         ZSTD_DCtx* dctx;
 
+        std::map<uint32_t, dsp::stream<dsp::complex_t>*> vfoOutputs;
+        std::mutex vfoMtx;
+        std::condition_variable vfoCnd;
+        int64_t vfoWriting = -1;
+        uint32_t nextVFOId = 0;
+        uint8_t* vfoBuffer = NULL;
+
+        bool fftEnabled = false;
+        FFTParams fftParams = {};
+        std::mutex sendMtx;
+
         std::thread workerThread;
 
         double currentSampleRate = 1000000.0;